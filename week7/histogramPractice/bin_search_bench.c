@@ -0,0 +1,205 @@
+/* COMP 137 Spring 2019
+ * filename: bin_search_bench.c
+ *
+ * Purpose:   Compare ways of finding the bin of a measurement when the
+ *            bins are not uniform: findBin, the original search of the
+ *            histogram programs kept here as the reference, a branch
+ *            free binary search over the sorted edges (binSearch) and
+ *            the interleaved Eytzinger search of histogram_bins.h.
+ *
+ *            The bins are log-scale, like latency bins, from min_meas
+ *            to max_meas, and the data is spread evenly in log scale.
+ *            Bin counts go from 16 to 1M by factors of 4.  Each search
+ *            must give the same bins as findBin.
+ *
+ * Program arguments: ./bin_search_bench <data_count> [repetitions]
+ *   <data_count>  = number of values searched for each bin count
+ *   [repetitions] = best of this many timings (default 3)
+ *
+ * How to compile: gcc -O3 -march=native -o bin_search_bench bin_search_bench.c -lm
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "timer.h"
+#include "histogram_bins.h"
+
+#define MIN_BINS 16
+#define MAX_BINS (1 << 20)
+
+const float min_meas = 1.0f;        /* 1 us */
+const float max_meas = 1.0e7f;      /* 10 s */
+
+void usage(char prog_name[]);
+
+void createLogBins(
+    float min_meas      /* in  */,
+    float max_meas      /* in  */,
+    float bin_maxes[]   /* out */,
+    int   bin_count     /* in  */);
+
+int findBin(
+    float    data         /* in */,
+    float    bin_maxes[]  /* in */,
+    int      bin_count    /* in */,
+    float    min_meas     /* in */);
+
+int main(int argc, char* argv[])
+{
+    long data_count, i;
+    int repetitions = 3, rep, bin_count;
+    float* data;
+    float* bin_maxes;
+    int* expected;
+    int* bins;
+    BIN_MAP bin_map;
+    double t1, t2, find_time, search_time, eytzinger_time;
+
+    if (argc != 2 && argc != 3) usage(argv[0]);
+    data_count = strtol(argv[1], NULL, 10);
+    if (argc == 3) repetitions = strtol(argv[2], NULL, 10);
+    if (data_count < 1 || repetitions < 1) usage(argv[0]);
+
+    data = malloc(data_count*sizeof(float));
+    expected = malloc(data_count*sizeof(int));
+    bins = malloc(data_count*sizeof(int));
+    bin_maxes = malloc(MAX_BINS*sizeof(float));
+
+    /* even in log scale, so every part of the bins is searched */
+    srand(0);
+    for (i = 0; i < data_count; i++)
+    {
+        data[i] = min_meas * powf(max_meas / min_meas, rand() / (RAND_MAX + 1.0f));
+        if (data[i] >= max_meas) data[i] = min_meas;
+    }
+
+    printf("%8s %12s %12s %12s   (ns per value)\n", "bins", "findBin", "binSearch", "eytzinger");
+    for (bin_count = MIN_BINS; bin_count <= MAX_BINS; bin_count *= 4)
+    {
+        createLogBins(min_meas, max_meas, bin_maxes, bin_count);
+        binMapInit(&bin_map, bin_maxes, bin_count, min_meas);
+        find_time = search_time = eytzinger_time = 1e30;
+
+        for (rep = 0; rep < repetitions; rep++)
+        {
+            GET_TIME(t1);
+            for (i = 0; i < data_count; i++)
+                expected[i] = findBin(data[i], bin_maxes, bin_count, min_meas);
+            GET_TIME(t2);
+            if (t2 - t1 < find_time) find_time = t2 - t1;
+
+            GET_TIME(t1);
+            for (i = 0; i < data_count; i++)
+                bins[i] = binSearch(&bin_map, data[i]);
+            GET_TIME(t2);
+            if (t2 - t1 < search_time) search_time = t2 - t1;
+            for (i = 0; i < data_count; i++)
+                if (bins[i] != expected[i])
+                {
+                    fprintf(stderr, "binSearch: data = %f in bin %d, not %d\n", data[i], bins[i], expected[i]);
+                    exit(-1);
+                }
+
+            GET_TIME(t1);
+            binBatch(&bin_map, data, bins, data_count);
+            GET_TIME(t2);
+            if (t2 - t1 < eytzinger_time) eytzinger_time = t2 - t1;
+            for (i = 0; i < data_count; i++)
+                if (bins[i] != expected[i])
+                {
+                    fprintf(stderr, "eytzinger: data = %f in bin %d, not %d\n", data[i], bins[i], expected[i]);
+                    exit(-1);
+                }
+        }
+
+        printf("%8d %12.2f %12.2f %12.2f%s\n", bin_count,
+               find_time / data_count * 1e9,
+               search_time / data_count * 1e9,
+               eytzinger_time / data_count * 1e9,
+               bin_map.uniform ? "   (uniform)" : "");
+        binMapFree(&bin_map);
+    }
+
+    free(data);
+    free(expected);
+    free(bins);
+    free(bin_maxes);
+    return 0;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  usage
+ * Purpose:   Print a message showing how to run program and quit
+ * In arg:    prog_name:  the name of the program from the command line
+ */
+void usage(char prog_name[] /* in */)
+{
+    fprintf(stderr, "usage: %s ", prog_name);
+    fprintf(stderr, "<data_count> [repetitions]\n");
+    exit(0);
+}  /* Usage */
+
+
+/*---------------------------------------------------------------------
+ * Function:  createLogBins
+ * Purpose:   Compute max value for each bin, with bins of equal width
+ *            in log scale
+ * In args:   min_meas:   the minimum possible measurement
+ *            max_meas:   the maximum possible measurement
+ *            bin_count:  the number of bins
+ * Out arg:   bin_maxes:  the maximum possible value for each bin
+ */
+void createLogBins(
+    float min_meas      /* in  */,
+    float max_meas      /* in  */,
+    float bin_maxes[]   /* out */,
+    int   bin_count     /* in  */)
+{
+    double ratio = pow((double)max_meas / min_meas, 1.0 / bin_count);
+    int i;
+
+    for (i = 0; i < bin_count; i++)
+        bin_maxes[i] = min_meas * pow(ratio, i+1);
+    bin_maxes[bin_count-1] = max_meas;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  findBin
+ * Purpose:   Use binary search to determine which bin a measurement
+ *            belongs to (the same as in histogram.c)
+ * In args:   data:       the current measurement
+ *            bin_maxes:  list of max bin values
+ *            bin_count:  number of bins
+ *            min_meas:   the minimum possible measurement
+ * Return:    the number of the bin to which data belongs
+ */
+int findBin(
+    float   data          /* in */,
+    float   bin_maxes[]   /* in */,
+    int     bin_count     /* in */,
+    float   min_meas      /* in */)
+{
+    int bottom = 0, top =  bin_count-1;
+    int mid;
+    float bin_max, bin_min;
+
+    while (bottom <= top)
+    {
+        mid = (bottom + top)/2;
+        bin_max = bin_maxes[mid];
+        bin_min = (mid == 0) ? min_meas: bin_maxes[mid-1];
+        if (data >= bin_max)
+            bottom = mid+1;
+        else if (data < bin_min)
+            top = mid-1;
+        else
+            return mid;
+    }
+
+    /* Whoops! (this should not happen)*/
+    fprintf(stderr, "Data = %f doesn't belong to a bin!\n", data);
+    fprintf(stderr, "Quitting\n");
+    exit(-1);
+}
@@ -0,0 +1,314 @@
+/* File:     cbrng.h
+ * COMP 137 Spring 2019
+ *
+ * Purpose:  Counter-based random numbers for the histogram programs.
+ *           Philox4x32-10 (Salmon et al., "Parallel random numbers: as
+ *           easy as 1, 2, 3", SC11) turns a 128-bit counter and a 64-bit
+ *           key into four random 32-bit words.  The counter is the index
+ *           of the value and the key is the seed, so data[i] is a pure
+ *           function of (seed, i): any thread can fill any part of the
+ *           array, in any order, and the result is the same bits for
+ *           every thread count.
+ *
+ *           One Philox call gives the values of four consecutive
+ *           indices.  cbrngFill computes CBRNG_LANES calls side by side,
+ *           in one AVX-512 register per word when available (the
+ *           compiler does not vectorize the 32x32->64 bit multiplies of
+ *           the plain loop), and turns them into floats in loops that
+ *           the compiler vectorizes (-O3).  Both paths give the same
+ *           bits; cbrngCheck tests them against the published known
+ *           answer, and histogram and histogram_pthreads run it first.
+ *
+ *           Distributions, all in min_meas <= x < max_meas:
+ *           CBRNG_UNIFORM  uniform
+ *           CBRNG_NORMAL   normal (Box-Muller), mean in the middle of the
+ *                          range and standard deviation 1/8 of it; the
+ *                          few values beyond 4 standard deviations are
+ *                          clamped into the range
+ *           CBRNG_PARETO   heavy tailed: bounded Pareto, shape 1.1, from
+ *                          1 to 1000 scaled onto the range, so most values
+ *                          are near min_meas with a long tail to max_meas
+ */
+#ifndef _CBRNG_H_
+#define _CBRNG_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#if defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+/* Philox calls computed side by side */
+#define CBRNG_LANES 16
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+
+typedef enum {
+    CBRNG_UNIFORM,
+    CBRNG_NORMAL,
+    CBRNG_PARETO
+} CBRNG_DISTRIBUTION;
+
+static const char* cbrng_names[] = { "uniform", "normal", "pareto" };
+
+
+/*---------------------------------------------------------------------
+ * Function:  cbrngDistributionFromName
+ * Return:    the distribution with that name, -1 if there is none
+ */
+static inline int cbrngDistributionFromName(const char* name /* in */)
+{
+    int d;
+
+    for (d = 0; d < (int)(sizeof(cbrng_names) / sizeof(cbrng_names[0])); d++)
+        if (strcmp(name, cbrng_names[d]) == 0) return d;
+    return -1;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  philoxLanesScalar
+ * Purpose:   Philox4x32-10 of the counters (block[l], 0, 0, 0) for
+ *            CBRNG_LANES lanes, one 32-bit word at a time
+ * In args:   block:  counter of each lane
+ *            seed:   the key
+ * Out arg:   out:    out[w][l] is word w of lane l
+ */
+static inline void philoxLanesScalar(
+    const uint64_t block[CBRNG_LANES]    /* in  */,
+    uint64_t       seed                  /* in  */,
+    uint32_t       out[4][CBRNG_LANES]   /* out */)
+{
+    uint32_t c0[CBRNG_LANES], c1[CBRNG_LANES], c2[CBRNG_LANES], c3[CBRNG_LANES];
+    uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed >> 32);
+    int l, round;
+
+    for (l = 0; l < CBRNG_LANES; l++)
+    {
+        c0[l] = (uint32_t)block[l];
+        c1[l] = (uint32_t)(block[l] >> 32);
+        c2[l] = 0;
+        c3[l] = 0;
+    }
+    for (round = 0; round < 10; round++)
+    {
+        for (l = 0; l < CBRNG_LANES; l++)
+        {
+            uint64_t p0 = (uint64_t)PHILOX_M0 * c0[l];
+            uint64_t p1 = (uint64_t)PHILOX_M1 * c2[l];
+            uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1[l] ^ k0;
+            uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3[l] ^ k1;
+            c1[l] = (uint32_t)p1;
+            c3[l] = (uint32_t)p0;
+            c0[l] = n0;
+            c2[l] = n2;
+        }
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    for (l = 0; l < CBRNG_LANES; l++)
+    {
+        out[0][l] = c0[l];
+        out[1][l] = c1[l];
+        out[2][l] = c2[l];
+        out[3][l] = c3[l];
+    }
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  philoxLanes
+ * Purpose:   philoxLanesScalar, in AVX-512 registers when available
+ * In args:   block:  counter of each lane
+ *            seed:   the key
+ * Out arg:   out:    out[w][l] is word w of lane l
+ */
+static inline void philoxLanes(
+    const uint64_t block[CBRNG_LANES]    /* in  */,
+    uint64_t       seed                  /* in  */,
+    uint32_t       out[4][CBRNG_LANES]   /* out */)
+{
+#if defined(__AVX512F__)
+    uint32_t c0[CBRNG_LANES], c1[CBRNG_LANES], c2[CBRNG_LANES], c3[CBRNG_LANES];
+    uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed >> 32);
+    int l, round;
+
+    for (l = 0; l < CBRNG_LANES; l++)
+    {
+        c0[l] = (uint32_t)block[l];
+        c1[l] = (uint32_t)(block[l] >> 32);
+        c2[l] = 0;
+        c3[l] = 0;
+    }
+    {
+        /* _mm512_mul_epu32 multiplies the even 32-bit words; the odd
+           words are shifted down and multiplied separately */
+        const __m512i m0 = _mm512_set1_epi64(PHILOX_M0);
+        const __m512i m1 = _mm512_set1_epi64(PHILOX_M1);
+        const __m512i odd = _mm512_set_epi32(31, 15, 29, 13, 27, 11, 25, 9, 23, 7, 21, 5, 19, 3, 17, 1);
+        const __m512i even = _mm512_set_epi32(30, 14, 28, 12, 26, 10, 24, 8, 22, 6, 20, 4, 18, 2, 16, 0);
+        __m512i v0 = _mm512_loadu_si512(c0), v1 = _mm512_loadu_si512(c1);
+        __m512i v2 = _mm512_loadu_si512(c2), v3 = _mm512_loadu_si512(c3);
+
+        for (round = 0; round < 10; round++)
+        {
+            __m512i p0e = _mm512_mul_epu32(v0, m0);
+            __m512i p0o = _mm512_mul_epu32(_mm512_srli_epi64(v0, 32), m0);
+            __m512i p1e = _mm512_mul_epu32(v2, m1);
+            __m512i p1o = _mm512_mul_epu32(_mm512_srli_epi64(v2, 32), m1);
+            __m512i hi0 = _mm512_permutex2var_epi32(p0e, odd, p0o);
+            __m512i lo0 = _mm512_permutex2var_epi32(p0e, even, p0o);
+            __m512i hi1 = _mm512_permutex2var_epi32(p1e, odd, p1o);
+            __m512i lo1 = _mm512_permutex2var_epi32(p1e, even, p1o);
+
+            v0 = _mm512_xor_si512(_mm512_xor_si512(hi1, v1), _mm512_set1_epi32(k0));
+            v2 = _mm512_xor_si512(_mm512_xor_si512(hi0, v3), _mm512_set1_epi32(k1));
+            v1 = lo1;
+            v3 = lo0;
+            k0 += PHILOX_W0;
+            k1 += PHILOX_W1;
+        }
+        _mm512_storeu_si512(out[0], v0);
+        _mm512_storeu_si512(out[1], v1);
+        _mm512_storeu_si512(out[2], v2);
+        _mm512_storeu_si512(out[3], v3);
+    }
+#else
+    philoxLanesScalar(block, seed, out);
+#endif
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  cbrngCheck
+ * Purpose:   Known-answer test: Philox4x32-10 of counter 0 and key 0 is
+ *            6627e8d5 e169c58d bc57ac4c 9b00dbd8 (Random123), and
+ *            philoxLanes must give the same words as philoxLanesScalar
+ *            for every lane, including counters above 2^32
+ * Return:    1 if both hold, 0 if not
+ */
+static inline int cbrngCheck(void)
+{
+    static const uint32_t known[4] = { 0x6627e8d5u, 0xe169c58du, 0xbc57ac4cu, 0x9b00dbd8u };
+    uint64_t block[CBRNG_LANES];
+    uint32_t fast[4][CBRNG_LANES], slow[4][CBRNG_LANES];
+    int l, w;
+
+    for (l = 0; l < CBRNG_LANES; l++)
+        block[l] = (l == 0) ? 0 : (uint64_t)l * 0x9E3779B97F4A7C15ull;
+    philoxLanes(block, 0, fast);
+    philoxLanesScalar(block, 0, slow);
+    for (w = 0; w < 4; w++)
+        if (fast[w][0] != known[w] || slow[w][0] != known[w]) return 0;
+    philoxLanes(block, 0x0123456789abcdefull, fast);
+    philoxLanesScalar(block, 0x0123456789abcdefull, slow);
+    return memcmp(fast, slow, sizeof(fast)) == 0;
+}
+
+
+/* 24 random bits to a float in [0, 1) */
+static inline float cbrngUnit(uint32_t u)
+{
+    return (u >> 8) * (1.0f / 16777216.0f);
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  cbrngFill
+ * Purpose:   Store the values with indices first .. first+count-1
+ * In args:   seed:          the key
+ *            distribution:  see above
+ *            min_meas:      smallest possible value
+ *            max_meas:      values are below max_meas
+ *            first:         index of data[0]
+ *            count:         number of values
+ * Out arg:   data
+ * Note:      Whole groups of 4*CBRNG_LANES indices are always computed
+ *            the same way, so a value does not depend on where the
+ *            range it was filled with starts or ends.  Multiply-adds are
+ *            not fused into FMAs here, so the floats round the same way
+ *            whatever the program is compiled for.
+ */
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+static inline void cbrngFill(
+    uint64_t           seed          /* in  */,
+    CBRNG_DISTRIBUTION distribution  /* in  */,
+    float              min_meas      /* in  */,
+    float              max_meas      /* in  */,
+    float              data[]        /* out */,
+    long               first         /* in  */,
+    long               count         /* in  */)
+{
+    const long group = 4 * CBRNG_LANES;
+    const float range = max_meas - min_meas;
+    const float top = nextafterf(max_meas, min_meas);
+    /* bounded Pareto, shape a from L to H */
+    const float a = 1.1f, L = 1.0f, H = 1000.0f;
+    const float La = powf(L, a), Ha = powf(H, a);
+    long g;
+
+    for (g = first / group * group; g < first + count; g += group)
+    {
+        uint64_t block[CBRNG_LANES];
+        uint32_t out[4][CBRNG_LANES];
+        float values[4*CBRNG_LANES];
+        long lo, hi;
+        int l, w;
+
+        for (l = 0; l < CBRNG_LANES; l++)
+            block[l] = (uint64_t)g / 4 + l;
+        philoxLanes(block, seed, out);
+
+        /* value of index g + 4*l + w comes from word w of lane l */
+        if (distribution == CBRNG_NORMAL)
+        {
+            for (l = 0; l < CBRNG_LANES; l++)
+                for (w = 0; w < 4; w += 2)
+                {
+                    /* words 0,1 and 2,3 make two pairs */
+                    float u1 = 1.0f - cbrngUnit(out[w][l]);
+                    float u2 = cbrngUnit(out[w+1][l]);
+                    float r = sqrtf(-2.0f * logf(u1));
+                    values[4*l + w] = r * cosf(2.0f * (float)M_PI * u2);
+                    values[4*l + w + 1] = r * sinf(2.0f * (float)M_PI * u2);
+                }
+            for (l = 0; l < 4*CBRNG_LANES; l++)
+                values[l] = min_meas + range * (0.5f + values[l] / 8.0f);
+        }
+        else if (distribution == CBRNG_PARETO)
+        {
+            for (l = 0; l < CBRNG_LANES; l++)
+                for (w = 0; w < 4; w++)
+                {
+                    float u = cbrngUnit(out[w][l]);
+                    float p = powf(-(u*Ha - u*La - Ha) / (Ha*La), -1.0f / a);
+                    values[4*l + w] = min_meas + range * (p - L) / (H - L);
+                }
+        }
+        else
+        {
+            for (l = 0; l < CBRNG_LANES; l++)
+                for (w = 0; w < 4; w++)
+                    values[4*l + w] = min_meas + range * cbrngUnit(out[w][l]);
+        }
+        /* keep min_meas <= x < max_meas */
+        for (l = 0; l < 4*CBRNG_LANES; l++)
+        {
+            float x = values[l];
+            x = (x < min_meas) ? min_meas : x;
+            values[l] = (x > top) ? top : x;
+        }
+
+        lo = (g < first) ? first : g;
+        hi = (g + group > first + count) ? first + count : g + group;
+        memcpy(&data[lo - first], &values[lo - g], (hi - lo) * sizeof(float));
+    }
+}
+#pragma GCC pop_options
+
+#endif
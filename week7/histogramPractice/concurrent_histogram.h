@@ -0,0 +1,259 @@
+/* File:     concurrent_histogram.h
+ * COMP 137 Spring 2019
+ *
+ * Purpose:  A histogram that any number of threads record into all the
+ *           time, while others now and then take a snapshot of it: the
+ *           request threads of a server, say, with a metrics thread.
+ *           There is no barrier and no final merge.
+ *
+ *           The counts are striped by writer.  Each thread gets a number
+ *           the first time it records and adds to the stripe of that
+ *           number (modulo stripes), so with a stripe per expected
+ *           writer no two writers share a cache line.  More writers
+ *           than that share stripes, so the adds are relaxed atomic adds
+ *           (one uncontended lock add on x86).  Striping by CPU would
+ *           need fewer rows, but a writer preempted inside a batch then
+ *           holds back the stripe of every thread on its CPU (below).
+ *
+ *           Each stripe has two rows, for two phases, and a phaser in
+ *           the style of HdrHistogram's WriterReaderPhaser: a writer
+ *           enters with one atomic add, which also tells it the current
+ *           phase, adds its values to that phase's row, and leaves with
+ *           another atomic add.  A snapshot flips every stripe to the
+ *           other phase with an atomic exchange, and moves the old row
+ *           of each stripe whose writers have all left into the totals.
+ *           A stripe with a writer still inside (one that was preempted
+ *           half way through a batch, likely when there are many more
+ *           threads than CPUs) is waited for only CONC_SNAPSHOT_SPINS
+ *           checks, which is plenty for a writer that is running; after
+ *           that it is left for a later snapshot, which drains it before
+ *           flipping it again.  Waiting for a preempted writer instead
+ *           takes until the scheduler runs it again, about a time slice
+ *           per runnable thread (a quarter of a second with 64 threads
+ *           on one CPU); with a stripe per writer only that writer's
+ *           values lag.  So:
+ *
+ *             - recording is wait free: a fixed number of steps, never a
+ *               lock and never a wait for the reader or other writers;
+ *             - a snapshot never stops the writers, and waits for them
+ *               for at most a few microseconds per stripe;
+ *             - a snapshot holds either all or none of the values of a
+ *               concRecordBatch call, so its counts are consistent with
+ *               each other, though a late stripe makes its writer's
+ *               values lag behind.
+ *
+ *           Columns are bins shifted up by one, with column 0 for values
+ *           below min_meas and column bin_count+1 for those at or above
+ *           the last edge (and NaN), as in window_histogram.h.
+ *
+ * Note:     The rows take 2 * writers * (bin_count + 2) longs, and a
+ *           snapshot adds them all up.  Compile with -lpthread.
+ *
+ * Example:
+ *    CONC_HISTOGRAM hist;
+ *    concInit(&hist, bin_maxes, bin_count, min_meas, num_threads);
+ *    any thread:    concRecord(&hist, value);  or  concRecordBatch(&hist, values, count);
+ *    reader:        concSnapshot(&hist, counts);
+ */
+#ifndef _CONCURRENT_HISTOGRAM_H_
+#define _CONCURRENT_HISTOGRAM_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "histogram_bins.h"
+
+/* times a snapshot checks a stripe with a writer inside before leaving
+   it: a few microseconds, enough for a writer that is running */
+#define CONC_SNAPSHOT_SPINS 4096
+
+/* writer numbers, handed out as threads first record */
+static unsigned conc_next_writer = 0;
+static __thread unsigned conc_writer = 0;
+static __thread int conc_numbered = 0;
+
+typedef struct {
+    long    start;        /* 2 * writers entered in this phase + the phase */
+    long    end[2];       /* writers that left, per phase */
+    long    draining;     /* snapshots only: writers of the old phase, -1 once drained */
+    long    pad[4];       /* a cache line per stripe */
+} CONC_PHASER;
+
+typedef struct {
+    BIN_MAP map;          /* the bins */
+    int     columns;      /* bin_count + 2 */
+    int     stripes;      /* one per expected writer */
+    long    stride;       /* longs from one row to the next */
+    long*   counts;       /* 2 phases * stripes rows, 64-byte aligned */
+    CONC_PHASER* phasers; /* per stripe */
+    long*   totals;       /* columns counts already moved out of the rows */
+    pthread_mutex_t snapshot_lock;
+} CONC_HISTOGRAM;
+
+
+/*---------------------------------------------------------------------
+ * Function:  concInit
+ * Purpose:   Set up an empty histogram with a stripe per writer
+ * In args:   bin_maxes, bin_count, min_meas:  the bins, as for binMapInit
+ *            writers:  threads expected to record; more can, sharing
+ *                      stripes
+ * Out arg:   hist, free with concFree
+ */
+static inline void concInit(
+    CONC_HISTOGRAM* hist         /* out */,
+    float           bin_maxes[]  /* in  */,
+    int             bin_count    /* in  */,
+    float           min_meas     /* in  */,
+    int             writers      /* in  */)
+{
+    size_t bytes;
+    int i;
+
+    binMapInit(&hist->map, bin_maxes, bin_count, min_meas);
+    hist->columns = bin_count + 2;
+    hist->stripes = (writers > 0) ? writers : 1;
+    /* whole cache lines (8 longs) per row */
+    hist->stride = ((long)hist->columns + 7) / 8 * 8;
+    bytes = (size_t)2 * hist->stripes * hist->stride * sizeof(long);
+    hist->counts = aligned_alloc(64, bytes);
+    memset(hist->counts, 0, bytes);
+    hist->phasers = aligned_alloc(64, hist->stripes * sizeof(CONC_PHASER));
+    memset(hist->phasers, 0, hist->stripes * sizeof(CONC_PHASER));
+    for (i = 0; i < hist->stripes; i++)
+        hist->phasers[i].draining = -1;
+    hist->totals = calloc(hist->columns, sizeof(long));
+    pthread_mutex_init(&hist->snapshot_lock, NULL);
+}
+
+static inline void concFree(CONC_HISTOGRAM* hist)
+{
+    binMapFree(&hist->map);
+    free(hist->counts);
+    free(hist->phasers);
+    free(hist->totals);
+    pthread_mutex_destroy(&hist->snapshot_lock);
+    hist->counts = NULL;
+    hist->phasers = NULL;
+    hist->totals = NULL;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  concRecordBatch
+ * Purpose:   Count count values, all in the same snapshots
+ * In args:   values, count
+ * In/out:    hist
+ * Note:      Wait free; safe to call from any number of threads while
+ *            another takes a snapshot.
+ */
+static inline void concRecordBatch(
+    CONC_HISTOGRAM* hist    /* in/out */,
+    const float*    values  /* in     */,
+    long            count   /* in     */)
+{
+    int bins[BIN_BATCH];
+    int stripe, phase;
+    CONC_PHASER* phaser;
+    long entered;
+    long* row;
+    long i, j, n;
+
+    if (!conc_numbered)
+    {
+        /* wraps after 2^32 threads, which only makes more share stripes */
+        conc_writer = __atomic_fetch_add(&conc_next_writer, 1, __ATOMIC_RELAXED);
+        conc_numbered = 1;
+    }
+    stripe = (int)(conc_writer % (unsigned)hist->stripes);
+    phaser = &hist->phasers[stripe];
+    /* enter: no add below can move above this */
+    entered = __atomic_fetch_add(&phaser->start, 2, __ATOMIC_ACQUIRE);
+    phase = entered & 1;
+    row = hist->counts + ((long)phase * hist->stripes + stripe) * hist->stride;
+
+    for (i = 0; i < count; i += BIN_BATCH)
+    {
+        n = (count - i < BIN_BATCH) ? count - i : BIN_BATCH;
+        binBatch(&hist->map, values + i, bins, n);
+        for (j = 0; j < n; j++)
+            __atomic_fetch_add(&row[bins[j] + 1], 1, __ATOMIC_RELAXED);
+    }
+    /* leave: the adds are visible to the reader that sees this */
+    __atomic_fetch_add(&phaser->end[phase], 1, __ATOMIC_RELEASE);
+}
+
+/* Count one value */
+static inline void concRecord(CONC_HISTOGRAM* hist, float value)
+{
+    concRecordBatch(hist, &value, 1);
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  concSnapshot
+ * Purpose:   Counts of everything recorded so far
+ * In/out:    hist
+ * Out arg:   counts:  columns counts, see above
+ * Return:    stripes left for a later snapshot, 0 if the counts hold
+ *            every batch finished before the call
+ * Note:      Snapshots take turns (a mutex); writers carry on.  A value
+ *            recorded while the snapshot is taken may or may not be in
+ *            it, but a batch is either all in or all out.
+ */
+static inline int concSnapshot(
+    CONC_HISTOGRAM* hist      /* in/out */,
+    long            counts[]  /* out    */)
+{
+    int stripe, late = 0;
+    long c;
+
+    pthread_mutex_lock(&hist->snapshot_lock);
+    for (stripe = 0; stripe < hist->stripes; stripe++)
+    {
+        CONC_PHASER* phaser = &hist->phasers[stripe];
+        int flipped = 0;
+
+        /* a stripe left draining by the last snapshot is drained, then
+           flipped and drained again for what came after */
+        while (!flipped)
+        {
+            /* only snapshots change the phase, and they hold the lock */
+            int phase = __atomic_load_n(&phaser->start, __ATOMIC_RELAXED) & 1;
+            int spins = 0;
+            long* row;
+
+            if (phaser->draining < 0)
+            {
+                phaser->draining = __atomic_exchange_n(&phaser->start, phase ^ 1, __ATOMIC_ACQ_REL) >> 1;
+                phase ^= 1;
+                flipped = 1;
+            }
+            /* the old phase is the one writers no longer enter */
+            phase ^= 1;
+            while (__atomic_load_n(&phaser->end[phase], __ATOMIC_ACQUIRE) != phaser->draining
+                   && spins < CONC_SNAPSHOT_SPINS)
+                spins++;
+            if (__atomic_load_n(&phaser->end[phase], __ATOMIC_ACQUIRE) != phaser->draining)
+            {
+                late++;
+                break;
+            }
+
+            /* nobody writes the old row until the next flip publishes this */
+            row = hist->counts + ((long)phase * hist->stripes + stripe) * hist->stride;
+            for (c = 0; c < hist->columns; c++)
+            {
+                hist->totals[c] += row[c];
+                row[c] = 0;
+            }
+            __atomic_store_n(&phaser->end[phase], 0, __ATOMIC_RELAXED);
+            phaser->draining = -1;
+        }
+    }
+    for (c = 0; c < hist->columns; c++)
+        counts[c] = hist->totals[c];
+    pthread_mutex_unlock(&hist->snapshot_lock);
+    return late;
+}
+
+#endif
@@ -0,0 +1,188 @@
+/* COMP 137 Spring 2019
+ * filename: concurrent_metrics.c
+ *
+ * Purpose:   Online recording into a concurrent histogram
+ *            (concurrent_histogram.h).  Many "request" threads, usually
+ *            far more than there are CPUs, each record the REQUEST_VALUES
+ *            timings of a request at a time, with no barrier and no
+ *            merge, while the main thread takes a snapshot every
+ *            <snapshot_ms> and prints the distribution of the values
+ *            recorded since the last one.
+ *
+ *            A request's values are recorded as one batch, so every
+ *            snapshot total is a multiple of REQUEST_VALUES; a snapshot
+ *            that caught part of a request would show up as "torn".
+ *            "late" is the number of stripes (one per writer) a
+ *            snapshot had to leave for the next one because the writer
+ *            was inside.  At the end the writers are stopped and the last
+ *            snapshot must hold exactly the values recorded.
+ *
+ * Program arguments: ./concurrent_metrics <bin_count> <min_meas> <max_meas> <num_threads> <snapshot_ms> <seconds>
+ *
+ * How to compile: gcc -O3 -march=native -o concurrent_metrics concurrent_metrics.c -lm -lpthread
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "timer.h"
+#include "cbrng.h"
+#include "concurrent_histogram.h"
+
+/* values recorded together by one request */
+#define REQUEST_VALUES 10
+
+#define DATA_SEED 0
+
+void usage(char prog_name[]);
+void* writerWork(void* args);
+float binPercentile(const long counts[], double percentile);
+
+/* shared by all threads */
+CONC_HISTOGRAM hist;
+float* bin_maxes;
+int bin_count;
+float min_meas, max_meas;
+int num_threads;
+int done = 0;
+long* values_recorded;          /* per thread, padded to a cache line */
+
+int main(int argc, char* argv[])
+{
+    pthread_t* thread_handles;
+    struct timespec interval;
+    long* counts;
+    long* last;
+    long* delta;
+    long t, tick, ticks, total, fresh, recorded = 0;
+    int snapshot_ms, i, late, torn = 0;
+    double seconds, t1, t2;
+
+    if (argc != 7) usage(argv[0]);
+    bin_count = strtol(argv[1], NULL, 10);
+    min_meas = strtof(argv[2], NULL);
+    max_meas = strtof(argv[3], NULL);
+    num_threads = strtol(argv[4], NULL, 10);
+    snapshot_ms = strtol(argv[5], NULL, 10);
+    seconds = strtod(argv[6], NULL);
+    if (bin_count < 1 || num_threads < 1 || snapshot_ms < 1 || !(min_meas < max_meas))
+        usage(argv[0]);
+
+    bin_maxes = malloc(bin_count*sizeof(float));
+    for (i = 0; i < bin_count; i++)
+        bin_maxes[i] = min_meas + (i+1)*((max_meas - min_meas)/bin_count);
+    concInit(&hist, bin_maxes, bin_count, min_meas, num_threads);
+    counts = malloc(hist.columns*sizeof(long));
+    last = calloc(hist.columns, sizeof(long));
+    delta = malloc(hist.columns*sizeof(long));
+    values_recorded = calloc(num_threads * 8, sizeof(long));
+    printf("%d writers, %d stripes\n", num_threads, hist.stripes);
+
+    thread_handles = malloc(num_threads*sizeof(pthread_t));
+    for (t = 0; t < num_threads; t++)
+        pthread_create(&thread_handles[t], NULL, writerWork, (void*) t);
+
+    interval.tv_sec = snapshot_ms / 1000;
+    interval.tv_nsec = (snapshot_ms % 1000) * 1000000L;
+    ticks = (long)(seconds * 1000 / snapshot_ms);
+    for (tick = 1; tick < ticks; tick++)
+    {
+        nanosleep(&interval, NULL);
+        GET_TIME(t1);
+        late = concSnapshot(&hist, counts);
+        GET_TIME(t2);
+
+        for (i = 0, total = 0, fresh = 0; i < hist.columns; i++)
+        {
+            delta[i] = counts[i] - last[i];
+            last[i] = counts[i];
+            total += counts[i];
+            fresh += delta[i];
+        }
+        if (total % REQUEST_VALUES != 0) torn++;
+        printf("%6.2fs: total = %10ld  new = %9ld  p50 = %8.3f  p99 = %8.3f  late = %d  snapshot = %.1f us\n",
+               tick * snapshot_ms / 1000.0, total, fresh, binPercentile(delta, 50.0),
+               binPercentile(delta, 99.0), late, (t2 - t1) * 1e6);
+    }
+    nanosleep(&interval, NULL);
+
+    __atomic_store_n(&done, 1, __ATOMIC_RELAXED);
+    for (t = 0; t < num_threads; t++)
+        pthread_join(thread_handles[t], NULL);
+    for (t = 0; t < num_threads; t++)
+        recorded += values_recorded[8*t];
+    late = concSnapshot(&hist, counts);
+    for (i = 0, total = 0; i < hist.columns; i++)
+        total += counts[i];
+    printf("recorded = %ld, in the histogram = %ld, torn snapshots = %d, late = %d\n",
+           recorded, total, torn, late);
+
+    concFree(&hist);
+    free(counts);
+    free(last);
+    free(delta);
+    free(values_recorded);
+    free(thread_handles);
+    free(bin_maxes);
+    return 0;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  writerWork
+ * Purpose:   Record the values of one request after another until done
+ *            is set
+ * In arg:    args:  the writer's rank
+ */
+void* writerWork(void* args)
+{
+    long rank = (long) args;
+    float request[REQUEST_VALUES];
+    /* each writer has its own run of indices of the random stream */
+    long next = rank << 40;
+
+    while (!__atomic_load_n(&done, __ATOMIC_RELAXED))
+    {
+        cbrngFill(DATA_SEED, CBRNG_PARETO, min_meas, max_meas, request, next, REQUEST_VALUES);
+        concRecordBatch(&hist, request, REQUEST_VALUES);
+        next += REQUEST_VALUES;
+        values_recorded[8*rank] += REQUEST_VALUES;
+    }
+    return NULL;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  binPercentile
+ * Purpose:   Upper edge of the bin holding the given percentile of the
+ *            values inside the bins
+ * In args:   counts:      histogram counts, column i+1 for bin i
+ *            percentile:  0 .. 100
+ */
+float binPercentile(const long counts[], double percentile)
+{
+    long total = 0, seen = 0;
+    int i;
+
+    for (i = 1; i <= bin_count; i++)
+        total += counts[i];
+    for (i = 1; i <= bin_count; i++)
+    {
+        seen += counts[i];
+        if (seen > 0 && seen >= percentile / 100.0 * total) return bin_maxes[i-1];
+    }
+    return min_meas;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  usage
+ * Purpose:   Print a message showing how to run program and quit
+ * In arg:    prog_name:  the name of the program from the command line
+ */
+void usage(char prog_name[] /* in */)
+{
+    fprintf(stderr, "usage: %s ", prog_name);
+    fprintf(stderr, "<bin_count> <min_meas> <max_meas> <num_threads> <snapshot_ms> <seconds>\n");
+    exit(0);
+}  /* Usage */
@@ -0,0 +1,255 @@
+/* File:     hdr_histogram.h
+ * COMP 137 Spring 2019
+ *
+ * Purpose:  A log-linear histogram for latencies and other positive
+ *           measurements whose tail matters.  Every power of 2 from
+ *           lowest to highest is split into 2^sub_bits buckets of equal
+ *           width, so a bucket is never wider than 2^-sub_bits of the
+ *           values in it (0.8% for sub_bits = 7) whether the value is a
+ *           microsecond or a minute, and the whole range takes a few
+ *           thousand buckets.
+ *
+ *           No search is needed to find a bucket: the bits of a positive
+ *           float are its exponent followed by its mantissa, so the top
+ *           8 + sub_bits bits after the sign are the octave and the
+ *           bucket inside it, and consecutive values of those bits are
+ *           consecutive buckets.  hdrRecordBatch does that for a batch of
+ *           values in a loop the compiler vectorizes (-O3).
+ *
+ *           Bucket 0 holds the values below lowest (and negative ones),
+ *           the last bucket those above the bucket of highest (and NaN),
+ *           so nothing is lost.  Each thread records into its own row
+ *           of counts; hdrMerge adds the rows, and two merged histograms
+ *           with the same lowest, highest and sub_bits add bucket by
+ *           bucket with hdrAdd.  hdrValueAt answers a percentile with
+ *           one running sum over the buckets.
+ *
+ * Example:
+ *    HDR_HISTOGRAM hdr;
+ *    hdrInit(&hdr, 1.0f, 1e9f, 7, num_threads);
+ *    in thread rank:   hdrRecordBatch(&hdr, rank, latencies, count);
+ *    after the join:   hdrMerge(&hdr, totals);
+ *                      p99 = hdrValueAt(&hdr, totals, 99.0);
+ */
+#ifndef _HDR_HISTOGRAM_H_
+#define _HDR_HISTOGRAM_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* values turned into buckets at a time by hdrRecordBatch */
+#define HDR_BATCH 1024
+
+typedef struct {
+    float   lowest;        /* smallest value with its own bucket */
+    float   highest;       /* largest value with its own bucket */
+    int     sub_bits;      /* buckets per power of 2 = 2^sub_bits */
+    int     shift;         /* 23 - sub_bits: mantissa bits dropped */
+    uint32_t first_key;    /* key of the bucket of lowest */
+    int     bucket_count;  /* buckets, including the two outside ones */
+    int     num_threads;   /* rows of counts */
+    long    stride;        /* counts from one row to the next */
+    long*   counts;        /* num_threads rows, 64-byte aligned */
+} HDR_HISTOGRAM;
+
+
+/* bits of a float as an unsigned int */
+static inline uint32_t hdrBits(float x)
+{
+    uint32_t u;
+    memcpy(&u, &x, sizeof(u));
+    return u;
+}
+
+static inline float hdrFloat(uint32_t u)
+{
+    float x;
+    memcpy(&x, &u, sizeof(x));
+    return x;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  hdrInit
+ * Purpose:   Set up zeroed rows of buckets
+ * In args:   lowest:       smallest value to resolve, > 0
+ *            highest:      largest value to resolve, >= lowest
+ *            sub_bits:     0 .. 23, relative bucket width 2^-sub_bits
+ *            num_threads:  threads recording values
+ * Out arg:   hdr, free with hdrFree
+ */
+static inline void hdrInit(
+    HDR_HISTOGRAM* hdr          /* out */,
+    float          lowest       /* in  */,
+    float          highest      /* in  */,
+    int            sub_bits     /* in  */,
+    int            num_threads  /* in  */)
+{
+    size_t bytes;
+
+    hdr->lowest = lowest;
+    hdr->highest = highest;
+    hdr->sub_bits = sub_bits;
+    hdr->shift = 23 - sub_bits;
+    hdr->first_key = hdrBits(lowest) >> hdr->shift;
+    hdr->bucket_count = (int)((hdrBits(highest) >> hdr->shift) - hdr->first_key) + 3;
+    hdr->num_threads = num_threads;
+    /* whole cache lines (8 longs) per row */
+    hdr->stride = ((long)hdr->bucket_count + 7) / 8 * 8;
+    bytes = num_threads * hdr->stride * sizeof(long);
+    hdr->counts = aligned_alloc(64, bytes);
+    memset(hdr->counts, 0, bytes);
+}
+
+static inline void hdrFree(HDR_HISTOGRAM* hdr)
+{
+    free(hdr->counts);
+    hdr->counts = NULL;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  hdrBucketLow
+ * Purpose:   Smallest value of a bucket, 1 .. bucket_count-2
+ */
+static inline float hdrBucketLow(const HDR_HISTOGRAM* hdr, int bucket)
+{
+    return hdrFloat((hdr->first_key + bucket - 1) << hdr->shift);
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  hdrBuckets
+ * Purpose:   Find the buckets of count values
+ * In args:   hdr, values, count
+ * Out arg:   buckets
+ */
+static inline void hdrBuckets(
+    const HDR_HISTOGRAM* hdr      /* in  */,
+    const float*         values   /* in  */,
+    int*                 buckets  /* out */,
+    long                 count    /* in  */)
+{
+    const float lowest = hdr->lowest;
+    const uint32_t first_key = hdr->first_key;
+    const uint32_t top = hdr->bucket_count - 1;
+    const int shift = hdr->shift;
+    long i;
+
+    for (i = 0; i < count; i++)
+    {
+        uint32_t u;
+        uint32_t b;
+
+        memcpy(&u, &values[i], sizeof(u));
+        /* +1 for the underflow bucket; below lowest wraps or is 0 */
+        b = (u >> shift) - first_key + 1;
+        b = (b > top) ? top : b;
+        buckets[i] = (values[i] < lowest) ? 0 : (int)b;
+    }
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  hdrRecordBatch
+ * Purpose:   Count count values for thread rank
+ * In args:   rank, values, count
+ * In/out:    hdr
+ */
+static inline void hdrRecordBatch(
+    HDR_HISTOGRAM* hdr     /* in/out */,
+    long           rank    /* in     */,
+    const float*   values  /* in     */,
+    long           count   /* in     */)
+{
+    long* row = hdr->counts + rank * hdr->stride;
+    int buckets[HDR_BATCH];
+    long i, j, n;
+
+    for (i = 0; i < count; i += HDR_BATCH)
+    {
+        n = (count - i < HDR_BATCH) ? count - i : HDR_BATCH;
+        hdrBuckets(hdr, values + i, buckets, n);
+        for (j = 0; j < n; j++)
+            row[buckets[j]]++;
+    }
+}
+
+/* Count a single value for thread rank */
+static inline void hdrRecord(HDR_HISTOGRAM* hdr, long rank, float value)
+{
+    int bucket;
+
+    hdrBuckets(hdr, &value, &bucket, 1);
+    hdr->counts[rank * hdr->stride + bucket]++;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  hdrMerge
+ * Purpose:   Add the rows of all threads
+ * In arg:    hdr
+ * Out arg:   totals:  bucket_count counts
+ */
+static inline void hdrMerge(
+    const HDR_HISTOGRAM* hdr      /* in  */,
+    long                 totals[] /* out */)
+{
+    int r, b;
+
+    for (b = 0; b < hdr->bucket_count; b++)
+        totals[b] = 0;
+    for (r = 0; r < hdr->num_threads; r++)
+    {
+        const long* row = hdr->counts + r * hdr->stride;
+        for (b = 0; b < hdr->bucket_count; b++)
+            totals[b] += row[b];
+    }
+}
+
+/* Add merged counts of another histogram with the same buckets */
+static inline void hdrAdd(const HDR_HISTOGRAM* hdr, long totals[], const long other[])
+{
+    int b;
+
+    for (b = 0; b < hdr->bucket_count; b++)
+        totals[b] += other[b];
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  hdrValueAt
+ * Purpose:   Value below which percentile % of the recorded values lie
+ * In args:   hdr, totals (from hdrMerge), percentile in 0 .. 100
+ * Return:    the middle of the bucket holding that value; lowest or
+ *            highest if it is outside the buckets, 0 if nothing was
+ *            recorded
+ */
+static inline float hdrValueAt(
+    const HDR_HISTOGRAM* hdr         /* in */,
+    const long           totals[]    /* in */,
+    double               percentile  /* in */)
+{
+    long total = 0, rank, seen = 0;
+    int b;
+
+    for (b = 0; b < hdr->bucket_count; b++)
+        total += totals[b];
+    if (total == 0) return 0.0f;
+
+    /* the rank-th smallest value, 1 .. total */
+    rank = (long)(percentile / 100.0 * total + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > total) rank = total;
+    for (b = 0; b < hdr->bucket_count; b++)
+    {
+        seen += totals[b];
+        if (seen >= rank) break;
+    }
+    if (b == 0) return hdr->lowest;
+    if (b == hdr->bucket_count - 1) return hdr->highest;
+    return 0.5f * (hdrBucketLow(hdr, b) + hdrBucketLow(hdr, b + 1));
+}
+
+#endif
@@ -0,0 +1,156 @@
+/* COMP 137 Spring 2019
+ * filename: hdr_latency.c
+ *
+ * Purpose:   Record simulated request latencies into a log-linear
+ *            histogram (hdr_histogram.h) from several threads and print
+ *            their percentiles.
+ *
+ *            Each thread makes its share of the latencies a batch at a
+ *            time (heavy tailed, from MIN_LATENCY to MAX_LATENCY ns) and
+ *            records the batch into its own row of buckets, so the
+ *            latencies are never stored.  After the join the rows are
+ *            merged and the percentiles read off the merged buckets.
+ *
+ *            With CHECK_EXACT = 1 the same latencies are also made into
+ *            one array and sorted, and the exact percentiles are printed
+ *            next to the histogram's with their relative error.
+ *
+ * Program arguments: ./hdr_latency <data_count> <num_threads> [sub_bits]
+ *   <data_count>  = number of latencies
+ *   <num_threads> = number of threads recording
+ *   [sub_bits]    = buckets per power of 2 = 2^sub_bits, default 7
+ *
+ * How to compile: gcc -O3 -march=native -o hdr_latency hdr_latency.c -lm -lpthread
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+#include "timer.h"
+#include "cbrng.h"
+#include "hdr_histogram.h"
+
+/* CHECK_EXACT = 1 -> also sort the latencies and compare
+ * CHECK_EXACT != 1 -> only the histogram
+ */
+#define CHECK_EXACT 0
+
+/* latencies in ns: 1 us to 100 ms */
+#define MIN_LATENCY 1e3f
+#define MAX_LATENCY 1e8f
+
+#define DATA_SEED 0
+
+void usage(char prog_name[]);
+void* threadWork(void* args);
+int compareFloats(const void* a, const void* b);
+
+/* shared by all threads */
+HDR_HISTOGRAM hdr;
+long data_count;
+int num_threads;
+
+static const double percentiles[] = { 50.0, 90.0, 99.0, 99.9, 99.99, 100.0 };
+#define PERCENTILE_COUNT (int)(sizeof(percentiles) / sizeof(percentiles[0]))
+
+int main(int argc, char* argv[])
+{
+    pthread_t* thread_handles;
+    long* totals;
+    long t;
+    int sub_bits = 7, p;
+    double t1, t2;
+#if CHECK_EXACT == 1
+    float* data;
+    long rank;
+#endif
+
+    if (argc != 3 && argc != 4) usage(argv[0]);
+    data_count = strtol(argv[1], NULL, 10);
+    num_threads = strtol(argv[2], NULL, 10);
+    if (argc == 4) sub_bits = strtol(argv[3], NULL, 10);
+    if (data_count < 1 || num_threads < 1 || sub_bits < 0 || sub_bits > 23) usage(argv[0]);
+
+    hdrInit(&hdr, MIN_LATENCY, MAX_LATENCY, sub_bits, num_threads);
+    totals = malloc(hdr.bucket_count*sizeof(long));
+    thread_handles = malloc(num_threads*sizeof(pthread_t));
+
+    GET_TIME(t1);
+    for (t = 0; t < num_threads; t++)
+        pthread_create(&thread_handles[t], NULL, threadWork, (void*) t);
+    for (t = 0; t < num_threads; t++)
+        pthread_join(thread_handles[t], NULL);
+    hdrMerge(&hdr, totals);
+    GET_TIME(t2);
+
+    printf("buckets = %d (%ld bytes per thread), relative width = %g\n",
+           hdr.bucket_count, hdr.stride * (long)sizeof(long), ldexp(1.0, -sub_bits));
+    printf("record time = %f (%.1f M values/s)\n", t2 - t1, data_count / (t2 - t1) * 1e-6);
+
+#if CHECK_EXACT == 1
+    data = malloc(data_count*sizeof(float));
+    cbrngFill(DATA_SEED, CBRNG_PARETO, MIN_LATENCY, MAX_LATENCY, data, 0, data_count);
+    qsort(data, data_count, sizeof(float), compareFloats);
+    for (p = 0; p < PERCENTILE_COUNT; p++)
+    {
+        float estimate = hdrValueAt(&hdr, totals, percentiles[p]);
+        rank = (long)(percentiles[p] / 100.0 * data_count + 0.5);
+        if (rank < 1) rank = 1;
+        printf("p%-6g = %12.1f ns   exact %12.1f ns   error %+.4f%%\n", percentiles[p],
+               estimate, data[rank - 1], 100.0 * (estimate - data[rank - 1]) / data[rank - 1]);
+    }
+    free(data);
+#else
+    for (p = 0; p < PERCENTILE_COUNT; p++)
+        printf("p%-6g = %12.1f ns\n", percentiles[p], hdrValueAt(&hdr, totals, percentiles[p]));
+#endif
+
+    hdrFree(&hdr);
+    free(totals);
+    free(thread_handles);
+    return 0;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  threadWork
+ * Purpose:   Make and record one thread's share of the latencies
+ * In arg:    args:  the thread's rank
+ */
+void* threadWork(void* args)
+{
+    long rank = (long) args;
+    long first = data_count * rank / num_threads;
+    long last = data_count * (rank + 1) / num_threads;
+    float batch[HDR_BATCH];
+    long i, n;
+
+    for (i = first; i < last; i += HDR_BATCH)
+    {
+        n = (last - i < HDR_BATCH) ? last - i : HDR_BATCH;
+        cbrngFill(DATA_SEED, CBRNG_PARETO, MIN_LATENCY, MAX_LATENCY, batch, i, n);
+        hdrRecordBatch(&hdr, rank, batch, n);
+    }
+    return NULL;
+}
+
+
+int compareFloats(const void* a, const void* b)
+{
+    float x = *(const float*)a, y = *(const float*)b;
+    return (x > y) - (x < y);
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  usage
+ * Purpose:   Print a message showing how to run program and quit
+ * In arg:    prog_name:  the name of the program from the command line
+ */
+void usage(char prog_name[] /* in */)
+{
+    fprintf(stderr, "usage: %s ", prog_name);
+    fprintf(stderr, "<data_count> <num_threads> [sub_bits]\n");
+    fprintf(stderr, "   sub_bits = 0 .. 23, default 7\n");
+    exit(0);
+}  /* Usage */
@@ -0,0 +1,514 @@
+/* File:     hist_serialize.h
+ * COMP 137 Spring 2019
+ *
+ * Purpose:  A compact binary form of a histogram, so the results of many
+ *           runs (one per shard of the data, say) can be saved and added
+ *           up later without parsing printHistogram's text.
+ *
+ *           All numbers are varints: 7 bits per byte, low bits first,
+ *           the top bit set on every byte but the last.
+ *
+ *               "HST1"
+ *               bin_count
+ *               bytes in the edges
+ *               edges:   min_meas, then the bin_maxes, each as the change
+ *                        in the step from the edge before (zigzag coded).
+ *                        The floats are first turned into integers in
+ *                        the same order, so this is exact, and bins of
+ *                        equal width take about a byte per edge.
+ *               total count
+ *               bytes in the counts
+ *               counts:  runs of (zeros, n, n counts): zeros empty bins
+ *                        are skipped, the next n bins are listed
+ *
+ *           Short gaps of one or two empty bins stay inside a run, where
+ *           they cost less than a new run.
+ *
+ *           histMerge adds any number of encoded histograms with the
+ *           same edges.  It checks the edges by comparing bytes, copies
+ *           them once, and walks the runs of all inputs together: where
+ *           every input is in a gap it skips the whole gap at once, and
+ *           only the listed counts are decoded and added.
+ *
+ * Example:
+ *    HIST_BUFFER buf;
+ *    histBufferInit(&buf);
+ *    histEncode(&buf, bin_maxes, bin_counts, bin_count, min_meas);
+ *    fwrite(buf.bytes, 1, buf.length, fp);
+ *    . . .
+ *    histMerge(inputs, lengths, num_inputs, &merged);
+ */
+#ifndef _HIST_SERIALIZE_H_
+#define _HIST_SERIALIZE_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HIST_MAGIC "HST1"
+
+/* empty bins kept inside a run rather than starting a new one */
+#define HIST_MAX_GAP 2
+
+typedef struct {
+    unsigned char* bytes;
+    long           length;     /* bytes in use */
+    long           capacity;   /* bytes allocated */
+} HIST_BUFFER;
+
+static inline void histBufferInit(HIST_BUFFER* buf)
+{
+    buf->capacity = 256;
+    buf->length = 0;
+    buf->bytes = malloc(buf->capacity);
+}
+
+static inline void histBufferFree(HIST_BUFFER* buf)
+{
+    free(buf->bytes);
+    buf->bytes = NULL;
+}
+
+/* Make room for n more bytes */
+static inline unsigned char* histBufferGrow(HIST_BUFFER* buf, long n)
+{
+    if (buf->length + n > buf->capacity)
+    {
+        while (buf->length + n > buf->capacity)
+            buf->capacity *= 2;
+        buf->bytes = realloc(buf->bytes, buf->capacity);
+    }
+    return buf->bytes + buf->length;
+}
+
+static inline void histPutBytes(HIST_BUFFER* buf, const void* bytes, long n)
+{
+    memcpy(histBufferGrow(buf, n), bytes, n);
+    buf->length += n;
+}
+
+static inline void histPutVarint(HIST_BUFFER* buf, uint64_t x)
+{
+    unsigned char* p = histBufferGrow(buf, 10);
+    int n = 0;
+
+    while (x >= 0x80)
+    {
+        p[n++] = (unsigned char)(x | 0x80);
+        x >>= 7;
+    }
+    p[n++] = (unsigned char)x;
+    buf->length += n;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  histGetVarint
+ * Purpose:   Read a varint at *p, moving *p past it
+ * In args:   end:  first byte after the input
+ * Out arg:   x
+ * Return:    0, or -1 if the input ends first
+ */
+static inline int histGetVarint(
+    const unsigned char** p    /* in/out */,
+    const unsigned char*  end  /* in     */,
+    uint64_t*             x    /* out    */)
+{
+    const unsigned char* q = *p;
+    uint64_t value = 0;
+    int shift = 0;
+
+    while (q < end && shift < 64)
+    {
+        value |= (uint64_t)(*q & 0x7f) << shift;
+        if (!(*q++ & 0x80))
+        {
+            *p = q;
+            *x = value;
+            return 0;
+        }
+        shift += 7;
+    }
+    return -1;
+}
+
+
+/* Floats as unsigned ints in the same order (no NaN) */
+static inline uint32_t histOrdered(float x)
+{
+    uint32_t u;
+    memcpy(&u, &x, sizeof(u));
+    return (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+}
+
+static inline float histUnordered(uint32_t u)
+{
+    float x;
+    u = (u & 0x80000000u) ? (u & 0x7fffffffu) : ~u;
+    memcpy(&x, &u, sizeof(x));
+    return x;
+}
+
+static inline uint64_t histZigzag(int64_t x)
+{
+    return ((uint64_t)x << 1) ^ (uint64_t)(x >> 63);
+}
+
+static inline int64_t histUnzigzag(uint64_t x)
+{
+    return (int64_t)(x >> 1) ^ -(int64_t)(x & 1);
+}
+
+
+/*---------------------------------------------------------------------
+ * The counts are written through a HIST_RUNS, which holds back the run
+ * being listed until it is known how long it is.
+ */
+typedef struct {
+    HIST_BUFFER* out;
+    uint64_t     gap;       /* empty bins before the pending run */
+    uint64_t     zeros;     /* empty bins after the pending run */
+    HIST_BUFFER  run;       /* varints of the pending run */
+    uint64_t     run_count; /* counts in the pending run */
+} HIST_RUNS;
+
+static inline void histRunsInit(HIST_RUNS* runs, HIST_BUFFER* out)
+{
+    runs->out = out;
+    runs->gap = runs->zeros = runs->run_count = 0;
+    histBufferInit(&runs->run);
+}
+
+/* Write the pending run, if there is one */
+static inline void histRunsFlush(HIST_RUNS* runs)
+{
+    if (runs->run_count > 0)
+    {
+        histPutVarint(runs->out, runs->gap);
+        histPutVarint(runs->out, runs->run_count);
+        histPutBytes(runs->out, runs->run.bytes, runs->run.length);
+        runs->gap = 0;
+        runs->run.length = 0;
+        runs->run_count = 0;
+    }
+}
+
+/* Add n empty bins */
+static inline void histRunsSkip(HIST_RUNS* runs, uint64_t n)
+{
+    if (runs->run_count == 0) runs->gap += n;
+    else runs->zeros += n;
+}
+
+/* Add a bin with count > 0 */
+static inline void histRunsPut(HIST_RUNS* runs, uint64_t count)
+{
+    if (runs->zeros > HIST_MAX_GAP)
+    {
+        histRunsFlush(runs);
+        runs->gap = runs->zeros;
+    }
+    else
+        for (; runs->zeros > 0; runs->zeros--, runs->run_count++)
+            histPutVarint(&runs->run, 0);
+    runs->zeros = 0;
+    histPutVarint(&runs->run, count);
+    runs->run_count++;
+}
+
+/* Write what is left; trailing empty bins are not written */
+static inline void histRunsFinish(HIST_RUNS* runs)
+{
+    histRunsFlush(runs);
+    histBufferFree(&runs->run);
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  histEncode
+ * Purpose:   Append the encoded histogram to buf
+ * In args:   bin_maxes, bin_counts, bin_count, min_meas:  as printed by
+ *            printHistogram
+ * Out arg:   buf
+ */
+static inline void histEncode(
+    HIST_BUFFER* buf           /* in/out */,
+    const float  bin_maxes[]   /* in     */,
+    const long   bin_counts[]  /* in     */,
+    int          bin_count     /* in     */,
+    float        min_meas      /* in     */)
+{
+    HIST_BUFFER edges, counts;
+    HIST_RUNS runs;
+    int64_t step = 0;
+    uint64_t total = 0;
+    uint32_t prev;
+    int i;
+
+    histBufferInit(&edges);
+    prev = histOrdered(min_meas);
+    histPutVarint(&edges, prev);
+    for (i = 0; i < bin_count; i++)
+    {
+        uint32_t u = histOrdered(bin_maxes[i]);
+        int64_t next_step = (int64_t)u - (int64_t)prev;
+        histPutVarint(&edges, histZigzag(next_step - step));
+        step = next_step;
+        prev = u;
+    }
+
+    histBufferInit(&counts);
+    histRunsInit(&runs, &counts);
+    for (i = 0; i < bin_count; i++)
+    {
+        total += bin_counts[i];
+        if (bin_counts[i] == 0) histRunsSkip(&runs, 1);
+        else histRunsPut(&runs, bin_counts[i]);
+    }
+    histRunsFinish(&runs);
+
+    histPutBytes(buf, HIST_MAGIC, 4);
+    histPutVarint(buf, bin_count);
+    histPutVarint(buf, edges.length);
+    histPutBytes(buf, edges.bytes, edges.length);
+    histPutVarint(buf, total);
+    histPutVarint(buf, counts.length);
+    histPutBytes(buf, counts.bytes, counts.length);
+    histBufferFree(&edges);
+    histBufferFree(&counts);
+}
+
+
+/*---------------------------------------------------------------------
+ * An encoded histogram split into its parts, without decoding them
+ */
+typedef struct {
+    uint64_t             bin_count;
+    const unsigned char* edges;        /* from the bin_count varint */
+    long                 edges_length; /* to the end of the edges */
+    uint64_t             total;
+    const unsigned char* counts;
+    const unsigned char* counts_end;
+} HIST_PARTS;
+
+/*---------------------------------------------------------------------
+ * Function:  histParts
+ * Purpose:   Find the parts of an encoded histogram
+ * Return:    0, or -1 if it is not a complete encoded histogram
+ */
+static inline int histParts(
+    const unsigned char* bytes   /* in  */,
+    long                 length  /* in  */,
+    HIST_PARTS*          parts   /* out */)
+{
+    const unsigned char* p = bytes + 4;
+    const unsigned char* end = bytes + length;
+    uint64_t n;
+
+    if (length < 4 || memcmp(bytes, HIST_MAGIC, 4) != 0) return -1;
+    parts->edges = p;
+    if (histGetVarint(&p, end, &parts->bin_count) < 0
+        || histGetVarint(&p, end, &n) < 0 || n > (uint64_t)(end - p)) return -1;
+    p += n;
+    parts->edges_length = p - parts->edges;
+    if (histGetVarint(&p, end, &parts->total) < 0
+        || histGetVarint(&p, end, &n) < 0 || n > (uint64_t)(end - p)) return -1;
+    parts->counts = p;
+    parts->counts_end = p + n;
+    return 0;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  histDecode
+ * Purpose:   Decode an encoded histogram
+ * In args:   bytes, length
+ * Out args:  min_meas, bin_count
+ *            bin_maxes, bin_counts:  allocated here, free them after use
+ * Return:    0, or -1 if the input is not a valid encoded histogram
+ */
+static inline int histDecode(
+    const unsigned char* bytes        /* in  */,
+    long                 length       /* in  */,
+    float*               min_meas     /* out */,
+    float**              bin_maxes    /* out */,
+    long**               bin_counts   /* out */,
+    int*                 bin_count    /* out */)
+{
+    HIST_PARTS parts;
+    const unsigned char* p;
+    const unsigned char* end;
+    uint64_t x, gap, n, bin = 0;
+    int64_t step = 0, u;
+    int i;
+
+    if (histParts(bytes, length, &parts) < 0 || parts.bin_count > 0x7fffffff) return -1;
+    *bin_count = (int)parts.bin_count;
+    *bin_maxes = malloc((*bin_count > 0 ? *bin_count : 1)*sizeof(float));
+    *bin_counts = calloc(*bin_count > 0 ? *bin_count : 1, sizeof(long));
+
+    p = parts.edges;
+    end = parts.edges + parts.edges_length;
+    histGetVarint(&p, end, &x);
+    histGetVarint(&p, end, &x);
+    if (histGetVarint(&p, end, &x) < 0) goto bad;
+    u = (int64_t)x;
+    *min_meas = histUnordered((uint32_t)u);
+    for (i = 0; i < *bin_count; i++)
+    {
+        if (histGetVarint(&p, end, &x) < 0) goto bad;
+        step += histUnzigzag(x);
+        u += step;
+        (*bin_maxes)[i] = histUnordered((uint32_t)u);
+    }
+
+    p = parts.counts;
+    while (p < parts.counts_end)
+    {
+        if (histGetVarint(&p, parts.counts_end, &gap) < 0
+            || histGetVarint(&p, parts.counts_end, &n) < 0
+            || gap > parts.bin_count - bin || n > parts.bin_count - bin - gap) goto bad;
+        bin += gap;
+        for (; n > 0; n--, bin++)
+        {
+            if (histGetVarint(&p, parts.counts_end, &x) < 0) goto bad;
+            (*bin_counts)[bin] = (long)x;
+        }
+    }
+    return 0;
+
+bad:
+    free(*bin_maxes);
+    free(*bin_counts);
+    return -1;
+}
+
+
+/*---------------------------------------------------------------------
+ * Where histMerge is in the counts of one input
+ */
+typedef struct {
+    const unsigned char* p;
+    const unsigned char* end;
+    uint64_t gap;          /* empty bins left before the run */
+    uint64_t listed;       /* counts left in the run */
+} HIST_CURSOR;
+
+/* Move to the next run when the current one is used up */
+static inline int histCursorNext(HIST_CURSOR* c)
+{
+    while (c->gap == 0 && c->listed == 0 && c->p < c->end)
+        if (histGetVarint(&c->p, c->end, &c->gap) < 0
+            || histGetVarint(&c->p, c->end, &c->listed) < 0) return -1;
+    return 0;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  histMerge
+ * Purpose:   Add up encoded histograms with the same edges
+ * In args:   inputs:      the encoded histograms
+ *            lengths:     their lengths in bytes
+ *            num_inputs:  at least 1
+ * Out arg:   out:         the encoded sum is appended
+ * Return:    0, -1 if an input is not valid, -2 if the edges differ
+ */
+static inline int histMerge(
+    const unsigned char* inputs[]    /* in     */,
+    const long           lengths[]   /* in     */,
+    int                  num_inputs  /* in     */,
+    HIST_BUFFER*         out         /* in/out */)
+{
+    HIST_PARTS* parts = malloc(num_inputs*sizeof(HIST_PARTS));
+    HIST_CURSOR* cursors = malloc(num_inputs*sizeof(HIST_CURSOR));
+    HIST_BUFFER counts;
+    HIST_RUNS runs;
+    uint64_t total = 0, bin = 0, bin_count, step, x, sum;
+    int i, all_gaps, status = 0;
+
+    for (i = 0; i < num_inputs && status == 0; i++)
+    {
+        if (histParts(inputs[i], lengths[i], &parts[i]) < 0) status = -1;
+        else if (parts[i].edges_length != parts[0].edges_length
+                 || memcmp(parts[i].edges, parts[0].edges, parts[0].edges_length) != 0)
+            status = -2;
+        else
+        {
+            total += parts[i].total;
+            cursors[i].p = parts[i].counts;
+            cursors[i].end = parts[i].counts_end;
+            cursors[i].gap = cursors[i].listed = 0;
+        }
+    }
+    if (status < 0)
+    {
+        free(parts);
+        free(cursors);
+        return status;
+    }
+
+    bin_count = parts[0].bin_count;
+    histBufferInit(&counts);
+    histRunsInit(&runs, &counts);
+    while (bin < bin_count)
+    {
+        /* bins until some input starts or ends a run */
+        step = bin_count - bin;
+        for (i = 0; i < num_inputs; i++)
+        {
+            if (histCursorNext(&cursors[i]) < 0) status = -1;
+            if (cursors[i].gap > 0 && cursors[i].gap < step) step = cursors[i].gap;
+            else if (cursors[i].gap == 0 && cursors[i].listed > 0 && cursors[i].listed < step)
+                step = cursors[i].listed;
+        }
+        if (status < 0) break;
+
+        /* every input in a gap (or past its last run): skip it whole */
+        all_gaps = 1;
+        for (i = 0; i < num_inputs; i++)
+            if (cursors[i].gap == 0 && cursors[i].listed > 0) all_gaps = 0;
+        if (all_gaps)
+            histRunsSkip(&runs, step);
+        else
+            for (x = 0; x < step; x++)
+            {
+                sum = 0;
+                for (i = 0; i < num_inputs; i++)
+                {
+                    uint64_t count = 0;
+                    if (cursors[i].gap == 0 && cursors[i].listed > 0
+                        && histGetVarint(&cursors[i].p, cursors[i].end, &count) < 0) status = -1;
+                    sum += count;
+                }
+                if (sum == 0) histRunsSkip(&runs, 1);
+                else histRunsPut(&runs, sum);
+            }
+        for (i = 0; i < num_inputs; i++)
+        {
+            if (cursors[i].gap > 0) cursors[i].gap -= step;
+            else if (cursors[i].listed > 0) cursors[i].listed -= step;
+        }
+        bin += step;
+        if (status < 0) break;
+    }
+    /* every input must end with its last bin */
+    for (i = 0; i < num_inputs && status == 0; i++)
+        if (histCursorNext(&cursors[i]) < 0 || cursors[i].gap > 0 || cursors[i].listed > 0
+            || cursors[i].p != cursors[i].end) status = -1;
+    histRunsFinish(&runs);
+
+    if (status == 0)
+    {
+        histPutBytes(out, HIST_MAGIC, 4);
+        histPutBytes(out, parts[0].edges, parts[0].edges_length);
+        histPutVarint(out, total);
+        histPutVarint(out, counts.length);
+        histPutBytes(out, counts.bytes, counts.length);
+    }
+    histBufferFree(&counts);
+    free(parts);
+    free(cursors);
+    return status;
+}
+
+#endif
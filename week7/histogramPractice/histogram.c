@@ -3,15 +3,30 @@
  *
  * Purpose:   Build a histogram from a list of random numbers
  *
- * Program arguments: ./histogram <bin_count> <min_meas> <max_meas> <data_count>
- *   <bin_count>  = number of bins in the histogram
- *   <min_meas>   = smallest possible value in list of random numbers
- *   <max_meas>   = largest possible value in list of random numbers
+ *            Either end of the range may be "auto": it is then taken
+ *            from the data, whose smallest and largest values are found
+ *            (rangeBatch) while it is generated, a batch at a time while
+ *            the batch is in L1.  The values are always generated in
+ *            DATA_MIN <= x < DATA_MAX, whatever the bins, as if loaded
+ *            from elsewhere.
+ *
+ *            Values outside a fixed range are counted in an underflow
+ *            and an overflow bin, printed after the others, so a range
+ *            narrower than the data (10 20, say) fills them.
+ *
+ * Program arguments: ./histogram <bin_count> <min_meas> <max_meas> <data_count> [distribution]
+ *   <bin_count>  = number of bins in the histogram
+ *   <min_meas>   = lower edge of the first bin, or auto
+ *   <max_meas>   = upper edge of the last bin, or auto
  *   <data_count> = number of values in list of random numbers
+ *   [distribution] = uniform (the default), normal or pareto, see cbrng.h
  */
 #include <stdio.h>
-#include <stdlib.h>
-#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "histogram_bins.h"
+#include "cbrng.h"
 
 /* GRAPHICAL_OUTPUT = 1 -> Show histogram with X's for number of
  *                         measurements in each bin
@@ -25,6 +40,13 @@
  */
 #define VERBOSE 0
 
+/* seed of the random data */
+#define DATA_SEED 0
+
+/* range of the generated data, whatever the bins */
+#define DATA_MIN 0.0f
+#define DATA_MAX 100.0f
+
 void usage(char prog_name[]);
 
 void extractCommandLineArgs(
@@ -33,70 +55,107 @@ void extractCommandLineArgs(
     int*     bin_count_p   /* out */,
     float*   min_meas_p    /* out */,
     float*   max_meas_p    /* out */,
-    int*     data_count_p  /* out */);
+    long*    data_count_p  /* out */,
+    int*     distribution_p /* out */);
 
 void generateData(
       float   min_meas    /* in  */,
       float   max_meas    /* in  */,
       float   data[]      /* out */,
-      int     data_count  /* in  */);
+      long    data_count  /* in  */,
+      int     distribution /* in  */,
+      float*  data_min_p  /* out */,
+      float*  data_max_p  /* out */);
 
 void createBins(
       float min_meas      /* in  */,
       float max_meas      /* in  */,
       float bin_maxes[]   /* out */,
-      int   bin_counts[]  /* out */,
+      long  bin_counts[]  /* out */,
       int   bin_count     /* in  */);
 
-int findBin(
-      float    data         /* in */,
-      float    bin_maxes[]  /* in */,
-      int      bin_count    /* in */,
-      float    min_meas     /* in */);
-
 void printHistogram(
       float    bin_maxes[]   /* in */,
-      int      bin_counts[]  /* in */,
+      long     bin_counts[]  /* in */,
       int      bin_count     /* in */,
       float    min_meas      /* in */);
 
 int main(int argc, char* argv[]) {
-   int bin_count, i, bin;
-   float min_meas, max_meas;
+   int bin_count, bin;
+   long i, j, n, below = 0, above = 0;
+   float min_meas, max_meas, data_min, data_max;
+   int auto_min, auto_max;
    float* bin_maxes;
-   int* bin_counts;
-   int data_count;
+   long* bin_counts;
+   long data_count;
    float* data;
+   int distribution;
+   BIN_MAP bin_map;
+   int bins[BIN_BATCH];
 
    /* Check and get command line args */
 
-   extractCommandLineArgs(argc, argv, &bin_count, &min_meas, &max_meas, &data_count);
+   extractCommandLineArgs(argc, argv, &bin_count, &min_meas, &max_meas, &data_count, &distribution);
+   if (!cbrngCheck()) {
+      fprintf(stderr, "cbrng.h does not give the Philox known answer\n");
+      exit(-1);
+   }
 
    /* Allocate arrays needed */
    bin_maxes = malloc(bin_count*sizeof(float));
-   bin_counts = malloc(bin_count*sizeof(int));
+   bin_counts = malloc(bin_count*sizeof(long));
    data = malloc(data_count*sizeof(float));
 
-   /* Generate the data */
-   generateData(min_meas, max_meas, data, data_count);
+   /* Generate the data, and find its range */
+   auto_min = isnan(min_meas);
+   auto_max = isnan(max_meas);
+   generateData(DATA_MIN, DATA_MAX, data, data_count, distribution, &data_min, &data_max);
+   if (data_min > data_max) {
+      /* no values */
+      data_min = DATA_MIN;
+      data_max = DATA_MAX;
+   }
+   /* the largest value must be below the last edge */
+   if (auto_min) min_meas = data_min;
+   if (auto_max) max_meas = nextafterf(data_max, INFINITY);
+   if (!(min_meas < max_meas)) {
+      fprintf(stderr, "min_meas = %f is not below max_meas = %f\n", min_meas, max_meas);
+      exit(-1);
+   }
 
 
 
    /* Create bins for storing counts */
    createBins(min_meas, max_meas, bin_maxes, bin_counts, bin_count);
+   /* rounding can leave the last edge short of max_meas */
+   if (auto_max) bin_maxes[bin_count-1] = max_meas;
 
  /* START PARALLELIZATION */
  
-   /* Count number of values in each bin */
-   for (i = 0; i < data_count; i++) {
-      bin = findBin(data[i], bin_maxes, bin_count, min_meas);
-      bin_counts[bin]++;
+   /* Count number of values in each bin, a batch at a time */
+   binMapInit(&bin_map, bin_maxes, bin_count, min_meas);
+   for (i = 0; i < data_count; i += BIN_BATCH) {
+      n = (data_count - i < BIN_BATCH) ? data_count - i : BIN_BATCH;
+      binBatch(&bin_map, &data[i], bins, n);
+      for (j = 0; j < n; j++) {
+         bin = bins[j];
+         /* values outside the bins go to underflow and overflow */
+         if (bin < 0)
+            below++;
+         else if (bin >= bin_count)
+            above++;
+         else
+            bin_counts[bin]++;
+      }
    }
+   binMapFree(&bin_map);
 
    /* END PARALLELIZATION */
 
    /* Print the histogram */
    printHistogram(bin_maxes, bin_counts, bin_count, min_meas);
+   printf("underflow (< %.3f):\t%ld\n", min_meas, below);
+   printf("overflow (>= %.3f):\t%ld\n", max_meas, above);
 
    free(data);
    free(bin_maxes);
@@ -113,7 +172,9 @@ int main(int argc, char* argv[]) {
  */
 void usage(char prog_name[] /* in */) {
    fprintf(stderr, "usage: %s ", prog_name);
-   fprintf(stderr, "<bin_count> <min_meas> <max_meas> <data_count>\n");
+   fprintf(stderr, "<bin_count> <min_meas> <max_meas> <data_count> [distribution]\n");
+   fprintf(stderr, "   <min_meas>, <max_meas> = a number or auto, from the data\n");
+   fprintf(stderr, "   [distribution] = uniform, normal or pareto\n");
    exit(0);
 }  /* Usage */
 
@@ -123,26 +184,30 @@ void usage(char prog_name[] /* in */) {
  * Purpose:   Get the command line arguments
  * In arg:    argv:  strings from command line
  * Out args:  bin_count_p:   number of bins
- *            min_meas_p:    minimum measurement
- *            max_meas_p:    maximum measurement
+ *            min_meas_p:    minimum measurement, NAN for auto
+ *            max_meas_p:    maximum measurement, NAN for auto
  *            data_count_p:  number of measurements
+ *            distribution_p: distribution of the measurements
  */
-void extractCommandLineArgs(
+void extractCommandLineArgs(
       int argc               /* in */,
       char*    argv[]        /* in  */,
       int*     bin_count_p   /* out */,
       float*   min_meas_p    /* out */,
       float*   max_meas_p    /* out */,
-      int*     data_count_p  /* out */) {
-    if (argc != 5) usage(argv[0]);
+      long*    data_count_p  /* out */,
+      int*     distribution_p /* out */) {
+    if (argc != 5 && argc != 6) usage(argv[0]);
     *bin_count_p = strtol(argv[1], NULL, 10);
-    *min_meas_p = strtof(argv[2], NULL);
-    *max_meas_p = strtof(argv[3], NULL);
+    *min_meas_p = (strcmp(argv[2], "auto") == 0) ? NAN : strtof(argv[2], NULL);
+    *max_meas_p = (strcmp(argv[3], "auto") == 0) ? NAN : strtof(argv[3], NULL);
     *data_count_p = strtol(argv[4], NULL, 10);
+    *distribution_p = (argc == 6) ? cbrngDistributionFromName(argv[5]) : CBRNG_UNIFORM;
+    if (*distribution_p < 0) usage(argv[0]);
 #if VERBOSE == 1
     printf("bin_count = %d\n", *bin_count_p);
     printf("min_meas = %f, max_meas = %f\n", *min_meas_p, *max_meas_p);
-    printf("data_count = %d\n", *data_count_p);
+    printf("data_count = %ld\n", *data_count_p);
 #endif
 }
 
@@ -153,20 +218,31 @@ void extractCommandLineArgs(
  * In args:   min_meas:    the minimum possible value for the data
  *            max_meas:    the maximum possible value for the data
  *            data_count:  the number of measurements
- * Out arg:   data:        the actual measurements
+ *            distribution: CBRNG_UNIFORM, CBRNG_NORMAL or CBRNG_PARETO
+ * Out args:  data:        the actual measurements
+ *            data_min_p:  smallest value made, +INFINITY if none
+ *            data_max_p:  largest value made, -INFINITY if none
+ * Note:      data[i] depends only on DATA_SEED and i, so the parallel
+ *            programs generate exactly the same data.  The range is
+ *            found a batch at a time, while the batch is still in L1.
  */
 void generateData(
         float   min_meas    /* in  */,
         float   max_meas    /* in  */,
         float   data[]      /* out */,
-        int     data_count  /* in  */) {
-   int i;
-
-   srand(0);
-   for (i = 0; i < data_count; i++) {
-      data[i] = min_meas + (max_meas - min_meas)*rand()/((double) RAND_MAX);
-      if (data[i] == max_meas) data[i]--;
-   }
+        long    data_count  /* in  */,
+        int     distribution /* in  */,
+        float*  data_min_p  /* out */,
+        float*  data_max_p  /* out */) {
+   long i, n;
+
+   *data_min_p = INFINITY;
+   *data_max_p = -INFINITY;
+   for (i = 0; i < data_count; i += BIN_BATCH) {
+      n = (data_count - i < BIN_BATCH) ? data_count - i : BIN_BATCH;
+      cbrngFill(DATA_SEED, distribution, min_meas, max_meas, &data[i], i, n);
+      rangeBatch(&data[i], n, data_min_p, data_max_p);
+   }
 
 #if VERBOSE == 1
    printf("data = ");
@@ -191,7 +267,7 @@ void createBins(
       float min_meas      /* in  */,
       float max_meas      /* in  */,
       float bin_maxes[]   /* out */,
-      int   bin_counts[]  /* out */,
+      long  bin_counts[]  /* out */,
       int   bin_count     /* in  */) {
    float bin_width;
    int   i;
@@ -212,51 +288,6 @@ void createBins(
 }
 
 
-/*---------------------------------------------------------------------
- * Function:  findBin
- * Purpose:   Use binary search to determine which bin a measurement
- *            belongs to
- * In args:   data:       the current measurement
- *            bin_maxes:  list of max bin values
- *            bin_count:  number of bins
- *            min_meas:   the minimum possible measurement
- * Return:    the number of the bin to which data belongs
- * Notes:
- * 1.  The bin to which data belongs satisfies
- *
- *            bin_maxes[i-1] <= data < bin_maxes[i]
- *
- *     where, bin_maxes[-1] = min_meas
- * 2.  If the search fails, the function prints a message and exits
- */
-int findBin(
-      float   data          /* in */,
-      float   bin_maxes[]   /* in */,
-      int     bin_count     /* in */,
-      float   min_meas      /* in */) {
-   int bottom = 0, top =  bin_count-1;
-   int mid;
-   float bin_max, bin_min;
-
-   while (bottom <= top) {
-      mid = (bottom + top)/2;
-      bin_max = bin_maxes[mid];
-      bin_min = (mid == 0) ? min_meas: bin_maxes[mid-1];
-      if (data >= bin_max)
-         bottom = mid+1;
-      else if (data < bin_min)
-         top = mid-1;
-      else
-         return mid;
-   }
-
-   /* Whoops! (this should not happen)*/
-   fprintf(stderr, "Data = %f doesn't belong to a bin!\n", data);
-   fprintf(stderr, "Quitting\n");
-   exit(-1);
-}
-
-
 /*---------------------------------------------------------------------
  * Function:  printHistogram
  * Purpose:   Print a histogram. Format of histogram is
@@ -268,7 +299,7 @@ int findBin(
  */
 void printHistogram(
         float  bin_maxes[]   /* in */,
-        int    bin_counts[]  /* in */,
+        long   bin_counts[]  /* in */,
         int    bin_count     /* in */,
         float  min_meas      /* in */) {
     int i;
@@ -279,11 +310,11 @@ void printHistogram(
         bin_min = (i == 0) ? min_meas: bin_maxes[i-1];
         printf("%.3f-%.3f:\t", bin_min, bin_max);
 #if GRAPHICAL_OUTPUT == 1
-        int j;
+        long j;
         for (j = 0; j < bin_counts[i]; j++)
             printf("X");
 #else
-        printf("%d", bin_counts[i]);
+        printf("%ld", bin_counts[i]);
 #endif
         printf("\n");
     }
@@ -0,0 +1,516 @@
+/* File:     histogram_accum.h
+ * COMP 137 Spring 2019
+ *
+ * Purpose:  Ways for several threads to add up bin counts, and a choice
+ *           between them from bin_count, the number of threads and a
+ *           sample of the data's bins:
+ *
+ *           ACCUM_PRIVATE  one row of counts per thread.  Rows are padded
+ *                          to whole cache lines, so threads never write
+ *                          to the same line.  Best while every row fits
+ *                          in a core's cache.
+ *           ACCUM_ATOMIC   a single shared row, updated with atomic adds.
+ *                          For bin counts so large that private rows
+ *                          would not fit in cache anyway: threads rarely
+ *                          hit the same bin and only one copy is read.
+ *           ACCUM_SHARDED  one shared row per ACCUM_SHARD_THREADS
+ *                          threads, updated with atomic adds.  Between
+ *                          the two: fewer copies than private rows, less
+ *                          sharing than a single row.
+ *           ACCUM_LANES    ACCUM_LANE_ROWS private rows per thread, used in
+ *                          turn.  When the data is skewed, consecutive
+ *                          values keep hitting the same bin and each
+ *                          increment waits for the last one's store;
+ *                          with separate lanes they do not depend on
+ *                          each other.
+ *           ACCUM_RADIX    one row per thread, counted in two passes for
+ *                          rows larger than L2.  The bins are first
+ *                          partitioned by their high bits, through a
+ *                          cache line per partition that is written out
+ *                          whole (software write combining) to the
+ *                          partition's stage.  A full stage is then
+ *                          counted at once, into the slice of the row
+ *                          its partition covers, which stays in cache
+ *                          while it is counted instead of every add
+ *                          going to DRAM.  A stage holds RADIX_REUSE
+ *                          values per cache line of its slice, so the
+ *                          stages of a thread take RADIX_REUSE/16 of
+ *                          the row's size.
+ *
+ *           Every strategy keeps its counts in rows of one array, so
+ *           accumMerge just adds all rows together.  Threads call
+ *           accumFinish after their last batch, so ACCUM_RADIX counts
+ *           what is still staged.
+ *
+ *           The rows are 32-bit, so they take half the cache of 64-bit
+ *           counts, and the 64-bit totals are only touched by a flush:
+ *           once ACCUM_FLUSH values have gone into a row (a thread's
+ *           lanes) since it was last emptied, the thread that added the
+ *           last of them moves its counts into the totals.  No int
+ *           counter can overflow however many values there are.
+ */
+#ifndef _HISTOGRAM_ACCUM_H_
+#define _HISTOGRAM_ACCUM_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* sub-counter rows per thread for ACCUM_LANES, a power of 2 */
+#define ACCUM_LANE_ROWS 4
+/* threads sharing a row for ACCUM_SHARDED */
+#define ACCUM_SHARD_THREADS 4
+/* bins looked at by accumChoose */
+#define ACCUM_SAMPLE 4096
+/* values added to a row of int counters between flushes, < 2^31 */
+#ifndef ACCUM_FLUSH
+#define ACCUM_FLUSH (1L << 30)
+#endif
+/* partitions of ACCUM_RADIX, their cache lines take 16KB of L1 */
+#define RADIX_PARTITIONS 256
+/* values staged per cache line of a partition's slice of the row */
+#define RADIX_REUSE 8
+
+typedef enum {
+    ACCUM_PRIVATE,
+    ACCUM_ATOMIC,
+    ACCUM_SHARDED,
+    ACCUM_LANES,
+    ACCUM_RADIX
+} ACCUM_STRATEGY;
+
+static const char* accum_names[] = { "private", "atomic", "sharded", "lanes", "radix" };
+
+typedef struct {
+    ACCUM_STRATEGY strategy;
+    int     bin_count;     /* number of bins */
+    int     num_threads;   /* number of threads adding counts */
+    int     rows;          /* rows of counts */
+    long    stride;        /* ints from one row to the next */
+    int*    counts;        /* rows*stride counts, 64-byte aligned */
+    long*   totals;        /* bin_count 64-bit counts the rows flush into */
+    long*   pending;       /* per row, padded: values since its flush */
+    int     radix_shift;   /* ACCUM_RADIX: bin >> radix_shift is the partition */
+    int*    combine;       /* ACCUM_RADIX: per thread, a line per partition, then fills */
+    long    radix_stage;   /* ACCUM_RADIX: bins staged per partition, a multiple of 16 */
+    int*    staged;        /* ACCUM_RADIX: per thread, radix_stage bins per partition */
+} HIST_ACCUM;
+
+
+/*---------------------------------------------------------------------
+ * Function:  cacheSize
+ * Purpose:   Size of a level of data cache, 0 if unknown
+ * In arg:    level:  1, 2 or 3
+ */
+static inline long cacheSize(int level /* in */)
+{
+    long size = 0;
+    int index;
+    char path[128];
+    FILE* fp;
+
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+    if (level == 1) size = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+    if (level == 2) size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    if (level == 3) size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+    if (size > 0) return size;
+
+    /* sysfs lists the caches of cpu0 as index0, index1, ... */
+    for (index = 0; index < 8; index++)
+    {
+        int cache_level;
+        long kb;
+        char type[16];
+
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/level", index);
+        if ((fp = fopen(path, "r")) == NULL) break;
+        if (fscanf(fp, "%d", &cache_level) != 1) cache_level = 0;
+        fclose(fp);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/type", index);
+        if ((fp = fopen(path, "r")) == NULL) break;
+        if (fscanf(fp, "%15s", type) != 1) type[0] = '\0';
+        fclose(fp);
+        if (cache_level != level || strcmp(type, "Instruction") == 0) continue;
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/size", index);
+        if ((fp = fopen(path, "r")) == NULL) break;
+        if (fscanf(fp, "%ldK", &kb) == 1) size = kb * 1024;
+        fclose(fp);
+    }
+    return size;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  accumStrategyFromName
+ * Purpose:   Look up a strategy by the name printed for it
+ * Return:    the strategy, -1 if there is none by that name
+ */
+static inline int accumStrategyFromName(const char* name /* in */)
+{
+    int s;
+
+    for (s = 0; s < (int)(sizeof(accum_names) / sizeof(accum_names[0])); s++)
+        if (strcmp(name, accum_names[s]) == 0) return s;
+    return -1;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  accumChoose
+ * Purpose:   Pick an accumulation strategy
+ * In args:   bin_count:     number of bins
+ *            num_threads:   number of threads
+ *            sample:        bins of some of the data, all in range
+ *            sample_count:  number of values in sample
+ * Return:    the strategy
+ */
+static inline ACCUM_STRATEGY accumChoose(
+    int        bin_count     /* in */,
+    int        num_threads   /* in */,
+    const int* sample        /* in */,
+    int        sample_count  /* in */)
+{
+    long row_bytes = (long)bin_count * sizeof(int);
+    long l2 = cacheSize(2), l3 = cacheSize(3);
+    int* seen;
+    int i, top = 0;
+
+    if (l2 <= 0) l2 = 256*1024;
+    if (l3 <= 0) l3 = l2;
+
+    /* share of the sample in the most common bin */
+    seen = calloc(bin_count, sizeof(int));
+    for (i = 0; i < sample_count; i++)
+        if (++seen[sample[i]] > top) top = seen[sample[i]];
+    free(seen);
+
+    /* rows that miss even L3 on most adds (the data wants some of it
+       too): count them a slice at a time */
+    if (row_bytes > l2 && row_bytes * num_threads > l3 / 4)
+        return ACCUM_RADIX;
+    /* a row that misses L2 on every add: keep just one */
+    if (row_bytes > l2 && num_threads > 1)
+        return ACCUM_ATOMIC;
+    /* rows fit one at a time, but not one per thread */
+    if (row_bytes * num_threads > l3 && num_threads > ACCUM_SHARD_THREADS)
+        return ACCUM_SHARDED;
+    /* half of the values in one bin: long runs of dependent adds */
+    if (sample_count > 0 && 2*top > sample_count && row_bytes * ACCUM_LANE_ROWS <= l2)
+        return ACCUM_LANES;
+    return ACCUM_PRIVATE;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  accumInit
+ * Purpose:   Allocate zeroed rows of counts for a strategy
+ * In args:   strategy, bin_count, num_threads
+ *            totals:  bin_count zeroed 64-bit counts, where the counts end
+ *                     up (accumMerge or parReduceArrays adds the rest)
+ * Out arg:   acc, free with accumFree
+ */
+static inline void accumInit(
+    HIST_ACCUM*    acc          /* out */,
+    ACCUM_STRATEGY strategy     /* in  */,
+    int            bin_count    /* in  */,
+    int            num_threads  /* in  */,
+    long           totals[]     /* in  */)
+{
+    size_t bytes;
+
+    acc->strategy = strategy;
+    acc->bin_count = bin_count;
+    acc->num_threads = num_threads;
+    switch (strategy)
+    {
+        case ACCUM_ATOMIC:         acc->rows = 1; break;
+        case ACCUM_SHARDED:        acc->rows = (num_threads + ACCUM_SHARD_THREADS - 1) / ACCUM_SHARD_THREADS; break;
+        case ACCUM_LANES:          acc->rows = num_threads * ACCUM_LANE_ROWS; break;
+        default:                   acc->rows = num_threads; break;
+    }
+    /* whole cache lines (16 ints) per row, so rows never share a line */
+    acc->stride = ((long)bin_count + 15) / 16 * 16;
+    bytes = acc->rows * acc->stride * sizeof(int);
+    acc->counts = aligned_alloc(64, bytes);
+    memset(acc->counts, 0, bytes);
+    acc->totals = totals;
+    acc->pending = calloc(acc->rows * 8, sizeof(long));
+
+    /* RADIX_PARTITIONS slices of 2^radix_shift bins cover the row */
+    acc->radix_shift = 0;
+    acc->radix_stage = 0;
+    acc->combine = NULL;
+    acc->staged = NULL;
+    if (strategy == ACCUM_RADIX)
+    {
+        while (((long)bin_count - 1) >> acc->radix_shift >= RADIX_PARTITIONS)
+            acc->radix_shift++;
+        /* at least a whole line; 2^radix_shift / 16 lines per slice */
+        acc->radix_stage = (1L << acc->radix_shift) / 16 * RADIX_REUSE;
+        if (acc->radix_stage < 16) acc->radix_stage = 16;
+        /* 17 ints per partition, so each thread's part is whole lines */
+        bytes = (size_t)num_threads * RADIX_PARTITIONS * 17 * sizeof(int);
+        acc->combine = aligned_alloc(64, bytes);
+        memset(acc->combine, 0, bytes);
+        acc->staged = aligned_alloc(64, num_threads * RADIX_PARTITIONS * acc->radix_stage * sizeof(int));
+    }
+}
+
+static inline void accumFree(HIST_ACCUM* acc)
+{
+    free(acc->counts);
+    free(acc->pending);
+    free(acc->combine);
+    free(acc->staged);
+    acc->counts = NULL;
+    acc->pending = NULL;
+    acc->combine = NULL;
+    acc->staged = NULL;
+}
+
+
+/* First of the rows thread rank adds to, and how many there are */
+static inline int accumFirstRow(const HIST_ACCUM* acc, long rank, int* num_rows)
+{
+    *num_rows = 1;
+    switch (acc->strategy)
+    {
+        case ACCUM_ATOMIC:         return 0;
+        case ACCUM_SHARDED:        return rank / ACCUM_SHARD_THREADS;
+        case ACCUM_LANES:          *num_rows = ACCUM_LANE_ROWS; return rank * ACCUM_LANE_ROWS;
+        default:                   return rank;
+    }
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  accumFlush
+ * Purpose:   Move the counts of thread rank's rows into the totals
+ * In args:   rank:     the thread
+ *            flushed:  values counted in pending when the flush began
+ * In/out:    acc
+ * Note:      Shared rows are emptied with atomic exchanges, so the adds
+ *            of the other threads are never lost; totals are updated
+ *            atomically since several threads may flush at once.
+ */
+static inline void accumFlush(
+    HIST_ACCUM* acc      /* in/out */,
+    long        rank     /* in     */,
+    long        flushed  /* in     */)
+{
+    int num_rows, r, bin;
+    int first = accumFirstRow(acc, rank, &num_rows);
+    int shared = (acc->strategy == ACCUM_ATOMIC || acc->strategy == ACCUM_SHARDED);
+
+    for (r = first; r < first + num_rows; r++)
+    {
+        int* row = acc->counts + r * acc->stride;
+        for (bin = 0; bin < acc->bin_count; bin++)
+        {
+            int count;
+            if (shared)
+                count = __atomic_exchange_n(&row[bin], 0, __ATOMIC_RELAXED);
+            else
+            {
+                count = row[bin];
+                row[bin] = 0;
+            }
+            if (count != 0) __atomic_fetch_add(&acc->totals[bin], count, __ATOMIC_RELAXED);
+        }
+    }
+    /* values added since the flush began stay pending */
+    __atomic_fetch_sub(&acc->pending[8*first], flushed, __ATOMIC_RELAXED);
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  accumCounted
+ * Purpose:   Note that count values went into thread rank's rows, and
+ *            flush them if ACCUM_FLUSH values have gone in
+ * In/out:    acc
+ */
+static inline void accumCounted(
+    HIST_ACCUM* acc     /* in/out */,
+    long        rank    /* in     */,
+    long        count   /* in     */)
+{
+    int num_rows;
+    int first = accumFirstRow(acc, rank, &num_rows);
+    long added = __atomic_add_fetch(&acc->pending[8*first], count, __ATOMIC_RELAXED);
+
+    /* one thread flushes a row once ACCUM_FLUSH values have gone in */
+    if (added >= ACCUM_FLUSH && added - count < ACCUM_FLUSH)
+        accumFlush(acc, rank, added);
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  radixCount
+ * Purpose:   Count the bins staged for one partition of thread rank
+ * In args:   rank:       the thread
+ *            partition:  the partition
+ * In/out:    acc:        the partition is empty on return
+ * Note:      All the bins are in one slice of the row, so after the
+ *            first adds it is in cache.
+ */
+static inline void radixCount(
+    HIST_ACCUM* acc        /* in/out */,
+    long        rank       /* in     */,
+    int         partition  /* in     */)
+{
+    int* combine = acc->combine + rank * RADIX_PARTITIONS * 17;
+    int* fill = combine + RADIX_PARTITIONS * 16;
+    const int* staged = acc->staged + (rank * RADIX_PARTITIONS + partition) * acc->radix_stage;
+    const int* line = combine + partition * 16;
+    int* row = acc->counts + rank * acc->stride;
+    int n = fill[partition], whole = n & ~15, j;
+
+    if (n == 0) return;
+    for (j = 0; j < whole; j++)
+        row[staged[j]]++;
+    /* the last bins have not left the line yet */
+    for (j = whole; j < n; j++)
+        row[line[j - whole]]++;
+    fill[partition] = 0;
+    accumCounted(acc, rank, n);
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  radixPartition
+ * Purpose:   Stage a batch of bins of thread rank by partition, and
+ *            count the partitions whose stage fills up
+ * In args:   rank, bins, count as for accumAddBatch
+ * In/out:    acc
+ * Note:      A bin goes into its partition's line in combine, which
+ *            stays in L1; each time the line is full it is copied to
+ *            the stage in one 64-byte store.
+ */
+static inline void radixPartition(
+    HIST_ACCUM* acc     /* in/out */,
+    long        rank    /* in     */,
+    const int*  bins    /* in     */,
+    long        count   /* in     */)
+{
+    int* combine = acc->combine + rank * RADIX_PARTITIONS * 17;
+    int* fill = combine + RADIX_PARTITIONS * 16;
+    int* staged = acc->staged + rank * RADIX_PARTITIONS * acc->radix_stage;
+    const int shift = acc->radix_shift;
+    const long stage = acc->radix_stage;
+    long j;
+
+    for (j = 0; j < count; j++)
+    {
+        int partition = bins[j] >> shift;
+        int n = fill[partition];
+        int* line = combine + partition * 16;
+
+        line[n & 15] = bins[j];
+        fill[partition] = ++n;
+        if ((n & 15) == 0)
+        {
+            memcpy(staged + partition * stage + n - 16, line, 16 * sizeof(int));
+            if (n == stage) radixCount(acc, rank, partition);
+        }
+    }
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  accumAddBatch
+ * Purpose:   Count a batch of bins for thread rank
+ * In args:   rank:   the thread
+ *            bins:   bins of the values, all in range
+ *            count:  number of bins
+ * In/out:    acc
+ */
+static inline void accumAddBatch(
+    HIST_ACCUM* acc     /* in/out */,
+    long        rank    /* in     */,
+    const int*  bins    /* in     */,
+    long        count   /* in     */)
+{
+    int* row;
+    long j;
+
+    switch (acc->strategy)
+    {
+        case ACCUM_RADIX:
+            /* counted, and flushed, when a stage is */
+            radixPartition(acc, rank, bins, count);
+            return;
+
+        case ACCUM_PRIVATE:
+            row = acc->counts + rank * acc->stride;
+            for (j = 0; j < count; j++)
+                row[bins[j]]++;
+            break;
+
+        case ACCUM_ATOMIC:
+        case ACCUM_SHARDED:
+            row = acc->counts + (rank / ACCUM_SHARD_THREADS) * acc->stride;
+            if (acc->strategy == ACCUM_ATOMIC) row = acc->counts;
+            for (j = 0; j < count; j++)
+                __atomic_fetch_add(&row[bins[j]], 1, __ATOMIC_RELAXED);
+            break;
+
+        case ACCUM_LANES:
+        {
+            int* lane[ACCUM_LANE_ROWS];
+            int l;
+
+            for (l = 0; l < ACCUM_LANE_ROWS; l++)
+                lane[l] = acc->counts + (rank * ACCUM_LANE_ROWS + l) * acc->stride;
+            /* neighbouring values go to different lanes */
+            for (j = 0; j + ACCUM_LANE_ROWS <= count; j += ACCUM_LANE_ROWS)
+                for (l = 0; l < ACCUM_LANE_ROWS; l++)
+                    lane[l][bins[j + l]]++;
+            for (; j < count; j++)
+                lane[0][bins[j]]++;
+            break;
+        }
+    }
+
+    accumCounted(acc, rank, count);
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  accumFinish
+ * Purpose:   Count what thread rank still has staged, after its last
+ *            batch and before the rows are merged
+ * In/out:    acc
+ */
+static inline void accumFinish(
+    HIST_ACCUM* acc     /* in/out */,
+    long        rank    /* in     */)
+{
+    int partition;
+
+    if (acc->strategy != ACCUM_RADIX) return;
+    for (partition = 0; partition < RADIX_PARTITIONS; partition++)
+        radixCount(acc, rank, partition);
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  accumMerge
+ * Purpose:   Add all rows into the totals, once every thread has
+ *            called accumFinish
+ * In/out:    acc
+ */
+static inline void accumMerge(HIST_ACCUM* acc /* in/out */)
+{
+    int r, bin;
+
+    for (r = 0; r < acc->rows; r++)
+    {
+        const int* row = acc->counts + r * acc->stride;
+        for (bin = 0; bin < acc->bin_count; bin++)
+            acc->totals[bin] += row[bin];
+    }
+}
+
+#endif
@@ -0,0 +1,132 @@
+/* COMP 137 Spring 2019
+ * filename: histogram_bench.c
+ *
+ * Purpose:   Compare the OpenMP variants of histogram_omp with
+ *            histogram_pthreads over a range of bin counts and thread
+ *            counts.  Each program is run as it would be from the shell,
+ *            and its "thread time" (the counting only) and "bin sum" are
+ *            read from its output; the best of <repetitions> runs is
+ *            printed, in ms, along with a check that every program
+ *            counted every value.  A program that declines a setting
+ *            (the reduction variant with too many bins) shows "-".
+ *
+ *            Build both programs in this directory first:
+ *            gcc -O3 -march=native -o histogram_pthreads histogram_pthreads.c -lm -lpthread
+ *            gcc -O3 -march=native -fopenmp -o histogram_omp histogram_omp.c -lm
+ *
+ * Program arguments: ./histogram_bench <data_count> <max_threads> [repetitions]
+ *   <data_count>  = number of values in each run
+ *   <max_threads> = thread counts 1, 2, 4, ... up to this are tried
+ *   [repetitions] = runs of each program per setting, default 3
+ *
+ * How to compile: gcc -O3 -o histogram_bench histogram_bench.c
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* bin counts tried, from all in L1 to far past L2 */
+static const int bin_counts[] = { 16, 256, 4096, 65536, 1048576 };
+#define BIN_SETTINGS (int)(sizeof(bin_counts) / sizeof(bin_counts[0]))
+
+/* the programs and their arguments after <num_threads>; their stderr
+   (a declined setting says why there) is dropped */
+static const char* programs[] = {
+    "./histogram_pthreads %d 0 100 %ld %d auto 2>/dev/null",
+    "./histogram_omp %d 0 100 %ld %d reduction 2>/dev/null",
+    "./histogram_omp %d 0 100 %ld %d private 2>/dev/null",
+    "./histogram_omp %d 0 100 %ld %d atomic 2>/dev/null"
+};
+static const char* program_names[] = { "pthreads", "reduction", "private", "atomic" };
+#define PROGRAMS (int)(sizeof(programs) / sizeof(programs[0]))
+
+void usage(char prog_name[]);
+int runProgram(const char* command, double* thread_time, long* bin_sum);
+
+int main(int argc, char* argv[])
+{
+    long data_count;
+    int max_threads, repetitions = 3, b, p, r, threads;
+    char command[256];
+
+    if (argc != 3 && argc != 4) usage(argv[0]);
+    data_count = strtol(argv[1], NULL, 10);
+    max_threads = strtol(argv[2], NULL, 10);
+    if (argc == 4) repetitions = strtol(argv[3], NULL, 10);
+    if (data_count < 1 || max_threads < 1 || repetitions < 1) usage(argv[0]);
+
+    printf("%10s %8s", "bins", "threads");
+    for (p = 0; p < PROGRAMS; p++)
+        printf(" %12s", program_names[p]);
+    printf("  check\n");
+
+    for (b = 0; b < BIN_SETTINGS; b++)
+        for (threads = 1; ; threads = (2*threads < max_threads) ? 2*threads : max_threads)
+        {
+            int ok = 1;
+
+            printf("%10d %8d", bin_counts[b], threads);
+            for (p = 0; p < PROGRAMS; p++)
+            {
+                double best = -1.0, time;
+                long sum;
+                int status = 0;
+
+                snprintf(command, sizeof(command), programs[p], bin_counts[b], data_count, threads);
+                for (r = 0; r < repetitions && status != -2; r++)
+                {
+                    status = runProgram(command, &time, &sum);
+                    if (status == -1 || (status == 0 && sum != data_count))
+                        ok = 0;
+                    else if (status == 0 && (best < 0 || time < best))
+                        best = time;
+                }
+                if (best < 0) printf(" %12s", "-");
+                else printf(" %12.2f", best * 1000.0);
+                fflush(stdout);
+            }
+            printf("  %s\n", ok ? "ok" : "FAILED");
+            if (threads == max_threads) break;
+        }
+    return 0;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  runProgram
+ * Purpose:   Run a histogram program and read its results
+ * In arg:    command:      the command line
+ * Out args:  thread_time:  its "thread time" in seconds
+ *            bin_sum:      its "bin sum"
+ * Return:    0, -1 if it failed, -2 if it ran but printed neither
+ *            (it declined the setting)
+ */
+int runProgram(const char* command, double* thread_time, long* bin_sum)
+{
+    char line[512];
+    int found = 0;
+    FILE* out = popen(command, "r");
+
+    if (out == NULL) return -1;
+    while (fgets(line, sizeof(line), out) != NULL)
+    {
+        if (sscanf(line, "thread time = %lf", thread_time) == 1) found |= 1;
+        if (sscanf(line, "bin sum = %ld", bin_sum) == 1) found |= 2;
+    }
+    if (pclose(out) != 0) return -1;
+    if (found == 0) return -2;
+    return (found == 3) ? 0 : -1;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  usage
+ * Purpose:   Print a message showing how to run program and quit
+ * In arg:    prog_name:  the name of the program from the command line
+ */
+void usage(char prog_name[] /* in */)
+{
+    fprintf(stderr, "usage: %s ", prog_name);
+    fprintf(stderr, "<data_count> <max_threads> [repetitions]\n");
+    exit(0);
+}  /* Usage */
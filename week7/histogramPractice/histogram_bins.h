@@ -0,0 +1,451 @@
+/* File:     histogram_bins.h
+ * COMP 137 Spring 2019
+ *
+ * Purpose:  Find the bins of a batch of measurements at a time, for the
+ *           histogram programs.  A bin satisfies the same rule as in
+ *           the reference findBin of bin_search_bench.c:
+ *
+ *               bin_maxes[i-1] <= data < bin_maxes[i]
+ *
+ *           where bin_maxes[-1] = min_meas.
+ *
+ *           createBins makes bins of equal width, so the bin of a value
+ *           is just (data - min_meas) / bin_width.  binMapInit checks
+ *           whether the edges are (close to) uniform; if they are,
+ *           binBatch computes that guess for 8 (AVX2) or 16 (AVX-512)
+ *           values at a time and then moves it one bin down or up where
+ *           rounding put it on the wrong side of the real edge, so the
+ *           result is exactly what binSearch returns.
+ *
+ *           Other edges (log-scale latency bins, say) are searched in
+ *           an Eytzinger copy of the edges: the sorted edges laid out as
+ *           an implicit binary tree, root at 1 and the children of k at
+ *           2k and 2k+1.  The search is branch free, the 16 nodes four
+ *           levels down share one cache line and are prefetched, and
+ *           EYTZINGER_LANES values are searched side by side so their
+ *           cache misses overlap.  binSearch, a plain binary search over
+ *           the sorted edges, is kept for comparison.
+ *
+ *           Values outside the bins get -1 (below min_meas) or bin_count
+ *           (at or above the last edge, or NaN) instead of a bin.
+ *
+ *           rangeBatch finds the smallest and largest value of a batch,
+ *           for programs that pick the bins from the data.
+ *
+ * Note:     Everything is static, so a program only has to include this
+ *           file.  Compile with -march=native to get the SIMD kernels.
+ */
+#ifndef _HISTOGRAM_BINS_H_
+#define _HISTOGRAM_BINS_H_
+
+#include <stdlib.h>
+#include <math.h>
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+/* values binned per call of binBatch by the histogram programs */
+#define BIN_BATCH 1024
+
+/* values searched side by side in the Eytzinger tree */
+#define EYTZINGER_LANES 8
+
+typedef struct {
+    float*  edges;       /* edges[0] = min_meas, edges[i+1] = bin_maxes[i] */
+    int     bin_count;   /* number of bins */
+    int     uniform;     /* 1 if the closed form guess can be used */
+    float   min_meas;    /* smallest value of the first bin */
+    float   inv_width;   /* 1 / bin width, for uniform bins */
+    float*  eytzinger;   /* edges in Eytzinger order, padded with +inf */
+    int     depth;       /* levels of the Eytzinger tree */
+} BIN_MAP;
+
+
+/*---------------------------------------------------------------------
+ * Function:  eytzingerFill
+ * Purpose:   Store sorted[i..] into the subtree rooted at k (in order)
+ * Return:    index of the next sorted value to store
+ */
+static inline int eytzingerFill(
+    float*       tree     /* out */,
+    int          size     /* in  */,
+    const float* sorted   /* in  */,
+    int          count    /* in  */,
+    int          i        /* in  */,
+    int          k        /* in  */)
+{
+    if (k < size)
+    {
+        i = eytzingerFill(tree, size, sorted, count, i, 2*k);
+        tree[k] = (i < count) ? sorted[i] : INFINITY;
+        i++;
+        i = eytzingerFill(tree, size, sorted, count, i, 2*k + 1);
+    }
+    return i;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  binMapInit
+ * Purpose:   Copy the bin edges and decide how bins will be found
+ * In args:   bin_maxes:  list of max bin values
+ *            bin_count:  number of bins
+ *            min_meas:   the minimum possible measurement
+ * Out arg:   map:        the bin map, free with binMapFree
+ * Note:      Bins count as uniform if every edge is within 1/8 of a
+ *            bin of where equal widths would put it; the guess is then
+ *            never off by more than one bin.
+ */
+static inline void binMapInit(
+    BIN_MAP* map          /* out */,
+    float    bin_maxes[]  /* in  */,
+    int      bin_count    /* in  */,
+    float    min_meas     /* in  */)
+{
+    double width;
+    int i;
+
+    map->edges = malloc((bin_count+1)*sizeof(float));
+    map->bin_count = bin_count;
+    map->min_meas = min_meas;
+    map->edges[0] = min_meas;
+    for (i = 0; i < bin_count; i++)
+        map->edges[i+1] = bin_maxes[i];
+
+    width = ((double)map->edges[bin_count] - min_meas) / bin_count;
+    map->uniform = (width > 0.0);
+    for (i = 0; i < bin_count; i++)
+        if (fabs(map->edges[i+1] - (min_meas + (i+1)*width)) > width/8)
+            map->uniform = 0;
+    map->inv_width = (float)(1.0 / width);
+
+    /* a complete tree of 2^depth - 1 nodes holding all bin_count+1 edges */
+    map->eytzinger = NULL;
+    map->depth = 0;
+    if (!map->uniform)
+    {
+        int size;
+        while ((1 << map->depth) - 1 < bin_count + 1)
+            map->depth++;
+        size = 1 << map->depth;
+        /* 64-byte aligned, so nodes 16k..16k+15 are one cache line */
+        map->eytzinger = aligned_alloc(64, (size*sizeof(float) + 63) / 64 * 64);
+        map->eytzinger[0] = NAN;
+        eytzingerFill(map->eytzinger, size, map->edges, bin_count + 1, 0, 1);
+    }
+}
+
+static inline void binMapFree(BIN_MAP* map)
+{
+    free(map->edges);
+    free(map->eytzinger);
+    map->edges = NULL;
+    map->eytzinger = NULL;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  binSearch
+ * Purpose:   Binary search for the bin of one value, any edges
+ * Return:    the bin, -1 below min_meas, bin_count above the last edge
+ */
+static inline int binSearch(
+    const BIN_MAP* map    /* in */,
+    float          data   /* in */)
+{
+    const float* edges = map->edges;
+    int bottom = 0, count = map->bin_count + 1;
+
+    if (data < edges[0]) return -1;
+    if (!(data < edges[map->bin_count])) return map->bin_count;
+
+    /* last edge <= data, as in std::upper_bound - 1 */
+    while (count > 1)
+    {
+        int half = count / 2;
+        if (edges[bottom + half] <= data) bottom += half;
+        count -= half;
+    }
+    return bottom;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  eytzingerToBin
+ * Purpose:   Turn the node where an Eytzinger search ended into a bin
+ * In args:   k:      node reached after depth levels
+ *            depth:  levels of the tree
+ * Return:    the bin whose upper edge is the first edge > data
+ */
+static inline int eytzingerToBin(
+    unsigned  k      /* in */,
+    int       depth  /* in */)
+{
+    int level;
+
+    /* undo the right turns taken after the last left turn: k is then
+       the first node > data */
+    k >>= __builtin_ffs(~k);
+    /* in order position of node k of a complete tree */
+    level = 31 - __builtin_clz(k);
+    return (int)(((2*(k - (1u << level)) + 1) << (depth - 1 - level)) - 1) - 1;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  binEytzinger
+ * Purpose:   Branch free search for the bin of one value, any edges
+ * Return:    the bin, -1 below min_meas, bin_count above the last edge
+ */
+static inline int binEytzinger(
+    const BIN_MAP* map    /* in */,
+    float          data   /* in */)
+{
+    const float* tree = map->eytzinger;
+    unsigned k = 1;
+    int level;
+
+    if (data < map->edges[0]) return -1;
+    if (!(data < map->edges[map->bin_count])) return map->bin_count;
+
+    for (level = 0; level < map->depth; level++)
+    {
+        /* prefetch never faults, so running past the end is harmless */
+        __builtin_prefetch(tree + 16*k);
+        k = 2*k + (tree[k] <= data);
+    }
+    return eytzingerToBin(k, map->depth);
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  binEytzingerBatch
+ * Purpose:   Search EYTZINGER_LANES values at a time in the Eytzinger
+ *            tree, one level of every search per step
+ * In args:   map, data, count as for binBatch
+ * Out arg:   bins
+ */
+static inline void binEytzingerBatch(
+    const BIN_MAP* map    /* in  */,
+    const float*   data   /* in  */,
+    int*           bins   /* out */,
+    long           count  /* in  */)
+{
+    const float* tree = map->eytzinger;
+    const float lowest = map->edges[0];
+    const float highest = map->edges[map->bin_count];
+    long i = 0;
+    int j, level;
+
+    for (; i + EYTZINGER_LANES <= count; i += EYTZINGER_LANES)
+    {
+        unsigned k[EYTZINGER_LANES];
+        float x[EYTZINGER_LANES];
+
+        /* values outside the bins search for lowest, fixed up below */
+        for (j = 0; j < EYTZINGER_LANES; j++)
+        {
+            x[j] = data[i+j];
+            if (!(x[j] >= lowest && x[j] < highest)) x[j] = lowest;
+            k[j] = 1;
+        }
+        for (level = 0; level < map->depth; level++)
+            for (j = 0; j < EYTZINGER_LANES; j++)
+            {
+                __builtin_prefetch(tree + 16*k[j]);
+                k[j] = 2*k[j] + (tree[k[j]] <= x[j]);
+            }
+        for (j = 0; j < EYTZINGER_LANES; j++)
+        {
+            float v = data[i+j];
+            bins[i+j] = (v < lowest) ? -1
+                      : !(v < highest) ? map->bin_count
+                      : eytzingerToBin(k[j], map->depth);
+        }
+    }
+    for (; i < count; i++)
+        bins[i] = binEytzinger(map, data[i]);
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  binUniform
+ * Purpose:   Closed form bin of one value for uniform bins
+ * Return:    the bin, -1 below min_meas, bin_count above the last edge
+ */
+static inline int binUniform(
+    const BIN_MAP* map    /* in */,
+    float          data   /* in */)
+{
+    const float* edges = map->edges;
+    int n = map->bin_count;
+    int bin;
+
+    if (data < edges[0]) return -1;
+    if (!(data < edges[n])) return n;
+
+    bin = (int)((data - map->min_meas) * map->inv_width);
+    if (bin > n-1) bin = n-1;
+    /* the guess is at most one bin off */
+    bin -= (data < edges[bin]);
+    bin += (data >= edges[bin+1]);
+    return bin;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  binBatch
+ * Purpose:   Find the bins of count values
+ * In args:   map:    the bin map
+ *            data:   the values
+ *            count:  number of values
+ * Out arg:   bins:   bins[i] is the bin of data[i], -1 or bin_count if
+ *                    data[i] is outside the bins
+ */
+static inline void binBatch(
+    const BIN_MAP* map    /* in  */,
+    const float*   data   /* in  */,
+    int*           bins   /* out */,
+    long           count  /* in  */)
+{
+    long i = 0;
+
+    if (!map->uniform)
+    {
+        binEytzingerBatch(map, data, bins, count);
+        return;
+    }
+
+#if defined(__AVX512F__)
+    {
+        const __m512  vmin = _mm512_set1_ps(map->min_meas);
+        const __m512  vinv = _mm512_set1_ps(map->inv_width);
+        const __m512  vtop = _mm512_set1_ps(map->edges[map->bin_count]);
+        const __m512i vlast = _mm512_set1_epi32(map->bin_count - 1);
+        const __m512i vzero = _mm512_setzero_si512();
+        const __m512i vone = _mm512_set1_epi32(1);
+        const __m512i vunder = _mm512_set1_epi32(-1);
+        const __m512i vover = _mm512_set1_epi32(map->bin_count);
+
+        for (; i + 16 <= count; i += 16)
+        {
+            __m512 x = _mm512_loadu_ps(&data[i]);
+            __m512i bin = _mm512_cvttps_epi32(_mm512_mul_ps(_mm512_sub_ps(x, vmin), vinv));
+            __m512 lo, hi;
+            __mmask16 below, above;
+
+            bin = _mm512_min_epi32(_mm512_max_epi32(bin, vzero), vlast);
+            lo = _mm512_i32gather_ps(bin, map->edges, 4);
+            hi = _mm512_i32gather_ps(_mm512_add_epi32(bin, vone), map->edges, 4);
+            bin = _mm512_mask_sub_epi32(bin, _mm512_cmp_ps_mask(x, lo, _CMP_LT_OQ), bin, vone);
+            bin = _mm512_mask_add_epi32(bin, _mm512_cmp_ps_mask(x, hi, _CMP_GE_OQ), bin, vone);
+
+            /* outside the bins, NaN counts as above */
+            below = _mm512_cmp_ps_mask(x, vmin, _CMP_LT_OQ);
+            above = _mm512_cmp_ps_mask(x, vtop, _CMP_NLT_UQ);
+            bin = _mm512_mask_mov_epi32(bin, below, vunder);
+            bin = _mm512_mask_mov_epi32(bin, above, vover);
+            _mm512_storeu_si512((void*)&bins[i], bin);
+        }
+    }
+#elif defined(__AVX2__)
+    {
+        const __m256  vmin = _mm256_set1_ps(map->min_meas);
+        const __m256  vinv = _mm256_set1_ps(map->inv_width);
+        const __m256  vtop = _mm256_set1_ps(map->edges[map->bin_count]);
+        const __m256i vlast = _mm256_set1_epi32(map->bin_count - 1);
+        const __m256i vzero = _mm256_setzero_si256();
+        const __m256i vone = _mm256_set1_epi32(1);
+        const __m256i vunder = _mm256_set1_epi32(-1);
+        const __m256i vover = _mm256_set1_epi32(map->bin_count);
+
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 x = _mm256_loadu_ps(&data[i]);
+            __m256i bin = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_sub_ps(x, vmin), vinv));
+            __m256 lo, hi, below, above;
+
+            bin = _mm256_min_epi32(_mm256_max_epi32(bin, vzero), vlast);
+            lo = _mm256_i32gather_ps(map->edges, bin, 4);
+            hi = _mm256_i32gather_ps(map->edges, _mm256_add_epi32(bin, vone), 4);
+            /* a true compare is all ones, which is -1 */
+            bin = _mm256_add_epi32(bin, _mm256_castps_si256(_mm256_cmp_ps(x, lo, _CMP_LT_OQ)));
+            bin = _mm256_sub_epi32(bin, _mm256_castps_si256(_mm256_cmp_ps(x, hi, _CMP_GE_OQ)));
+
+            below = _mm256_cmp_ps(x, vmin, _CMP_LT_OQ);
+            above = _mm256_cmp_ps(x, vtop, _CMP_NLT_UQ);
+            bin = _mm256_blendv_epi8(bin, vunder, _mm256_castps_si256(below));
+            bin = _mm256_blendv_epi8(bin, vover, _mm256_castps_si256(above));
+            _mm256_storeu_si256((__m256i*)&bins[i], bin);
+        }
+    }
+#endif
+    for (; i < count; i++)
+        bins[i] = binUniform(map, data[i]);
+}
+
+
+
+/*---------------------------------------------------------------------
+ * Function:  rangeBatch
+ * Purpose:   Widen [min, max] to hold count more values
+ * In args:   data:   the values
+ *            count:  number of values
+ * In/out:    min_p, max_p:  start as +INFINITY and -INFINITY for an
+ *                           empty range
+ * Note:      NaNs are skipped: the SIMD min and max return their second
+ *            operand when either is NaN, and that is the running one.
+ */
+static inline void rangeBatch(
+    const float* data    /* in     */,
+    long         count   /* in     */,
+    float*       min_p   /* in/out */,
+    float*       max_p   /* in/out */)
+{
+    float lo = *min_p, hi = *max_p;
+    long i = 0;
+
+#if defined(__AVX512F__)
+    {
+        __m512 vlo = _mm512_set1_ps(lo), vhi = _mm512_set1_ps(hi);
+
+        for (; i + 16 <= count; i += 16)
+        {
+            __m512 x = _mm512_loadu_ps(&data[i]);
+            vlo = _mm512_min_ps(x, vlo);
+            vhi = _mm512_max_ps(x, vhi);
+        }
+        lo = _mm512_reduce_min_ps(vlo);
+        hi = _mm512_reduce_max_ps(vhi);
+    }
+#elif defined(__AVX2__)
+    {
+        __m256 vlo = _mm256_set1_ps(lo), vhi = _mm256_set1_ps(hi);
+        float lanes_lo[8], lanes_hi[8];
+        int l;
+
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 x = _mm256_loadu_ps(&data[i]);
+            vlo = _mm256_min_ps(x, vlo);
+            vhi = _mm256_max_ps(x, vhi);
+        }
+        _mm256_storeu_ps(lanes_lo, vlo);
+        _mm256_storeu_ps(lanes_hi, vhi);
+        for (l = 0; l < 8; l++)
+        {
+            lo = (lanes_lo[l] < lo) ? lanes_lo[l] : lo;
+            hi = (lanes_hi[l] > hi) ? lanes_hi[l] : hi;
+        }
+    }
+#endif
+    for (; i < count; i++)
+    {
+        lo = (data[i] < lo) ? data[i] : lo;
+        hi = (data[i] > hi) ? data[i] : hi;
+    }
+    *min_p = lo;
+    *max_p = hi;
+}
+
+#endif
@@ -0,0 +1,166 @@
+/* COMP 137 Spring 2019
+ * filename: histogram_merge.c
+ *
+ * Purpose:   Add up histograms saved by histogram_stream (or anything
+ *            else that writes hist_serialize.h's format), for example
+ *            the partial histograms of many shards of a data set.
+ *
+ *            The inputs are merged in their encoded form (histMerge):
+ *            the edges are checked and copied once and only the listed
+ *            counts are decoded.  The sum is written in the same format,
+ *            so merged files can be merged again, or printed like
+ *            printHistogram does when the output is -.
+ *
+ * Program arguments: ./histogram_merge <out> <in> [in ...]
+ *   <out> = file for the merged histogram, - to print it
+ *   <in>  = encoded histograms, all with the same bins
+ *
+ * How to compile: gcc -O3 -o histogram_merge histogram_merge.c
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "timer.h"
+#include "hist_serialize.h"
+
+void usage(char prog_name[]);
+unsigned char* readFile(char* filename, long* length);
+void printHistogram(
+    float bin_maxes[]   /* in */,
+    long  bin_counts[]  /* in */,
+    int   bin_count     /* in */,
+    float min_meas      /* in */);
+
+int main(int argc, char* argv[])
+{
+    int num_inputs = argc - 2, i, status, bin_count;
+    const unsigned char** inputs;
+    long* lengths;
+    long bytes_in = 0;
+    HIST_BUFFER merged;
+    float min_meas;
+    float* bin_maxes;
+    long* bin_counts;
+    FILE* fp;
+    double t1, t2;
+
+    if (argc < 3) usage(argv[0]);
+    inputs = malloc(num_inputs*sizeof(unsigned char*));
+    lengths = malloc(num_inputs*sizeof(long));
+    for (i = 0; i < num_inputs; i++)
+    {
+        inputs[i] = readFile(argv[i + 2], &lengths[i]);
+        if (inputs[i] == NULL)
+        {
+            fprintf(stderr, "could not read %s\n", argv[i + 2]);
+            exit(-1);
+        }
+        bytes_in += lengths[i];
+    }
+
+    GET_TIME(t1);
+    histBufferInit(&merged);
+    status = histMerge(inputs, lengths, num_inputs, &merged);
+    GET_TIME(t2);
+    if (status == -2)
+    {
+        fprintf(stderr, "the inputs do not have the same bins\n");
+        exit(-1);
+    }
+    if (status < 0)
+    {
+        fprintf(stderr, "an input is not an encoded histogram\n");
+        exit(-1);
+    }
+
+    if (strcmp(argv[1], "-") == 0)
+    {
+        if (histDecode(merged.bytes, merged.length, &min_meas, &bin_maxes, &bin_counts, &bin_count) != 0)
+        {
+            fprintf(stderr, "could not decode the merged histogram\n");
+            exit(-1);
+        }
+        printHistogram(bin_maxes, bin_counts, bin_count, min_meas);
+        free(bin_maxes);
+        free(bin_counts);
+    }
+    else if ((fp = fopen(argv[1], "wb")) == NULL
+             || fwrite(merged.bytes, 1, merged.length, fp) != (size_t)merged.length
+             || fclose(fp) != 0)
+    {
+        fprintf(stderr, "could not write %s\n", argv[1]);
+        exit(-1);
+    }
+    printf("merged %d histograms, %ld bytes in, %ld bytes out, in %f s (%.1f MB/s)\n",
+           num_inputs, bytes_in, merged.length, t2 - t1, bytes_in / (t2 - t1) / 1048576.0);
+
+    for (i = 0; i < num_inputs; i++)
+        free((void*)inputs[i]);
+    free(inputs);
+    free(lengths);
+    histBufferFree(&merged);
+    return 0;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  readFile
+ * Purpose:   Read a whole file into memory
+ * In arg:    filename
+ * Out arg:   length:  bytes read
+ * Return:    the bytes, NULL if the file cannot be read
+ */
+unsigned char* readFile(char* filename, long* length)
+{
+    FILE* fp = fopen(filename, "rb");
+    unsigned char* bytes;
+
+    if (fp == NULL) return NULL;
+    fseek(fp, 0, SEEK_END);
+    *length = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    bytes = malloc(*length > 0 ? *length : 1);
+    if (*length < 0 || fread(bytes, 1, *length, fp) != (size_t)*length)
+    {
+        free(bytes);
+        bytes = NULL;
+    }
+    fclose(fp);
+    return bytes;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  printHistogram
+ * Purpose:   Print a histogram, as the histogram programs do
+ */
+void printHistogram(
+    float bin_maxes[]   /* in */,
+    long  bin_counts[]  /* in */,
+    int   bin_count     /* in */,
+    float min_meas      /* in */)
+{
+    int i;
+    float bin_max, bin_min;
+
+    for (i = 0; i < bin_count; i++)
+    {
+        bin_max = bin_maxes[i];
+        bin_min = (i == 0) ? min_meas: bin_maxes[i-1];
+        printf("%.3f-%.3f:\t%ld\n", bin_min, bin_max, bin_counts[i]);
+    }
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  usage
+ * Purpose:   Print a message showing how to run program and quit
+ * In arg:    prog_name:  the name of the program from the command line
+ */
+void usage(char prog_name[] /* in */)
+{
+    fprintf(stderr, "usage: %s ", prog_name);
+    fprintf(stderr, "<out> <in> [in ...]\n");
+    fprintf(stderr, "   out = - to print the merged histogram\n");
+    exit(0);
+}  /* Usage */
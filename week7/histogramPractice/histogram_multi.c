@@ -0,0 +1,404 @@
+/* COMP 137 Spring 2019
+ * filename: histogram_multi.c
+ *
+ * Purpose:   Build several histograms of the same data at once, at
+ *            different resolutions (16, 256 and 65536 bins, say) and over
+ *            different ranges, in a single pass over the data.
+ *
+ *            Each level is a createBins configuration: bin_count bins of
+ *            equal width from min_meas to max_meas.  Before counting,
+ *            every level is checked against the finer levels: if each of
+ *            its edges is exactly one of a finer level's edges (same
+ *            range and a power of 2 fewer bins, usually), its counts are
+ *            sums of runs of the finer level's counts and it is derived
+ *            from them after the pass.  Only the other levels, the base
+ *            levels, are counted.
+ *
+ *            Each thread takes BIN_BATCH values at a time and bins them
+ *            for every base level while they are still in L1, so the data
+ *            is read from memory once however many levels there are.
+ *            Every base level has its own accumulator (accumChoose), whose
+ *            rows are merged with parReduceArrays.
+ *
+ *            Since the levels need not cover the same range, a value
+ *            outside a level is not an error: it is counted as below or
+ *            above that level.
+ *
+ *            With CHECK_LEVELS = 1 every level is also counted on its own,
+ *            one pass per level as histogram.c would, and compared.
+ *
+ * Program arguments: ./histogram_multi <data_count> <num_threads> <level> [level ...]
+ *   <data_count>  = number of values in list of random numbers
+ *   <num_threads> = number of threads
+ *   <level>       = bin_count:min_meas:max_meas, e.g. 256:0:100
+ *
+ *            The values are normal over the widest range of the levels.
+ *
+ * How to compile: gcc -O3 -march=native -o histogram_multi histogram_multi.c -lm -lpthread
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "timer.h"
+#include "histogram_bins.h"
+#include "histogram_accum.h"
+#include "par_reduce.h"
+#include "cbrng.h"
+
+/* PRINT_BINS = 1 -> print the bins of every level
+ * PRINT_BINS != 1 -> only a summary line per level
+ */
+#define PRINT_BINS 0
+
+/* CHECK_LEVELS = 1 -> also count every level on its own and compare
+ * CHECK_LEVELS != 1 -> only the single pass
+ */
+#define CHECK_LEVELS 0
+
+#define DATA_SEED 0
+
+typedef struct {
+    int      bin_count;
+    float    min_meas, max_meas;
+    float*   bin_maxes;
+    BIN_MAP  map;
+    int      base;        /* the level counted for this one, itself if it is counted */
+    int*     edge_bin;    /* derived: edge k is edge edge_bin[k] of the base */
+    long*    counts;      /* [0] below, [i+1] bin i, [bin_count+1] above */
+    HIST_ACCUM accum;     /* base levels: columns as in counts */
+} LEVEL;
+
+void usage(char prog_name[]);
+void createBins(float min_meas, float max_meas, float bin_maxes[], int bin_count);
+int levelNests(LEVEL* coarse, const LEVEL* fine);
+void deriveCounts(LEVEL* coarse, const LEVEL* fine);
+void* generateWork(void* args);
+void* threadWork(void* args);
+
+/* shared by all threads */
+LEVEL* levels;
+int level_count;
+int* bases;                     /* the base levels */
+int base_count;
+float* data;
+long data_count;
+float data_min, data_max;
+int num_threads;
+BARRIER barrier;
+
+int main(int argc, char* argv[])
+{
+    pthread_t* thread_handles;
+    int* order;
+    int* sample;
+    long t, i, n;
+    int l, m, b;
+    double t1, t2, setup_time, thread_time;
+
+    if (argc < 4) usage(argv[0]);
+    data_count = strtol(argv[1], NULL, 10);
+    num_threads = strtol(argv[2], NULL, 10);
+    level_count = argc - 3;
+    if (data_count < 0 || num_threads < 1) usage(argv[0]);
+
+    levels = calloc(level_count, sizeof(LEVEL));
+    for (l = 0; l < level_count; l++)
+    {
+        LEVEL* level = &levels[l];
+        if (sscanf(argv[l + 3], "%d:%f:%f", &level->bin_count, &level->min_meas, &level->max_meas) != 3
+            || level->bin_count < 1 || !(level->min_meas < level->max_meas)) usage(argv[0]);
+        if (l == 0 || level->min_meas < data_min) data_min = level->min_meas;
+        if (l == 0 || level->max_meas > data_max) data_max = level->max_meas;
+    }
+
+    data = malloc((data_count > 0 ? data_count : 1)*sizeof(float));
+    thread_handles = malloc(num_threads*sizeof(pthread_t));
+    for (t = 0; t < num_threads; t++)
+        pthread_create(&thread_handles[t], NULL, generateWork, (void*) t);
+    for (t = 0; t < num_threads; t++)
+        pthread_join(thread_handles[t], NULL);
+
+    GET_TIME(t1);
+    for (l = 0; l < level_count; l++)
+    {
+        LEVEL* level = &levels[l];
+        level->bin_maxes = malloc(level->bin_count*sizeof(float));
+        createBins(level->min_meas, level->max_meas, level->bin_maxes, level->bin_count);
+        binMapInit(&level->map, level->bin_maxes, level->bin_count, level->min_meas);
+        level->counts = calloc(level->bin_count + 2, sizeof(long));
+        level->base = l;
+    }
+
+    /* finest first: a level can only be derived from one with more bins */
+    order = malloc(level_count*sizeof(int));
+    for (l = 0; l < level_count; l++)
+    {
+        for (m = l; m > 0 && levels[order[m-1]].bin_count < levels[l].bin_count; m--)
+            order[m] = order[m-1];
+        order[m] = l;
+    }
+    bases = malloc(level_count*sizeof(int));
+    base_count = 0;
+    for (l = 0; l < level_count; l++)
+    {
+        LEVEL* level = &levels[order[l]];
+        for (b = 0; b < base_count; b++)
+            if (levelNests(level, &levels[bases[b]]))
+            {
+                level->base = bases[b];
+                break;
+            }
+        if (b == base_count) bases[base_count++] = order[l];
+    }
+
+    /* an accumulator per base level, from a sample of its columns */
+    n = (data_count < ACCUM_SAMPLE) ? data_count : ACCUM_SAMPLE;
+    sample = malloc((n > 0 ? n : 1)*sizeof(int));
+    for (b = 0; b < base_count; b++)
+    {
+        LEVEL* level = &levels[bases[b]];
+        for (i = 0; i < n; i++)
+            sample[i] = binSearch(&level->map, data[i * data_count / n]) + 1;
+        accumInit(&level->accum, accumChoose(level->bin_count + 2, num_threads, sample, n),
+                  level->bin_count + 2, num_threads, level->counts);
+    }
+    free(sample);
+    barrierInit(&barrier, num_threads);
+    GET_TIME(t2);
+    setup_time = t2 - t1;
+    t1 = t2;
+
+    for (t = 0; t < num_threads; t++)
+        pthread_create(&thread_handles[t], NULL, threadWork, (void*) t);
+    for (t = 0; t < num_threads; t++)
+        pthread_join(thread_handles[t], NULL);
+    for (l = 0; l < level_count; l++)
+        if (levels[l].base != l) deriveCounts(&levels[l], &levels[levels[l].base]);
+    GET_TIME(t2);
+    thread_time = t2 - t1;
+
+    for (l = 0; l < level_count; l++)
+    {
+        LEVEL* level = &levels[l];
+        long in_bins = 0;
+
+        for (i = 1; i <= level->bin_count; i++)
+            in_bins += level->counts[i];
+        printf("level %d: %d bins %.3f-%.3f, ", l, level->bin_count, level->min_meas, level->max_meas);
+        if (level->base == l) printf("counted (%s)", accum_names[level->accum.strategy]);
+        else printf("derived from level %d", level->base);
+        printf(", in bins = %ld, below = %ld, above = %ld\n",
+               in_bins, level->counts[0], level->counts[level->bin_count + 1]);
+#if PRINT_BINS == 1
+        for (i = 0; i < level->bin_count; i++)
+            printf("%.3f-%.3f:\t%ld\n", (i == 0) ? level->min_meas : level->bin_maxes[i-1],
+                   level->bin_maxes[i], level->counts[i+1]);
+#endif
+    }
+    printf("levels = %d, counted = %d, values = %ld\n", level_count, base_count, data_count);
+    printf("setup time = %f\n", setup_time);
+    printf("thread time = %f (%.1f M values/s)\n", thread_time, data_count / thread_time * 1e-6);
+
+#if CHECK_LEVELS == 1
+    {
+        int* bins = malloc(BIN_BATCH*sizeof(int));
+        long* check;
+        int wrong = 0;
+
+        GET_TIME(t1);
+        for (l = 0; l < level_count; l++)
+        {
+            LEVEL* level = &levels[l];
+            check = calloc(level->bin_count + 2, sizeof(long));
+            for (i = 0; i < data_count; i += BIN_BATCH)
+            {
+                long j, k = (data_count - i < BIN_BATCH) ? data_count - i : BIN_BATCH;
+                binBatch(&level->map, &data[i], bins, k);
+                for (j = 0; j < k; j++)
+                    check[bins[j] + 1]++;
+            }
+            if (memcmp(check, level->counts, (level->bin_count + 2)*sizeof(long)) != 0)
+            {
+                printf("level %d does not match\n", l);
+                wrong++;
+            }
+            free(check);
+        }
+        GET_TIME(t2);
+        printf("check: %d of %d levels match, one pass per level on one thread = %f\n",
+               level_count - wrong, level_count, t2 - t1);
+        free(bins);
+    }
+#endif
+
+    barrierDestroy(&barrier);
+    for (l = 0; l < level_count; l++)
+    {
+        if (levels[l].base == l) accumFree(&levels[l].accum);
+        binMapFree(&levels[l].map);
+        free(levels[l].bin_maxes);
+        free(levels[l].edge_bin);
+        free(levels[l].counts);
+    }
+    free(levels);
+    free(bases);
+    free(order);
+    free(data);
+    free(thread_handles);
+    return 0;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  levelNests
+ * Purpose:   Check whether every edge of a level is an edge of a finer
+ *            one, and if so where
+ * In arg:    fine:    a base level
+ * In/out:    coarse:  edge_bin is set if it nests
+ * Return:    1 if coarse can be derived from fine, 0 if not
+ * Note:      The edges must be equal as floats, not just close, so a
+ *            derived level counts exactly what binning it would.
+ */
+int levelNests(LEVEL* coarse, const LEVEL* fine)
+{
+    const float* edges = coarse->map.edges;
+    int* edge_bin = malloc((coarse->bin_count + 1)*sizeof(int));
+    int k;
+
+    for (k = 0; k <= coarse->bin_count; k++)
+    {
+        /* the fine edge <= edges[k]; the last edge is found as "above" */
+        int j = binSearch(&fine->map, edges[k]);
+        if (j < 0 || fine->map.edges[j] != edges[k])
+        {
+            free(edge_bin);
+            return 0;
+        }
+        edge_bin[k] = j;
+    }
+    coarse->edge_bin = edge_bin;
+    return 1;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  deriveCounts
+ * Purpose:   Add up a nested level's counts from its base's
+ * In arg:    fine:    the base level, counted
+ * In/out:    coarse:  counts filled in
+ * Note:      Coarse bin k is fine bins edge_bin[k] .. edge_bin[k+1]-1,
+ *            which are columns edge_bin[k]+1 .. edge_bin[k+1]; the
+ *            columns before and after the coarse edges are below and
+ *            above it.
+ */
+void deriveCounts(LEVEL* coarse, const LEVEL* fine)
+{
+    const long* columns = fine->counts;
+    int column = 0, k;
+
+    for (k = 0; k <= coarse->bin_count; k++)
+    {
+        long sum = 0;
+        for (; column <= coarse->edge_bin[k]; column++)
+            sum += columns[column];
+        coarse->counts[k] = sum;
+    }
+    for (coarse->counts[k] = 0; column < fine->bin_count + 2; column++)
+        coarse->counts[k] += columns[column];
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  threadWork
+ * Purpose:   Bin one thread's share of the values for every base level,
+ *            a batch at a time, then merge
+ * In arg:    args:  the thread's rank
+ */
+void* threadWork(void* args)
+{
+    long rank = (long) args;
+    long first = data_count * rank / num_threads;
+    long last = data_count * (rank + 1) / num_threads;
+    int bins[BIN_BATCH];
+    long i, j, n;
+    int b;
+
+    for (i = first; i < last; i += BIN_BATCH)
+    {
+        n = (last - i < BIN_BATCH) ? last - i : BIN_BATCH;
+        /* the batch is read from memory by the first level, from L1 after */
+        for (b = 0; b < base_count; b++)
+        {
+            LEVEL* level = &levels[bases[b]];
+            binBatch(&level->map, &data[i], bins, n);
+            for (j = 0; j < n; j++)
+                bins[j]++;
+            accumAddBatch(&level->accum, rank, bins, n);
+        }
+    }
+    for (b = 0; b < base_count; b++)
+        accumFinish(&levels[bases[b]].accum, rank);
+
+    for (b = 0; b < base_count; b++)
+    {
+        LEVEL* level = &levels[bases[b]];
+        parReduceArrays(&barrier, rank, num_threads, level->accum.counts, level->accum.rows,
+                        level->accum.stride, level->counts, level->bin_count + 2);
+    }
+    return NULL;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  generateWork
+ * Purpose:   Fill one thread's share of the data with normal values over
+ *            the widest range of the levels
+ * In arg:    args:  the thread's rank
+ */
+void* generateWork(void* args)
+{
+    long rank = (long) args;
+    long first = data_count * rank / num_threads;
+    long last = data_count * (rank + 1) / num_threads;
+
+    cbrngFill(DATA_SEED, CBRNG_NORMAL, data_min, data_max, &data[first], first, last - first);
+    return NULL;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  createBins
+ * Purpose:   Compute max value for each bin, as histogram.c does
+ * In args:   min_meas:   the minimum possible measurement
+ *            max_meas:   the maximum possible measurement
+ *            bin_count:  the number of bins
+ * Out arg:   bin_maxes:  the maximum possible value for each bin
+ */
+void createBins(
+    float min_meas      /* in  */,
+    float max_meas      /* in  */,
+    float bin_maxes[]   /* out */,
+    int   bin_count     /* in  */)
+{
+    float bin_width = (max_meas - min_meas)/bin_count;
+    int i;
+
+    for (i = 0; i < bin_count; i++)
+        bin_maxes[i] = min_meas + (i+1)*bin_width;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  usage
+ * Purpose:   Print a message showing how to run program and quit
+ * In arg:    prog_name:  the name of the program from the command line
+ */
+void usage(char prog_name[] /* in */)
+{
+    fprintf(stderr, "usage: %s ", prog_name);
+    fprintf(stderr, "<data_count> <num_threads> <level> [level ...]\n");
+    fprintf(stderr, "   <level> = bin_count:min_meas:max_meas, e.g. 256:0:100\n");
+    exit(0);
+}  /* Usage */
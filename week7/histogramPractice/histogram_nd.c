@@ -0,0 +1,384 @@
+/* COMP 137 Spring 2019
+ * filename: histogram_nd.c
+ *
+ * Purpose:   Build a 2D or 3D histogram of joint measurements, such as
+ *            the x/y/z components of the vectors of the rotate programs.
+ *
+ *            Each axis has its own uniform bins and its own BIN_MAP, so
+ *            the bins of a batch are found one axis at a time with the
+ *            SIMD kernel of histogram_bins.h.  The cells are stored in
+ *            square (cubic) tiles of TILE_2D x TILE_2D (TILE_3D^3) cells,
+ *            one or a few cache lines each, so points that are close in
+ *            space land on the same lines whichever axis they move along.
+ *
+ *            How the threads add up counts is picked by accumChoose from
+ *            the total number of cells: private rows while they fit in
+ *            cache, rows counted a slice at a time (ACCUM_RADIX) once they
+ *            do not.  The rows are merged with parReduceArrays.
+ *
+ *            The data comes from a file in the rotate programs' input
+ *            format (angles, count, then "x, y, z" lines), or is
+ *            generated: independent normal values on every axis.
+ *
+ * Program arguments: ./histogram_nd <bins> <min_meas> <max_meas> <data_count> <num_threads> [fn]
+ *   <bins>        = cells per axis, 2D as 1000x1000 or 3D as 64x64x64
+ *   <min_meas>    = lower edge of the first bin, on every axis
+ *   <max_meas>    = upper edge of the last bin, on every axis
+ *   <data_count>  = number of points generated (ignored with [fn])
+ *   <num_threads> = number of threads
+ *   [fn]          = file of vectors to bin instead of generated data
+ *
+ * How to compile: gcc -O3 -march=native -o histogram_nd histogram_nd.c -lm -lpthread
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "timer.h"
+#include "histogram_bins.h"
+#include "histogram_accum.h"
+#include "par_reduce.h"
+#include "cbrng.h"
+
+/* PRINT_CELLS = 1 -> print every non-empty cell
+ * PRINT_CELLS != 1 -> only print the summary
+ */
+#define PRINT_CELLS 0
+
+/* cells per tile side, powers of 2: 8x8 ints and 4x4x4 ints are 256 bytes */
+#define TILE_2D 8
+#define TILE_3D 4
+
+/* seed of the random data, one stream per axis */
+#define DATA_SEED 0
+
+void usage(char prog_name[]);
+long readVectors(char* filename, float* axis[3]);
+void* generateWork(void* args);
+void* threadWork(void* args);
+void tileIndices(int* bins[3], int* cells, long count);
+long cellOf(int x, int y, int z);
+
+/* shared by all threads */
+int dims;                       /* 2 or 3 */
+int bins_per_axis[3];
+int tile;                       /* TILE_2D or TILE_3D */
+int tiles_per_axis[3];
+long cell_count;                /* cells in the tiled layout */
+float* axis_data[3];            /* the points, one array per axis */
+long data_count;
+float min_meas, max_meas;
+BIN_MAP axis_map[3];
+HIST_ACCUM accum;
+BARRIER barrier;
+long* cell_counts;
+int num_threads;
+long* values_outside;           /* per thread, padded to a cache line */
+
+int main(int argc, char* argv[])
+{
+    float* bin_maxes;
+    pthread_t* thread_handles;
+    int* sample;
+    float* sample_axis[3];
+    int* sample_bins[3];
+    long t, i, n, outside = 0, counted = 0, top = 0;
+    int d, x, y, z, top_x = 0, top_y = 0, top_z = 0;
+    double t1, t2, setup_time, thread_time;
+
+    GET_TIME(t1);
+    if (argc != 6 && argc != 7) usage(argv[0]);
+    dims = sscanf(argv[1], "%dx%dx%d", &bins_per_axis[0], &bins_per_axis[1], &bins_per_axis[2]);
+    min_meas = strtof(argv[2], NULL);
+    max_meas = strtof(argv[3], NULL);
+    data_count = strtol(argv[4], NULL, 10);
+    num_threads = strtol(argv[5], NULL, 10);
+    if (dims < 2 || num_threads < 1 || !(min_meas < max_meas)) usage(argv[0]);
+    for (d = 0; d < dims; d++)
+        if (bins_per_axis[d] < 1) usage(argv[0]);
+    if (dims == 2) bins_per_axis[2] = 1;
+
+    /* tiled layout, axes padded to whole tiles */
+    tile = (dims == 2) ? TILE_2D : TILE_3D;
+    cell_count = 1;
+    for (d = 0; d < 3; d++)
+    {
+        tiles_per_axis[d] = (d < dims) ? (bins_per_axis[d] + tile - 1) / tile : 1;
+        cell_count *= (d < dims) ? (long)tiles_per_axis[d] * tile : 1;
+    }
+
+    if (argc == 7)
+    {
+        data_count = readVectors(argv[6], axis_data);
+        if (data_count < 0)
+        {
+            fprintf(stderr, "could not read input file %s\n", argv[6]);
+            exit(0);
+        }
+    }
+    else
+    {
+        thread_handles = malloc(num_threads*sizeof(pthread_t));
+        for (d = 0; d < 3; d++)
+            axis_data[d] = malloc((data_count > 0 ? data_count : 1)*sizeof(float));
+        for (t = 0; t < num_threads; t++)
+            pthread_create(&thread_handles[t], NULL, generateWork, (void*) t);
+        for (t = 0; t < num_threads; t++)
+            pthread_join(thread_handles[t], NULL);
+        free(thread_handles);
+    }
+
+    for (d = 0; d < dims; d++)
+    {
+        bin_maxes = malloc(bins_per_axis[d]*sizeof(float));
+        for (i = 0; i < bins_per_axis[d]; i++)
+            bin_maxes[i] = min_meas + (i+1)*((max_meas - min_meas)/bins_per_axis[d]);
+        binMapInit(&axis_map[d], bin_maxes, bins_per_axis[d], min_meas);
+        free(bin_maxes);
+    }
+
+    /* pick the accumulation strategy from a sample of the cells */
+    n = (data_count < ACCUM_SAMPLE) ? data_count : ACCUM_SAMPLE;
+    sample = malloc((n > 0 ? n : 1)*sizeof(int));
+    for (d = 0; d < 3; d++)
+    {
+        sample_axis[d] = malloc((n > 0 ? n : 1)*sizeof(float));
+        sample_bins[d] = calloc(n > 0 ? n : 1, sizeof(int));
+        for (i = 0; i < n && d < dims; i++)
+            sample_axis[d][i] = axis_data[d][i * data_count / n];
+        if (d < dims) binBatch(&axis_map[d], sample_axis[d], sample_bins[d], n);
+    }
+    tileIndices(sample_bins, sample, n);
+    for (i = 0, t = 0; i < n; i++)
+        if (sample[i] >= 0) sample[t++] = sample[i];
+    cell_counts = calloc(cell_count, sizeof(long));
+    accumInit(&accum, accumChoose(cell_count, num_threads, sample, t), cell_count, num_threads,
+              cell_counts);
+    for (d = 0; d < 3; d++)
+    {
+        free(sample_axis[d]);
+        free(sample_bins[d]);
+    }
+    free(sample);
+
+    values_outside = calloc(num_threads * 8, sizeof(long));
+    barrierInit(&barrier, num_threads);
+    GET_TIME(t2);
+    setup_time = t2 - t1;
+    t1 = t2;
+
+    thread_handles = malloc(num_threads*sizeof(pthread_t));
+    for (t = 0; t < num_threads; t++)
+        pthread_create(&thread_handles[t], NULL, threadWork, (void*) t);
+    for (t = 0; t < num_threads; t++)
+        pthread_join(thread_handles[t], NULL);
+    GET_TIME(t2);
+    thread_time = t2 - t1;
+
+    /* summary: busiest cell and total */
+    for (t = 0; t < num_threads; t++)
+        outside += values_outside[8*t];
+    for (z = 0; z < bins_per_axis[2]; z++)
+        for (y = 0; y < bins_per_axis[1]; y++)
+            for (x = 0; x < bins_per_axis[0]; x++)
+            {
+                long c = cellOf(x, y, z);
+                counted += cell_counts[c];
+                if (cell_counts[c] > cell_counts[top])
+                {
+                    top = c;
+                    top_x = x; top_y = y; top_z = z;
+                }
+#if PRINT_CELLS == 1
+                if (cell_counts[c] > 0)
+                {
+                    if (dims == 2) printf("%d %d:\t%ld\n", x, y, cell_counts[c]);
+                    else printf("%d %d %d:\t%ld\n", x, y, z, cell_counts[c]);
+                }
+#endif
+            }
+    if (dims == 2) printf("busiest cell = (%d, %d) with %ld\n", top_x, top_y, cell_counts[top]);
+    else printf("busiest cell = (%d, %d, %d) with %ld\n", top_x, top_y, top_z, cell_counts[top]);
+
+    printf("points = %ld, in cells = %ld, outside = %ld\n", data_count, counted, outside);
+    printf("cells = %ld, accumulation = %s\n", cell_count, accum_names[accum.strategy]);
+    printf("setup time = %f\n", setup_time);
+    printf("thread time = %f (%.1f M points/s)\n", thread_time,
+           data_count / thread_time * 1e-6);
+
+    barrierDestroy(&barrier);
+    accumFree(&accum);
+    for (d = 0; d < dims; d++)
+        binMapFree(&axis_map[d]);
+    for (d = 0; d < 3; d++)
+        free(axis_data[d]);
+    free(cell_counts);
+    free(values_outside);
+    free(thread_handles);
+    return 0;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  cellOf
+ * Purpose:   Position of cell (x, y, z) in the tiled layout
+ * Note:      Tiles are stored x fastest, then y, then z, and so are the
+ *            cells inside a tile.
+ */
+long cellOf(int x, int y, int z)
+{
+    long tile_index = ((long)(z / tile) * tiles_per_axis[1] + y / tile) * tiles_per_axis[0] + x / tile;
+    long in_tile = ((long)(dims == 3 ? z % tile : 0) * tile + y % tile) * tile + x % tile;
+    return tile_index * (dims == 3 ? tile*tile*tile : tile*tile) + in_tile;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  tileIndices
+ * Purpose:   Turn the bins of count points on each axis into cells,
+ *            -1 for points outside the bins on any axis
+ * In args:   bins:   bins[d][i] is the bin of point i on axis d
+ *            count:  number of points
+ * Out arg:   cells
+ * Note:      Only shifts and masks, so the loop vectorizes.
+ */
+void tileIndices(int* bins[3], int* cells, long count)
+{
+    const int shift = (dims == 2) ? 3 : 2;          /* log2 of tile */
+    const int mask = tile - 1;
+    const int tx = tiles_per_axis[0], ty = tiles_per_axis[1];
+    const int nx = bins_per_axis[0], ny = bins_per_axis[1], nz = bins_per_axis[2];
+    const int* bx = bins[0];
+    const int* by = bins[1];
+    const int* bz = bins[2];
+    long i;
+
+    if (dims == 2)
+        for (i = 0; i < count; i++)
+        {
+            int x = bx[i], y = by[i];
+            int outside = (unsigned)x >= (unsigned)nx || (unsigned)y >= (unsigned)ny;
+            int c = ((((y >> shift) * tx + (x >> shift)) << (2*shift))
+                     | ((y & mask) << shift) | (x & mask));
+            cells[i] = outside ? -1 : c;
+        }
+    else
+        for (i = 0; i < count; i++)
+        {
+            int x = bx[i], y = by[i], z = bz[i];
+            int outside = (unsigned)x >= (unsigned)nx || (unsigned)y >= (unsigned)ny
+                          || (unsigned)z >= (unsigned)nz;
+            int c = (((((z >> shift) * ty + (y >> shift)) * tx + (x >> shift)) << (3*shift))
+                     | ((z & mask) << (2*shift)) | ((y & mask) << shift) | (x & mask));
+            cells[i] = outside ? -1 : c;
+        }
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  threadWork
+ * Purpose:   Bin one thread's share of the points, then merge
+ * In arg:    args:  the thread's rank
+ */
+void* threadWork(void* args)
+{
+    long rank = (long) args;
+    long first = data_count * rank / num_threads;
+    long last = data_count * (rank + 1) / num_threads;
+    int bin_x[BIN_BATCH], bin_y[BIN_BATCH], bin_z[BIN_BATCH];
+    int* bins[3] = { bin_x, bin_y, bin_z };
+    int cells[BIN_BATCH];
+    long i, j, n, in;
+    int d;
+
+    memset(bin_z, 0, sizeof(bin_z));
+    for (i = first; i < last; i += BIN_BATCH)
+    {
+        n = (last - i < BIN_BATCH) ? last - i : BIN_BATCH;
+        for (d = 0; d < dims; d++)
+            binBatch(&axis_map[d], &axis_data[d][i], bins[d], n);
+        tileIndices(bins, cells, n);
+        for (j = 0, in = 0; j < n; j++)
+        {
+            cells[in] = cells[j];
+            in += (cells[j] >= 0);
+        }
+        accumAddBatch(&accum, rank, cells, in);
+        values_outside[8*rank] += n - in;
+    }
+    accumFinish(&accum, rank);
+
+    parReduceArrays(&barrier, rank, num_threads, accum.counts, accum.rows, accum.stride,
+                    cell_counts, cell_count);
+    return NULL;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  generateWork
+ * Purpose:   Fill one thread's share of every axis with normal values
+ *            centred in the bins
+ * In arg:    args:  the thread's rank
+ */
+void* generateWork(void* args)
+{
+    long rank = (long) args;
+    long first = data_count * rank / num_threads;
+    long last = data_count * (rank + 1) / num_threads;
+    int d;
+
+    for (d = 0; d < dims; d++)
+        cbrngFill(DATA_SEED + d, CBRNG_NORMAL, min_meas, max_meas,
+                  &axis_data[d][first], first, last - first);
+    return NULL;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  readVectors
+ * Purpose:   Read a vector file of the rotate programs into one array
+ *            per axis
+ * In arg:    filename
+ * Out arg:   axis:  axis[d] allocated and filled with component d
+ * Return:    number of vectors, -1 if the file cannot be read
+ */
+long readVectors(char* filename, float* axis[3])
+{
+    float angles[3];
+    long n, i;
+    int d;
+    FILE* fp = fopen(filename, "r");
+
+    if (fp == NULL) return -1;
+    if (fscanf(fp, "%f, %f, %f", &angles[0], &angles[1], &angles[2]) != 3
+        || fscanf(fp, "%ld", &n) != 1 || n < 0)
+    {
+        fclose(fp);
+        return -1;
+    }
+    for (d = 0; d < 3; d++)
+        axis[d] = malloc((n > 0 ? n : 1)*sizeof(float));
+    for (i = 0; i < n; i++)
+        if (fscanf(fp, "%f, %f, %f", &axis[0][i], &axis[1][i], &axis[2][i]) != 3)
+        {
+            fclose(fp);
+            return -1;
+        }
+    fclose(fp);
+    return n;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  usage
+ * Purpose:   Print a message showing how to run program and quit
+ * In arg:    prog_name:  the name of the program from the command line
+ */
+void usage(char prog_name[] /* in */)
+{
+    fprintf(stderr, "usage: %s ", prog_name);
+    fprintf(stderr, "<bins> <min_meas> <max_meas> <data_count> <num_threads> [fn]\n");
+    fprintf(stderr, "   <bins> = cells per axis, as 1000x1000 or 64x64x64\n");
+    exit(0);
+}  /* Usage */
@@ -0,0 +1,385 @@
+/* COMP 137 Spring 2019
+ * filename: histogram_omp.c
+ *
+ * Purpose:   Build a histogram from a list of random numbers, with OpenMP
+ *            in place of the threads, barrier and merge written out by
+ *            hand in histogram_pthreads.c.  Three ways of adding up the
+ *            counts:
+ *
+ *            reduction  parallel for with reduction(+: bin_counts[:bin_count]):
+ *                       OpenMP gives each thread a private copy of the
+ *                       counts and adds the copies up at the end.  The
+ *                       copies are on the threads' stacks (gcc), so
+ *                       this is only run up to REDUCTION_MAX_BINS bins
+ *            private    each thread counts into its own 32-bit row
+ *                       (ACCUM_PRIVATE of histogram_accum.h), then the
+ *                       rows are added bin by bin in an omp for, so the
+ *                       merge is split over the threads too
+ *            atomic     one shared array, every count an omp atomic
+ *
+ *            The data is the same as in histogram.c and
+ *            histogram_pthreads.c (cbrng.h), made in parallel.  Only the
+ *            counting is timed, as the thread time of histogram_pthreads.
+ *
+ * Program arguments: ./histogram_omp <bin_count> <min_meas> <max_meas> <data_count> <num_threads> [variant] [distribution]
+ *   <bin_count>  = number of bins in the histogram
+ *   <min_meas>   = smallest possible value in list of random numbers
+ *   <max_meas>   = largest possible value in list of random numbers
+ *   <data_count> = number of values in list of random numbers
+ *   <num_threads> = number of threads
+ *   [variant]    = reduction (the default), private or atomic
+ *   [distribution] = uniform (the default), normal or pareto, see cbrng.h
+ *
+ * How to compile: gcc -O3 -march=native -fopenmp -o histogram_omp histogram_omp.c -lm
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+#include "histogram_bins.h"
+#include "histogram_accum.h"
+#include "cbrng.h"
+
+/* GRAPHICAL_OUTPUT = 1 -> Show histogram with X's for number of
+ *                         measurements in each bin
+ * GRAPHICAL_OUTPUT != 1 -> Show histogram with text values for number of
+ *                          measurements in each bin
+ */
+#define GRAPHICAL_OUTPUT 0
+
+/* seed of the random data, the same as in histogram.c */
+#define DATA_SEED 0
+
+/* most bins for the reduction variant: 1MB of counts per thread stack */
+#define REDUCTION_MAX_BINS (1 << 17)
+
+typedef enum {
+    OMP_REDUCTION,
+    OMP_PRIVATE,
+    OMP_ATOMIC
+} OMP_VARIANT;
+
+static const char* variant_names[] = { "reduction", "private", "atomic" };
+
+void usage(char prog_name[]);
+
+void createBins(
+    float min_meas      /* in  */,
+    float max_meas      /* in  */,
+    float bin_maxes[]   /* out */,
+    long  bin_counts[]  /* out */,
+    int   bin_count     /* in  */);
+
+int findBin(
+    float    data         /* in */,
+    float    bin_maxes[]  /* in */,
+    int      bin_count    /* in */,
+    float    min_meas     /* in */);
+
+void printHistogram(
+    float    bin_maxes[]   /* in */,
+    long     bin_counts[]  /* in */,
+    int      bin_count     /* in */,
+    float    min_meas      /* in */);
+
+void countReduction(float data[], long data_count, BIN_MAP* bin_map, float bin_maxes[],
+                    long bin_counts[], int bin_count, float min_meas, int num_threads);
+void countPrivate(float data[], long data_count, BIN_MAP* bin_map, float bin_maxes[],
+                  long bin_counts[], int bin_count, float min_meas, int num_threads);
+void countAtomic(float data[], long data_count, BIN_MAP* bin_map, float bin_maxes[],
+                 long bin_counts[], int bin_count, float min_meas, int num_threads);
+
+int main(int argc, char* argv[])
+{
+    int bin_count, num_threads, variant = OMP_REDUCTION, distribution = CBRNG_UNIFORM;
+    float min_meas, max_meas;
+    float* bin_maxes;
+    long* bin_counts;
+    long data_count, bin, bin_sum = 0;
+    float* data;
+    BIN_MAP bin_map;
+    double t1, t2;
+
+    if (argc < 6 || argc > 8) usage(argv[0]);
+    bin_count = strtol(argv[1], NULL, 10);
+    min_meas = strtof(argv[2], NULL);
+    max_meas = strtof(argv[3], NULL);
+    data_count = strtol(argv[4], NULL, 10);
+    num_threads = strtol(argv[5], NULL, 10);
+    if (argc >= 7)
+    {
+        for (variant = 0; variant < 3; variant++)
+            if (strcmp(argv[6], variant_names[variant]) == 0) break;
+        if (variant == 3) usage(argv[0]);
+    }
+    if (argc == 8 && (distribution = cbrngDistributionFromName(argv[7])) < 0) usage(argv[0]);
+    if (bin_count < 1 || data_count < 0 || num_threads < 1) usage(argv[0]);
+    if (variant == OMP_REDUCTION && bin_count > REDUCTION_MAX_BINS)
+    {
+        fprintf(stderr, "the reduction variant takes at most %d bins\n", REDUCTION_MAX_BINS);
+        exit(0);
+    }
+
+    bin_maxes = malloc(bin_count*sizeof(float));
+    bin_counts = malloc(bin_count*sizeof(long));
+    data = malloc((data_count > 0 ? data_count : 1)*sizeof(float));
+
+    /* Generate the data, each thread its own part */
+#   pragma omp parallel num_threads(num_threads)
+    {
+        long rank = omp_get_thread_num(), threads = omp_get_num_threads();
+        long first = data_count * rank / threads;
+        long last = data_count * (rank + 1) / threads;
+        cbrngFill(DATA_SEED, distribution, min_meas, max_meas, &data[first], first, last - first);
+    }
+
+    createBins(min_meas, max_meas, bin_maxes, bin_counts, bin_count);
+    binMapInit(&bin_map, bin_maxes, bin_count, min_meas);
+
+    t1 = omp_get_wtime();
+    if (variant == OMP_REDUCTION)
+        countReduction(data, data_count, &bin_map, bin_maxes, bin_counts, bin_count, min_meas, num_threads);
+    else if (variant == OMP_PRIVATE)
+        countPrivate(data, data_count, &bin_map, bin_maxes, bin_counts, bin_count, min_meas, num_threads);
+    else
+        countAtomic(data, data_count, &bin_map, bin_maxes, bin_counts, bin_count, min_meas, num_threads);
+    t2 = omp_get_wtime();
+
+    printHistogram(bin_maxes, bin_counts, bin_count, min_meas);
+    for (bin = 0; bin < bin_count; bin++)
+        bin_sum += bin_counts[bin];
+    printf("bin sum = %ld\n", bin_sum);
+    printf("variant = %s\n", variant_names[variant]);
+    printf("thread time = %f\n", t2 - t1);
+
+    binMapFree(&bin_map);
+    free(data);
+    free(bin_maxes);
+    free(bin_counts);
+    return 0;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  countReduction
+ * Purpose:   Count the values with an array reduction
+ * In args:   data, data_count, bin_map, bin_maxes, bin_count, min_meas,
+ *            num_threads
+ * In/out:    bin_counts:  zeroed on entry
+ * Note:      Batches of BIN_BATCH values are shared out by the omp for;
+ *            values outside the bins go to findBin, which quits.
+ */
+void countReduction(float data[], long data_count, BIN_MAP* bin_map, float bin_maxes[],
+                    long bin_counts[], int bin_count, float min_meas, int num_threads)
+{
+    long i;
+
+#   pragma omp parallel for num_threads(num_threads) reduction(+: bin_counts[:bin_count])
+    for (i = 0; i < data_count; i += BIN_BATCH)
+    {
+        int bins[BIN_BATCH];
+        long j, n = (data_count - i < BIN_BATCH) ? data_count - i : BIN_BATCH;
+
+        binBatch(bin_map, &data[i], bins, n);
+        for (j = 0; j < n; j++)
+        {
+            if (bins[j] < 0 || bins[j] >= bin_count)
+                findBin(data[i+j], bin_maxes, bin_count, min_meas);
+            bin_counts[bins[j]]++;
+        }
+    }
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  countPrivate
+ * Purpose:   Count the values in a private row per thread, then add the
+ *            rows up with the bins split over the threads
+ * In args:   as countReduction
+ * In/out:    bin_counts:  zeroed on entry
+ */
+void countPrivate(float data[], long data_count, BIN_MAP* bin_map, float bin_maxes[],
+                  long bin_counts[], int bin_count, float min_meas, int num_threads)
+{
+    HIST_ACCUM accum;
+
+    accumInit(&accum, ACCUM_PRIVATE, bin_count, num_threads, bin_counts);
+
+#   pragma omp parallel num_threads(num_threads)
+    {
+        long rank = omp_get_thread_num();
+        int bins[BIN_BATCH];
+        long i, j, n, bin;
+        int r;
+
+#       pragma omp for
+        for (i = 0; i < data_count; i += BIN_BATCH)
+        {
+            n = (data_count - i < BIN_BATCH) ? data_count - i : BIN_BATCH;
+            binBatch(bin_map, &data[i], bins, n);
+            for (j = 0; j < n; j++)
+                if (bins[j] < 0 || bins[j] >= bin_count)
+                    findBin(data[i+j], bin_maxes, bin_count, min_meas);
+            accumAddBatch(&accum, rank, bins, n);
+        }
+        /* the implied barrier: every row is complete */
+
+#       pragma omp for
+        for (bin = 0; bin < bin_count; bin++)
+            for (r = 0; r < accum.rows; r++)
+                bin_counts[bin] += accum.counts[r * accum.stride + bin];
+    }
+
+    accumFree(&accum);
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  countAtomic
+ * Purpose:   Count the values straight into bin_counts, atomically
+ * In args:   as countReduction
+ * In/out:    bin_counts:  zeroed on entry
+ */
+void countAtomic(float data[], long data_count, BIN_MAP* bin_map, float bin_maxes[],
+                 long bin_counts[], int bin_count, float min_meas, int num_threads)
+{
+    long i;
+
+#   pragma omp parallel for num_threads(num_threads)
+    for (i = 0; i < data_count; i += BIN_BATCH)
+    {
+        int bins[BIN_BATCH];
+        long j, n = (data_count - i < BIN_BATCH) ? data_count - i : BIN_BATCH;
+
+        binBatch(bin_map, &data[i], bins, n);
+        for (j = 0; j < n; j++)
+        {
+            if (bins[j] < 0 || bins[j] >= bin_count)
+                findBin(data[i+j], bin_maxes, bin_count, min_meas);
+#           pragma omp atomic
+            bin_counts[bins[j]]++;
+        }
+    }
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  usage
+ * Purpose:   Print a message showing how to run program and quit
+ * In arg:    prog_name:  the name of the program from the command line
+ */
+void usage(char prog_name[] /* in */)
+{
+    fprintf(stderr, "usage: %s ", prog_name);
+    fprintf(stderr, "<bin_count> <min_meas> <max_meas> <data_count> <num_threads> [variant] [distribution]\n");
+    fprintf(stderr, "   [variant] = reduction, private or atomic\n");
+    fprintf(stderr, "   [distribution] = uniform, normal or pareto\n");
+    exit(0);
+}  /* Usage */
+
+
+/*---------------------------------------------------------------------
+ * Function:  createBins
+ * Purpose:   Compute max value for each bin, and store 0 as the
+ *            number of values in each bin
+ * In args:   min_meas:   the minimum possible measurement
+ *            max_meas:   the maximum possible measurement
+ *            bin_count:  the number of bins
+ * Out args:  bin_maxes:  the maximum possible value for each bin
+ *            bin_counts: the number of data values in each bin
+ */
+void createBins(
+    float min_meas      /* in  */,
+    float max_meas      /* in  */,
+    float bin_maxes[]   /* out */,
+    long  bin_counts[]  /* out */,
+    int   bin_count     /* in  */)
+{
+    float bin_width;
+    int   i;
+
+    bin_width = (max_meas - min_meas)/bin_count;
+
+    for (i = 0; i < bin_count; i++)
+    {
+        bin_maxes[i] = min_meas + (i+1)*bin_width;
+        bin_counts[i] = 0;
+    }
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  findBin
+ * Purpose:   Use binary search to determine which bin a measurement
+ *            belongs to
+ * In args:   data:       the current measurement
+ *            bin_maxes:  list of max bin values
+ *            bin_count:  number of bins
+ *            min_meas:   the minimum possible measurement
+ * Return:    the number of the bin to which data belongs
+ * Note:      If the search fails, the function prints a message and exits
+ */
+int findBin(
+    float   data          /* in */,
+    float   bin_maxes[]   /* in */,
+    int     bin_count     /* in */,
+    float   min_meas      /* in */)
+{
+    int bottom = 0, top =  bin_count-1;
+    int mid;
+    float bin_max, bin_min;
+
+    while (bottom <= top)
+    {
+        mid = (bottom + top)/2;
+        bin_max = bin_maxes[mid];
+        bin_min = (mid == 0) ? min_meas: bin_maxes[mid-1];
+        if (data >= bin_max)
+            bottom = mid+1;
+        else if (data < bin_min)
+            top = mid-1;
+        else
+            return mid;
+    }
+
+    /* Whoops! (this should not happen)*/
+    fprintf(stderr, "Data = %f doesn't belong to a bin!\n", data);
+    fprintf(stderr, "Quitting\n");
+    exit(-1);
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  printHistogram
+ * Purpose:   Print a histogram. Format of histogram is
+ *            determined by value of GRAPHICAL_OUTPUT
+ * In args:   bin_maxes:   the max value for each bin
+ *            bin_counts:  the number of elements in each bin
+ *            bin_count:   the number of bins
+ *            min_meas:    the minimum possible measurement
+ */
+void printHistogram(
+    float  bin_maxes[]   /* in */,
+    long   bin_counts[]  /* in */,
+    int    bin_count     /* in */,
+    float  min_meas      /* in */)
+{
+    int i;
+    float bin_max, bin_min;
+
+    for (i = 0; i < bin_count; i++)
+    {
+        bin_max = bin_maxes[i];
+        bin_min = (i == 0) ? min_meas: bin_maxes[i-1];
+        printf("%.3f-%.3f:\t", bin_min, bin_max);
+#if GRAPHICAL_OUTPUT == 1
+        long j;
+        for (j = 0; j < bin_counts[i]; j++)
+            printf("X");
+#else
+        printf("%ld", bin_counts[i]);
+#endif
+        printf("\n");
+    }
+}
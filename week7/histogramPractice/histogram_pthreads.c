@@ -1,20 +1,38 @@
-2   /* COMP 137 Spring 2019
+/* COMP 137 Spring 2019
  * filename: parallel_histogram_condvar_barrier.c
  *
  * Purpose:   Build a histogram from a list of random numbers
  *
- * Program arguments: ./histogram <bin_count> <min_meas> <max_meas> <data_count>
+ *            Either end of the range may be "auto", as in histogram.c:
+ *            each thread finds the smallest and largest of the values it
+ *            generates (rangeBatch, a batch at a time while the batch is
+ *            in L1), and main takes the smallest and largest of those.
+ *            The values are always generated in DATA_MIN <= x < DATA_MAX,
+ *            and values outside a fixed range are counted in an underflow
+ *            and an overflow bin.
+ *
+ * Program arguments: ./histogram <bin_count> <min_meas> <max_meas> <data_count> <num_threads> [strategy] [distribution]
  *   <bin_count>  = number of bins in the histogram
- *   <min_meas>   = smallest possible value in list of random numbers
- *   <max_meas>   = largest possible value in list of random numbers
+ *   <min_meas>   = lower edge of the first bin, or auto
+ *   <max_meas>   = upper edge of the last bin, or auto
  *   <data_count> = number of values in list of random numbers
+ *   <num_threads> = number of threads
+ *   [strategy]   = how threads add up counts: private, atomic, sharded,
+ *                  lanes, radix (see histogram_accum.h) or auto (the default),
+ *                  which picks one from the bins of a sample of the data
+ *   [distribution] = uniform (the default), normal or pareto, see cbrng.h
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <pthread.h>
 #include <semaphore.h>
 #include "timer.h"
+#include "histogram_bins.h"
+#include "histogram_accum.h"
+#include "par_reduce.h"
+#include "cbrng.h"
 
 /* GRAPHICAL_OUTPUT = 1 -> Show histogram with X's for number of
  *                         measurements in each bin
@@ -28,6 +46,13 @@
  */
 #define VERBOSE 0
 
+/* seed of the random data, the same as in histogram.c */
+#define DATA_SEED 0
+
+/* range of the generated data, whatever the bins */
+#define DATA_MIN 0.0f
+#define DATA_MAX 100.0f
+
 void usage(char prog_name[]);
 
 void extractCommandLineArgs(
@@ -36,44 +61,50 @@ void extractCommandLineArgs(
     int*     bin_count_p   /* out */,
     float*   min_meas_p    /* out */,
     float*   max_meas_p    /* out */,
-    int*     data_count_p  /* out */,
-    int*     num_threads_p /* out */);
+    long*    data_count_p  /* out */,
+    int*     num_threads_p /* out */,
+    char**   strategy_p    /* out */,
+    int*     distribution_p /* out */);
 
 void generateData(
     float   min_meas    /* in  */,
     float   max_meas    /* in  */,
     float   data[]      /* out */,
-    int     data_count  /* in  */);
+    long    data_count  /* in  */,
+    int     distribution /* in  */,
+    float*  data_min_p  /* out */,
+    float*  data_max_p  /* out */);
+
+void* generateWork(void* args);
 
 void createBins(
     float min_meas      /* in  */,
     float max_meas      /* in  */,
     float bin_maxes[]   /* out */,
-    int   bin_counts[]  /* out */,
+    long  bin_counts[]  /* out */,
     int   bin_count     /* in  */);
 
-int findBin(
-    float    data         /* in */,
-    float    bin_maxes[]  /* in */,
-    int      bin_count    /* in */,
-    float    min_meas     /* in */);
-
 void printHistogram(
     float    bin_maxes[]   /* in */,
-    int      bin_counts[]  /* in */,
+    long     bin_counts[]  /* in */,
     int      bin_count     /* in */,
     float    min_meas      /* in */);
 
 void* threadWork(void* args);
 
-int** local_bin_counts;
-int* bin_counts;
+int chooseStrategy(
+    float*   data          /* in */,
+    long     data_count    /* in */,
+    BIN_MAP* bin_map       /* in */,
+    int      bin_count     /* in */);
+
+HIST_ACCUM accum;       /* the counts of all threads */
+long* bin_counts;
 int num_threads;
+long* outside_counts;   /* per thread: underflow, overflow, padded to a cache line */
 
 /* barrier control */
-int barrier_thread_count = 0;
-pthread_mutex_t barrier_mutex;
-pthread_cond_t ok_to_proceed;
+BARRIER barrier;
 
 typedef struct {
     long    rank;        /* the thread's unique rand/id */
@@ -83,19 +114,36 @@ typedef struct {
     float*  bin_maxes;   /* maximum value for each bin */
     int     bin_count;   /* number of bins */
     float   min_meas;    /* smallest possible value (lowest value for first bin) */
+    BIN_MAP* bin_map;    /* how to find the bins of a batch of values */
 } THREAD_ARG;
 
+typedef struct {
+    long    rank;         /* the thread's unique id */
+    float*  data;         /* full array of data */
+    long    data_count;   /* number of values in data array */
+    float   min_meas;     /* smallest possible value */
+    float   max_meas;     /* values are below max_meas */
+    int     distribution; /* CBRNG_UNIFORM, CBRNG_NORMAL or CBRNG_PARETO */
+    float   data_min;     /* out: smallest value of the thread's part */
+    float   data_max;     /* out: largest value of the thread's part */
+} GENERATE_ARG;
+
 int main(int argc, char* argv[])
 {
-    int bin_count, bin_sum;
-    float min_meas, max_meas;
+    int bin_count;
+    long bin_sum, below = 0, above = 0;
+    float min_meas, max_meas, data_min, data_max;
     float* bin_maxes;
+    int auto_min, auto_max;
 
-    int data_count;
+    long data_count;
     float* data;
     long t, bin;
     pthread_t* thread_handles;
     THREAD_ARG* thread_arguments;
+    BIN_MAP bin_map;
+    char* strategy_name;
+    int strategy, distribution;
 
     double setup_time, thread_time, print_time;
     double t1, t2;
@@ -103,32 +151,59 @@ int main(int argc, char* argv[])
     GET_TIME(t1);
 
     /* Check and get command line args */
-    extractCommandLineArgs(argc, argv, &bin_count, &min_meas, &max_meas, &data_count, &num_threads);
+    extractCommandLineArgs(argc, argv, &bin_count, &min_meas, &max_meas, &data_count, &num_threads, &strategy_name, &distribution);
+    if (!cbrngCheck())
+    {
+        fprintf(stderr, "cbrng.h does not give the Philox known answer\n");
+        exit(-1);
+    }
 
     /* Allocate arrays needed */
     bin_maxes = malloc(bin_count*sizeof(float));
-    bin_counts = malloc(bin_count*sizeof(int));
+    bin_counts = malloc(bin_count*sizeof(long));
     data = malloc(data_count*sizeof(float));
 
-    local_bin_counts = calloc(num_threads,sizeof(int*));
-    for (t=0; t<num_threads; t++)
-        local_bin_counts[t] = calloc(bin_count,sizeof(int));
-
-    /* Generate the data */
-    generateData(min_meas, max_meas, data, data_count);
+    /* Generate the data, and find its range */
+    auto_min = isnan(min_meas);
+    auto_max = isnan(max_meas);
+    generateData(DATA_MIN, DATA_MAX, data, data_count, distribution, &data_min, &data_max);
+    if (data_min > data_max)
+    {
+        /* no values */
+        data_min = DATA_MIN;
+        data_max = DATA_MAX;
+    }
+    /* the largest value must be below the last edge */
+    if (auto_min) min_meas = data_min;
+    if (auto_max) max_meas = nextafterf(data_max, INFINITY);
+    if (!(min_meas < max_meas))
+    {
+        fprintf(stderr, "min_meas = %f is not below max_meas = %f\n", min_meas, max_meas);
+        exit(-1);
+    }
 
     /* START PARALLELIZATION */
 
     /* Create bins for storing counts */
     createBins(min_meas, max_meas, bin_maxes, bin_counts, bin_count);
+    /* rounding can leave the last edge short of max_meas */
+    if (auto_max) bin_maxes[bin_count-1] = max_meas;
+    binMapInit(&bin_map, bin_maxes, bin_count, min_meas);
+    outside_counts = calloc(num_threads * 8, sizeof(long));
+
+    /* Decide how threads add up their counts */
+    strategy = accumStrategyFromName(strategy_name);
+    if (strcmp(strategy_name, "auto") == 0)
+        strategy = chooseStrategy(data, data_count, &bin_map, bin_count);
+    else if (strategy < 0)
+        usage(argv[0]);
+    accumInit(&accum, strategy, bin_count, num_threads, bin_counts);
 
     GET_TIME(t2);
     setup_time = t2-t1;
     t1 = t2;
 
-    barrier_thread_count = 0;
-    pthread_mutex_init(&barrier_mutex, NULL);
-    pthread_cond_init(&ok_to_proceed, NULL);
+    barrierInit(&barrier, num_threads);
 
     /* allocate thread handles */
     thread_handles = (pthread_t*)malloc(num_threads*sizeof(pthread_t));
@@ -145,6 +220,7 @@ int main(int argc, char* argv[])
         thread_arguments[t].bin_maxes = bin_maxes;
         thread_arguments[t].bin_count = bin_count;
         thread_arguments[t].min_meas = min_meas;
+        thread_arguments[t].bin_map = &bin_map;
 
         pthread_create(&thread_handles[t],
                        NULL,
@@ -153,15 +229,6 @@ int main(int argc, char* argv[])
                        );
     }
 
-    /* Count number of values in each bin */
-    /*
-    for (i = 0; i < data_count; i++)
-    {
-        bin = findBin(data[i], bin_maxes, bin_count, min_meas);
-        bin_counts[bin]++;
-    }
-    */
-
     /* wait for all threads to finish */
     for (t = 0; t < num_threads; t++)
         pthread_join(thread_handles[t], NULL);
@@ -173,6 +240,13 @@ int main(int argc, char* argv[])
 
     /* Print the histogram */
     printHistogram(bin_maxes, bin_counts, bin_count, min_meas);
+    for (t = 0; t < num_threads; t++)
+    {
+        below += outside_counts[8*t];
+        above += outside_counts[8*t + 1];
+    }
+    printf("underflow (< %.3f):\t%ld\n", min_meas, below);
+    printf("overflow (>= %.3f):\t%ld\n", max_meas, above);
 
     GET_TIME(t2);
     print_time = t2-t1;
@@ -182,18 +256,21 @@ int main(int argc, char* argv[])
     bin_sum = 0;
     for (bin=0; bin<bin_count; bin++)
         bin_sum += bin_counts[bin];
-    printf("bin sum = %d\n", bin_sum);
+    printf("bin sum = %ld\n", bin_sum);
+    printf("accumulation = %s\n", accum_names[accum.strategy]);
 
     printf("setup time = %f\n", setup_time);
     printf("thread time = %f\n", thread_time);
     printf("print time = %f\n", print_time);
 
-    pthread_cond_destroy(&ok_to_proceed);
-    pthread_mutex_destroy(&barrier_mutex);
+    barrierDestroy(&barrier);
 
+    accumFree(&accum);
+    binMapFree(&bin_map);
     free(data);
     free(bin_maxes);
     free(bin_counts);
+    free(outside_counts);
     return 0;
 }
 
@@ -207,62 +284,80 @@ int main(int argc, char* argv[])
     long    num_threads = ((THREAD_ARG*)args)->num_threads;
     float*  data = ((THREAD_ARG*)args)->data;
     long    data_count = ((THREAD_ARG*)args)->data_count;
-    float*  bin_maxes = ((THREAD_ARG*)args)->bin_maxes;
     int     bin_count = ((THREAD_ARG*)args)->bin_count;
-    float   min_meas = ((THREAD_ARG*)args)->min_meas;
+    BIN_MAP* bin_map = ((THREAD_ARG*)args)->bin_map;
 
-    int i, bin, t;
-    int n = data_count / num_threads;
-    int start = n*rank;
-    int end = start + n;
-    if (end > data_count) end = data_count;
+    long i, j, count, in, below = 0, above = 0;
+    int bins[BIN_BATCH];
+    /* the first data_count % num_threads threads get one value more */
+    long start = data_count * rank / num_threads;
+    long end = data_count * (rank + 1) / num_threads;
 
-    /* Count number of values in each bin */
-    for (i = start; i < end; i++)
+    /* Count number of values in each bin, a batch at a time */
+    for (i = start; i < end; i += BIN_BATCH)
     {
-        bin = findBin(data[i], bin_maxes, bin_count, min_meas);
-        local_bin_counts[rank][bin]++;
+        count = (end - i < BIN_BATCH) ? end - i : BIN_BATCH;
+        binBatch(bin_map, &data[i], bins, count);
+        /* values outside the bins go to underflow and overflow */
+        for (j = 0, in = 0; j < count; j++)
+        {
+            below += (bins[j] < 0);
+            above += (bins[j] >= bin_count);
+            bins[in] = bins[j];
+            in += ((unsigned)bins[j] < (unsigned)bin_count);
+        }
+        accumAddBatch(&accum, rank, bins, in);
     }
+    accumFinish(&accum, rank);
+    outside_counts[8*rank] = below;
+    outside_counts[8*rank + 1] = above;
 
-    /*........... barrier ..........*/
+    /*........... barrier and merge ..........*/
     printf("thread %ld entering barrier\n", rank);
-    /* wait for the barrier mutex */
-    pthread_mutex_lock(&barrier_mutex);
-    /* increment counter to indicate thread's arrival */
-    barrier_thread_count++;
-    /* if not last thread to arrive */
-    if (barrier_thread_count < num_threads)
-    {
-        /* wait unlocks barrier_mutex and puts thread to sleep */
-        /* wait is in a loop in case some other event wakes the thread */
-        while (pthread_cond_wait(&ok_to_proceed, &barrier_mutex) != 0);
-        /* barrier_mutex is relocked when pthread_cond_wait returns */
-    }
-    else {
-        /* clear thread counter */
-        barrier_thread_count = 0;
-        /* signal all threads to wake up */
-        pthread_cond_broadcast(&ok_to_proceed);
-    }
-    /* release barrier mutex */
-    pthread_mutex_unlock(&barrier_mutex);
-    printf("thread %ld leaving barrier\n", rank);
-
+    /* every thread sums the counts of its own range of bins */
+    parReduceArrays(&barrier, rank, num_threads, accum.counts, accum.rows, accum.stride,
+                    bin_counts, bin_count);
     if (rank == 0)
-    {
-        /* sum values from local bin counts */
-        for (bin=0; bin<bin_count; bin++)
-        {
-            bin_counts[bin] = 0;
-            for (t=0; t<num_threads; t++)
-                bin_counts[bin] += local_bin_counts[t][bin];
-        }
         printf("thread %ld has finished accumulating results\n", rank);
-    }
 
     return NULL;
  }
 
+/*---------------------------------------------------------------------
+ * Function:  chooseStrategy
+ * Purpose:   Pick the accumulation strategy from the bins of
+ *            ACCUM_SAMPLE values spread over the data
+ * In args:   data:        the measurements
+ *            data_count:  number of measurements
+ *            bin_map:     how to find bins
+ *            bin_count:   number of bins
+ * Return:    the strategy
+ */
+int chooseStrategy(
+    float*   data          /* in */,
+    long     data_count    /* in */,
+    BIN_MAP* bin_map       /* in */,
+    int      bin_count     /* in */)
+{
+    float values[ACCUM_SAMPLE];
+    int bins[ACCUM_SAMPLE];
+    int i, in_range = 0;
+    int sample_count = (data_count < ACCUM_SAMPLE) ? (int)data_count : ACCUM_SAMPLE;
+
+    if (sample_count < 1) return ACCUM_PRIVATE;
+
+    /* consecutive runs from everywhere in the data, so runs of equal
+       values show up in the sample */
+    for (i = 0; i < sample_count; i++)
+        values[i] = data[(long)(i / 16) * 16 * data_count / sample_count + i % 16];
+    binBatch(bin_map, values, bins, sample_count);
+    for (i = 0; i < sample_count; i++)
+        if (bins[i] >= 0 && bins[i] < bin_count)
+            bins[in_range++] = bins[i];
+
+    return accumChoose(bin_count, num_threads, bins, in_range);
+}
+
 /*---------------------------------------------------------------------
  * Function:  usage
  * Purpose:   Print a message showing how to run program and quit
@@ -271,7 +366,10 @@ int main(int argc, char* argv[])
 void usage(char prog_name[] /* in */)
 {
     fprintf(stderr, "usage: %s ", prog_name);
-    fprintf(stderr, "<bin_count> <min_meas> <max_meas> <data_count> <num_threads>\n");
+    fprintf(stderr, "<bin_count> <min_meas> <max_meas> <data_count> <num_threads> [strategy] [distribution]\n");
+    fprintf(stderr, "   <min_meas>, <max_meas> = a number or auto, from the data\n");
+    fprintf(stderr, "   [strategy] = private, atomic, sharded, lanes, radix or auto\n");
+    fprintf(stderr, "   [distribution] = uniform, normal or pareto\n");
     exit(0);
 }  /* Usage */
 
@@ -281,9 +379,12 @@ void usage(char prog_name[] /* in */)
  * Purpose:   Get the command line arguments
  * In arg:    argv:  strings from command line
  * Out args:  bin_count_p:   number of bins
- *            min_meas_p:    minimum measurement
- *            max_meas_p:    maximum measurement
+ *            min_meas_p:    minimum measurement, NAN for auto
+ *            max_meas_p:    maximum measurement, NAN for auto
  *            data_count_p:  number of measurements
+ *            num_threads_p: number of threads
+ *            strategy_p:    name of the accumulation strategy
+ *            distribution_p: distribution of the measurements
  */
 void extractCommandLineArgs(
     int argc               /* in */,
@@ -291,47 +392,80 @@ void extractCommandLineArgs(
     int*     bin_count_p   /* out */,
     float*   min_meas_p    /* out */,
     float*   max_meas_p    /* out */,
-    int*     data_count_p  /* out */,
-    int*     num_threads_p /* out */)
+    long*    data_count_p  /* out */,
+    int*     num_threads_p /* out */,
+    char**   strategy_p    /* out */,
+    int*     distribution_p /* out */)
 {
-    if (argc != 6)
+    if (argc < 6 || argc > 8)
         usage(argv[0]);
     *bin_count_p = strtol(argv[1], NULL, 10);
-    *min_meas_p = strtof(argv[2], NULL);
-    *max_meas_p = strtof(argv[3], NULL);
+    *min_meas_p = (strcmp(argv[2], "auto") == 0) ? NAN : strtof(argv[2], NULL);
+    *max_meas_p = (strcmp(argv[3], "auto") == 0) ? NAN : strtof(argv[3], NULL);
     *data_count_p = strtol(argv[4], NULL, 10);
     *num_threads_p = strtol(argv[5], NULL, 10);
+    *strategy_p = (argc >= 7) ? argv[6] : "auto";
+    *distribution_p = (argc == 8) ? cbrngDistributionFromName(argv[7]) : CBRNG_UNIFORM;
+    if (*distribution_p < 0)
+        usage(argv[0]);
 #if VERBOSE == 1
     printf("bin_count = %d\n", *bin_count_p);
     printf("min_meas = %f, max_meas = %f\n", *min_meas_p, *max_meas_p);
-    printf("data_count = %d\n", *data_count_p);
+    printf("data_count = %ld\n", *data_count_p);
 #endif
 }
 
 
 /*---------------------------------------------------------------------
  * Function:  generateData
- * Purpose:   Generate random floats in the range min_meas <= x < max_meas
+ * Purpose:   Generate random floats in the range min_meas <= x < max_meas,
+ *            each of num_threads threads filling its own part of data
  * In args:   min_meas:    the minimum possible value for the data
  *            max_meas:    the maximum possible value for the data
  *            data_count:  the number of measurements
- * Out arg:   data:        the actual measurements
+ *            distribution: CBRNG_UNIFORM, CBRNG_NORMAL or CBRNG_PARETO
+ * Out args:  data:        the actual measurements
+ *            data_min_p:  smallest value made, +INFINITY if none
+ *            data_max_p:  largest value made, -INFINITY if none
+ * Note:      data[i] depends only on DATA_SEED and i, so the data is
+ *            the same for any number of threads (and as in histogram.c)
  */
 void generateData(
     float   min_meas    /* in  */,
     float   max_meas    /* in  */,
     float   data[]      /* out */,
-    int     data_count  /* in  */)
+    long    data_count  /* in  */,
+    int     distribution /* in  */,
+    float*  data_min_p  /* out */,
+    float*  data_max_p  /* out */)
 {
-    int i;
+    pthread_t* handles = malloc(num_threads*sizeof(pthread_t));
+    GENERATE_ARG* arguments = malloc(num_threads*sizeof(GENERATE_ARG));
+    long t;
+#if VERBOSE == 1
+    long i;
+#endif
 
-    srand(0);
-    for (i = 0; i < data_count; i++)
+    for (t = 0; t < num_threads; t++)
     {
-        data[i] = min_meas + (max_meas - min_meas)*rand()/((double) RAND_MAX);
-        if (data[i] == max_meas)
-            data[i]--;
+        arguments[t].rank = t;
+        arguments[t].data = data;
+        arguments[t].data_count = data_count;
+        arguments[t].min_meas = min_meas;
+        arguments[t].max_meas = max_meas;
+        arguments[t].distribution = distribution;
+        pthread_create(&handles[t], NULL, generateWork, (void*) &arguments[t]);
     }
+    *data_min_p = INFINITY;
+    *data_max_p = -INFINITY;
+    for (t = 0; t < num_threads; t++)
+    {
+        pthread_join(handles[t], NULL);
+        if (arguments[t].data_min < *data_min_p) *data_min_p = arguments[t].data_min;
+        if (arguments[t].data_max > *data_max_p) *data_max_p = arguments[t].data_max;
+    }
+    free(handles);
+    free(arguments);
 
 #if VERBOSE == 1
     printf("data = ");
@@ -342,6 +476,31 @@ void generateData(
 }
 
 
+/*---------------------------------------------------------------------
+ * Function:  generateWork
+ * Purpose:   Fill one thread's part of data and find its range
+ * In arg:    args:  pointer to the thread's GENERATE_ARG
+ */
+void* generateWork(void* args)
+{
+    GENERATE_ARG* arg = (GENERATE_ARG*)args;
+    long first = arg->data_count * arg->rank / num_threads;
+    long last = arg->data_count * (arg->rank + 1) / num_threads;
+    long i, n;
+
+    arg->data_min = INFINITY;
+    arg->data_max = -INFINITY;
+    for (i = first; i < last; i += BIN_BATCH)
+    {
+        n = (last - i < BIN_BATCH) ? last - i : BIN_BATCH;
+        cbrngFill(DATA_SEED, arg->distribution, arg->min_meas, arg->max_meas,
+                  &arg->data[i], i, n);
+        rangeBatch(&arg->data[i], n, &arg->data_min, &arg->data_max);
+    }
+    return NULL;
+}
+
+
 /*---------------------------------------------------------------------
  * Function:  createBins
  * Purpose:   Compute max value for each bin, and store 0 as the
@@ -356,7 +515,7 @@ void createBins(
     float min_meas      /* in  */,
     float max_meas      /* in  */,
     float bin_maxes[]   /* out */,
-    int   bin_counts[]  /* out */,
+    long  bin_counts[]  /* out */,
     int   bin_count     /* in  */)
 {
     float bin_width;
@@ -379,53 +538,6 @@ void createBins(
 }
 
 
-/*---------------------------------------------------------------------
- * Function:  findBin
- * Purpose:   Use binary search to determine which bin a measurement
- *            belongs to
- * In args:   data:       the current measurement
- *            bin_maxes:  list of max bin values
- *            bin_count:  number of bins
- *            min_meas:   the minimum possible measurement
- * Return:    the number of the bin to which data belongs
- * Notes:
- * 1.  The bin to which data belongs satisfies
- *
- *            bin_maxes[i-1] <= data < bin_maxes[i]
- *
- *     where, bin_maxes[-1] = min_meas
- * 2.  If the search fails, the function prints a message and exits
- */
-int findBin(
-    float   data          /* in */,
-    float   bin_maxes[]   /* in */,
-    int     bin_count     /* in */,
-    float   min_meas      /* in */)
-{
-    int bottom = 0, top =  bin_count-1;
-    int mid;
-    float bin_max, bin_min;
-
-    while (bottom <= top)
-    {
-        mid = (bottom + top)/2;
-        bin_max = bin_maxes[mid];
-        bin_min = (mid == 0) ? min_meas: bin_maxes[mid-1];
-        if (data >= bin_max)
-            bottom = mid+1;
-        else if (data < bin_min)
-            top = mid-1;
-        else
-            return mid;
-    }
-
-    /* Whoops! (this should not happen)*/
-    fprintf(stderr, "Data = %f doesn't belong to a bin!\n", data);
-    fprintf(stderr, "Quitting\n");
-    exit(-1);
-}
-
-
 /*---------------------------------------------------------------------
  * Function:  printHistogram
  * Purpose:   Print a histogram. Format of histogram is
@@ -437,7 +549,7 @@ int findBin(
  */
 void printHistogram(
     float  bin_maxes[]   /* in */,
-    int    bin_counts[]  /* in */,
+    long   bin_counts[]  /* in */,
     int    bin_count     /* in */,
     float  min_meas      /* in */)
 {
@@ -450,11 +562,11 @@ void printHistogram(
         bin_min = (i == 0) ? min_meas: bin_maxes[i-1];
         printf("%.3f-%.3f:\t", bin_min, bin_max);
 #if GRAPHICAL_OUTPUT == 1
-        int j;
+        long j;
         for (j = 0; j < bin_counts[i]; j++)
             printf("X");
 #else
-        printf("%d", bin_counts[i]);
+        printf("%ld", bin_counts[i]);
 #endif
         printf("\n");
     }
@@ -0,0 +1,544 @@
+/* COMP 137 Spring 2019
+ * filename: histogram_stream.c
+ *
+ * Purpose:   Build a histogram of measurements streamed from a file or
+ *            stdin, for inputs far bigger than memory (latency logs).
+ *
+ *            The main thread reads the input in chunks of CHUNK_BYTES
+ *            into a fixed pool of buffers.  Worker threads take full
+ *            buffers, parse and bin them, and hand them back, so memory
+ *            stays at BUFFERS_PER_THREAD chunks per worker however long the
+ *            input is.
+ *
+ *            Text input is numbers separated by white space or commas; a
+ *            chunk ends at its last separator and the rest (part of a
+ *            number) is carried over to the next chunk, so one long line
+ *            of comma separated values is fine.  Binary input is native 32-bit floats.
+ *
+ *            Values outside the bins are counted, not fatal.  At the end
+ *            the histogram, the count, and the throughput in values per
+ *            second are printed.  With [out] the histogram is also saved
+ *            in hist_serialize.h's format, so the histograms of several
+ *            inputs can be added up with histogram_merge.
+ *
+ * Program arguments: ./histogram_stream <bin_count> <min_meas> <max_meas> <num_threads> <format> [file] [out]
+ *   <bin_count>   = number of bins in the histogram
+ *   <min_meas>    = lower edge of the first bin
+ *   <max_meas>    = upper edge of the last bin
+ *   <num_threads> = number of worker threads
+ *   <format>      = text or binary
+ *   [file]        = input file, stdin if missing or -
+ *   [out]         = file to save the encoded histogram in
+ *
+ * How to compile: gcc -O3 -march=native -o histogram_stream histogram_stream.c -lm -lpthread
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "timer.h"
+#include "histogram_bins.h"
+#include "histogram_accum.h"
+#include "par_reduce.h"
+#include "hist_serialize.h"
+
+/* GRAPHICAL_OUTPUT = 1 -> Show histogram with X's for number of
+ *                         measurements in each bin
+ * GRAPHICAL_OUTPUT != 1 -> Show histogram with text values for number of
+ *                          measurements in each bin
+ */
+#define GRAPHICAL_OUTPUT 0
+
+/* bytes read at a time, and buffers in the pool per worker */
+#define CHUNK_BYTES (4 << 20)
+#define BUFFERS_PER_THREAD 2
+
+/* longest text carried from one chunk to the next (part of a number) */
+#define MAX_LINE 4096
+
+/* most values a chunk can hold: text needs at least a digit and a
+   separator per value, and a chunk may start with carried text */
+#define CHUNK_VALUES ((CHUNK_BYTES + MAX_LINE) / 2 + 1)
+
+/* what separates the numbers of text input */
+static inline int isSeparator(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == ',';
+}
+
+typedef struct {
+    char*   bytes;       /* CHUNK_BYTES + MAX_LINE bytes, text NUL terminated */
+    long    length;      /* bytes in use */
+} CHUNK;
+
+/* a bounded queue of chunks, NULL means end of input */
+typedef struct {
+    CHUNK**         items;
+    int             capacity;
+    int             head, count;
+    pthread_mutex_t mutex;
+    pthread_cond_t  not_empty;
+    pthread_cond_t  not_full;
+} CHUNK_QUEUE;
+
+void usage(char prog_name[]);
+
+void createBins(
+    float min_meas      /* in  */,
+    float max_meas      /* in  */,
+    float bin_maxes[]   /* out */,
+    long  bin_counts[]  /* out */,
+    int   bin_count     /* in  */);
+
+void printHistogram(
+    float    bin_maxes[]   /* in */,
+    long     bin_counts[]  /* in */,
+    int      bin_count     /* in */,
+    float    min_meas      /* in */);
+
+void queueInit(CHUNK_QUEUE* queue, int capacity);
+void queuePut(CHUNK_QUEUE* queue, CHUNK* chunk);
+CHUNK* queueGet(CHUNK_QUEUE* queue);
+void queueDestroy(CHUNK_QUEUE* queue);
+
+long parseText(const char* text, long length, float values[], long capacity);
+long readChunks(FILE* fp, int binary);
+void* threadWork(void* args);
+
+/* shared by all threads */
+CHUNK_QUEUE full_chunks;        /* read, waiting to be binned */
+CHUNK_QUEUE free_chunks;        /* binned, ready to be read into */
+BIN_MAP bin_map;
+HIST_ACCUM accum;
+BARRIER barrier;
+long* bin_counts;
+int bin_count;
+int num_threads;
+int binary_input;
+long* values_read;              /* per thread, padded to a cache line */
+long* values_outside;
+
+int main(int argc, char* argv[])
+{
+    float min_meas, max_meas;
+    float* bin_maxes;
+    FILE* fp = stdin;
+    CHUNK* chunks;
+    int num_chunks, c;
+    long t, total = 0, outside = 0, bytes;
+    pthread_t* thread_handles;
+    double t1, t2;
+
+    if (argc < 6 || argc > 8) usage(argv[0]);
+    bin_count = strtol(argv[1], NULL, 10);
+    min_meas = strtof(argv[2], NULL);
+    max_meas = strtof(argv[3], NULL);
+    num_threads = strtol(argv[4], NULL, 10);
+    if (strcmp(argv[5], "text") == 0) binary_input = 0;
+    else if (strcmp(argv[5], "binary") == 0) binary_input = 1;
+    else usage(argv[0]);
+    if (bin_count < 1 || num_threads < 1 || !(min_meas < max_meas)) usage(argv[0]);
+    if (argc >= 7 && strcmp(argv[6], "-") != 0 && (fp = fopen(argv[6], "rb")) == NULL)
+    {
+        fprintf(stderr, "could not open %s\n", argv[6]);
+        exit(0);
+    }
+
+    bin_maxes = malloc(bin_count*sizeof(float));
+    bin_counts = malloc(bin_count*sizeof(long));
+    createBins(min_meas, max_meas, bin_maxes, bin_counts, bin_count);
+    binMapInit(&bin_map, bin_maxes, bin_count, min_meas);
+    accumInit(&accum, ACCUM_PRIVATE, bin_count, num_threads, bin_counts);
+    barrierInit(&barrier, num_threads);
+    values_read = calloc(num_threads * 8, sizeof(long));
+    values_outside = calloc(num_threads * 8, sizeof(long));
+
+    /* the whole pool starts out free */
+    num_chunks = BUFFERS_PER_THREAD * num_threads + 1;
+    chunks = malloc(num_chunks*sizeof(CHUNK));
+    queueInit(&full_chunks, num_chunks + num_threads);
+    queueInit(&free_chunks, num_chunks);
+    for (c = 0; c < num_chunks; c++)
+    {
+        chunks[c].bytes = malloc(CHUNK_BYTES + MAX_LINE);
+        queuePut(&free_chunks, &chunks[c]);
+    }
+
+    GET_TIME(t1);
+    thread_handles = malloc(num_threads*sizeof(pthread_t));
+    for (t = 0; t < num_threads; t++)
+        pthread_create(&thread_handles[t], NULL, threadWork, (void*) t);
+
+    bytes = readChunks(fp, binary_input);
+
+    for (t = 0; t < num_threads; t++)
+        pthread_join(thread_handles[t], NULL);
+    GET_TIME(t2);
+
+    for (t = 0; t < num_threads; t++)
+    {
+        total += values_read[8*t];
+        outside += values_outside[8*t];
+    }
+
+    printHistogram(bin_maxes, bin_counts, bin_count, min_meas);
+    printf("values = %ld, outside the bins = %ld\n", total, outside);
+    printf("time = %f, %.1f M values/s, %.1f MB/s\n", t2 - t1,
+           total / (t2 - t1) * 1e-6, bytes / (t2 - t1) / 1048576.0);
+    printf("buffer memory = %d x %d KB\n", num_chunks, (CHUNK_BYTES + MAX_LINE) / 1024);
+
+    if (argc == 8)
+    {
+        HIST_BUFFER encoded;
+        FILE* out;
+
+        histBufferInit(&encoded);
+        histEncode(&encoded, bin_maxes, bin_counts, bin_count, min_meas);
+        if ((out = fopen(argv[7], "wb")) == NULL
+            || fwrite(encoded.bytes, 1, encoded.length, out) != (size_t)encoded.length
+            || fclose(out) != 0)
+            fprintf(stderr, "could not write %s\n", argv[7]);
+        else
+            printf("saved %ld bytes to %s\n", encoded.length, argv[7]);
+        histBufferFree(&encoded);
+    }
+
+    if (fp != stdin) fclose(fp);
+    for (c = 0; c < num_chunks; c++)
+        free(chunks[c].bytes);
+    free(chunks);
+    queueDestroy(&full_chunks);
+    queueDestroy(&free_chunks);
+    barrierDestroy(&barrier);
+    accumFree(&accum);
+    binMapFree(&bin_map);
+    free(values_read);
+    free(values_outside);
+    free(thread_handles);
+    free(bin_maxes);
+    free(bin_counts);
+    return 0;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  readChunks
+ * Purpose:   Read the input into free chunks and queue them for the
+ *            workers, then queue one end marker per worker
+ * In args:   fp:      the input
+ *            binary:  1 for 32-bit floats, 0 for text
+ * Return:    number of bytes read
+ */
+long readChunks(
+    FILE* fp      /* in */,
+    int   binary  /* in */)
+{
+    char carry[MAX_LINE];
+    long carried = 0, bytes = 0, n, end;
+    int t;
+
+    while (1)
+    {
+        CHUNK* chunk = queueGet(&free_chunks);
+
+        /* the incomplete number (or float) left from the last chunk */
+        memcpy(chunk->bytes, carry, carried);
+        n = fread(chunk->bytes + carried, 1, CHUNK_BYTES, fp);
+        bytes += n;
+        chunk->length = carried + n;
+        if (n == 0)
+        {
+            /* the last line may have no newline */
+            if (carried > 0 && !binary)
+            {
+                chunk->bytes[chunk->length++] = '\n';
+                chunk->bytes[chunk->length] = '\0';
+                queuePut(&full_chunks, chunk);
+            }
+            else
+                queuePut(&free_chunks, chunk);
+            break;
+        }
+
+        /* keep whole numbers (whole floats) in this chunk */
+        if (binary)
+            end = chunk->length / sizeof(float) * sizeof(float);
+        else
+        {
+            end = chunk->length;
+            while (end > 0 && !isSeparator(chunk->bytes[end-1]))
+                end--;
+        }
+        carried = chunk->length - end;
+        if (carried > MAX_LINE - 1)
+        {
+            fprintf(stderr, "number longer than %d bytes\n", MAX_LINE - 1);
+            exit(-1);
+        }
+        memcpy(carry, chunk->bytes + end, carried);
+        chunk->length = end;
+        /* strtof in parseText stops here */
+        chunk->bytes[end] = '\0';
+        queuePut(&full_chunks, chunk);
+    }
+
+    for (t = 0; t < num_threads; t++)
+        queuePut(&full_chunks, NULL);
+    return bytes;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  threadWork
+ * Purpose:   Parse and bin chunks until the end marker, then merge
+ * In arg:    args:  the thread's rank
+ */
+void* threadWork(void* args)
+{
+    long rank = (long) args;
+    float* values = malloc(CHUNK_VALUES * sizeof(float));
+    int bins[BIN_BATCH];
+    long count, i, j, n, in;
+    CHUNK* chunk;
+
+    while ((chunk = queueGet(&full_chunks)) != NULL)
+    {
+        if (binary_input)
+        {
+            count = chunk->length / sizeof(float);
+            memcpy(values, chunk->bytes, count * sizeof(float));
+        }
+        else
+            count = parseText(chunk->bytes, chunk->length, values, CHUNK_VALUES);
+        queuePut(&free_chunks, chunk);
+
+        for (i = 0; i < count; i += BIN_BATCH)
+        {
+            n = (count - i < BIN_BATCH) ? count - i : BIN_BATCH;
+            binBatch(&bin_map, &values[i], bins, n);
+            /* drop the values outside the bins */
+            for (j = 0, in = 0; j < n; j++)
+            {
+                bins[in] = bins[j];
+                in += (bins[j] >= 0 && bins[j] < bin_count);
+            }
+            accumAddBatch(&accum, rank, bins, in);
+            values_outside[8*rank] += n - in;
+        }
+        values_read[8*rank] += count;
+    }
+    free(values);
+
+    parReduceArrays(&barrier, rank, num_threads, accum.counts, accum.rows, accum.stride,
+                    bin_counts, bin_count);
+    return NULL;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  parseText
+ * Purpose:   Parse the numbers of a chunk of text
+ * In args:   text:    whole numbers separated by white space or
+ *                     commas, with a NUL at text[length] so strtof
+ *                     stops there
+ *            length:  bytes of text
+ *            capacity:  room in values; parsing stops when it is full
+ * Out arg:   values
+ * Return:    number of values
+ * Note:      A number with at most 7 digits and at most 10 after the
+ *            point is m / 10^k with m and 10^k exact floats, so one float
+ *            division rounds it exactly as strtof would.  Anything else
+ *            is handed to strtof.
+ */
+long parseText(
+    const char* text      /* in  */,
+    long        length    /* in  */,
+    float       values[]  /* out */,
+    long        capacity  /* in  */)
+{
+    static const float powers[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f,
+                                    1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+    const char* p = text;
+    const char* end = text + length;
+    long count = 0;
+
+    while (p < end && count < capacity)
+    {
+        const char* start;
+        long mantissa = 0;
+        int digits = 0, decimals = 0, negative = 0;
+        char c = *p;
+
+        if (isSeparator(c))
+        {
+            p++;
+            continue;
+        }
+
+        start = p;
+        if (*p == '-' || *p == '+') negative = (*p++ == '-');
+        /* too many digits for the fast path are only counted */
+        while (p < end && *p >= '0' && *p <= '9')
+        {
+            if (++digits <= 7) mantissa = 10*mantissa + (*p - '0');
+            p++;
+        }
+        if (p < end && *p == '.')
+            for (p++; p < end && *p >= '0' && *p <= '9'; p++)
+            {
+                if (++digits <= 7) mantissa = 10*mantissa + (*p - '0');
+                decimals++;
+            }
+
+        if (digits > 0 && digits <= 7 && decimals <= 10
+            && (p == end || isSeparator(*p)))
+        {
+            float x = (float)mantissa / powers[decimals];
+            values[count++] = negative ? -x : x;
+        }
+        else
+        {
+            char* stop;
+            float x = strtof(start, &stop);
+            if (stop == start)
+            {
+                /* not a number: skip the word */
+                while (p < end && !isSeparator(*p))
+                    p++;
+                continue;
+            }
+            values[count++] = x;
+            p = stop;
+        }
+    }
+    return count;
+}
+
+
+/*---------------------------------------------------------------------
+ * Functions: queueInit, queuePut, queueGet, queueDestroy
+ * Purpose:   A bounded queue of chunks; put waits while it is full and
+ *            get waits while it is empty
+ */
+void queueInit(CHUNK_QUEUE* queue, int capacity)
+{
+    queue->items = malloc(capacity*sizeof(CHUNK*));
+    queue->capacity = capacity;
+    queue->head = queue->count = 0;
+    pthread_mutex_init(&queue->mutex, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+}
+
+void queuePut(CHUNK_QUEUE* queue, CHUNK* chunk)
+{
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->count == queue->capacity)
+        pthread_cond_wait(&queue->not_full, &queue->mutex);
+    queue->items[(queue->head + queue->count) % queue->capacity] = chunk;
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+CHUNK* queueGet(CHUNK_QUEUE* queue)
+{
+    CHUNK* chunk;
+
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->count == 0)
+        pthread_cond_wait(&queue->not_empty, &queue->mutex);
+    chunk = queue->items[queue->head];
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->count--;
+    pthread_cond_signal(&queue->not_full);
+    pthread_mutex_unlock(&queue->mutex);
+    return chunk;
+}
+
+void queueDestroy(CHUNK_QUEUE* queue)
+{
+    pthread_cond_destroy(&queue->not_full);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_mutex_destroy(&queue->mutex);
+    free(queue->items);
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  usage
+ * Purpose:   Print a message showing how to run program and quit
+ * In arg:    prog_name:  the name of the program from the command line
+ */
+void usage(char prog_name[] /* in */)
+{
+    fprintf(stderr, "usage: %s ", prog_name);
+    fprintf(stderr, "<bin_count> <min_meas> <max_meas> <num_threads> <text|binary> [file] [out]\n");
+    exit(0);
+}  /* Usage */
+
+
+/*---------------------------------------------------------------------
+ * Function:  createBins
+ * Purpose:   Compute max value for each bin, and store 0 as the
+ *            number of values in each bin
+ * In args:   min_meas:   the minimum possible measurement
+ *            max_meas:   the maximum possible measurement
+ *            bin_count:  the number of bins
+ * Out args:  bin_maxes:  the maximum possible value for each bin
+ *            bin_counts: the number of data values in each bin
+ */
+void createBins(
+    float min_meas      /* in  */,
+    float max_meas      /* in  */,
+    float bin_maxes[]   /* out */,
+    long  bin_counts[]  /* out */,
+    int   bin_count     /* in  */)
+{
+    float bin_width;
+    int   i;
+
+    bin_width = (max_meas - min_meas)/bin_count;
+
+    for (i = 0; i < bin_count; i++)
+    {
+        bin_maxes[i] = min_meas + (i+1)*bin_width;
+        bin_counts[i] = 0;
+    }
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  printHistogram
+ * Purpose:   Print a histogram. Format of histogram is
+ *            determined by value of GRAPHICAL_OUTPUT
+ * In args:   bin_maxes:   the max value for each bin
+ *            bin_counts:  the number of elements in each bin
+ *            bin_count:   the number of bins
+ *            min_meas:    the minimum possible measurement
+ */
+void printHistogram(
+    float  bin_maxes[]   /* in */,
+    long   bin_counts[]  /* in */,
+    int    bin_count     /* in */,
+    float  min_meas      /* in */)
+{
+    int i;
+    float bin_max, bin_min;
+
+    for (i = 0; i < bin_count; i++)
+    {
+        bin_max = bin_maxes[i];
+        bin_min = (i == 0) ? min_meas: bin_maxes[i-1];
+        printf("%.3f-%.3f:\t", bin_min, bin_max);
+#if GRAPHICAL_OUTPUT == 1
+        long j;
+        for (j = 0; j < bin_counts[i]; j++)
+            printf("X");
+#else
+        printf("%ld", bin_counts[i]);
+#endif
+        printf("\n");
+    }
+}
@@ -0,0 +1,158 @@
+/* File:     par_reduce.h
+ * COMP 137 Spring 2019
+ *
+ * Purpose:  A reusable condition variable barrier, and a parallel reduce
+ *           of arrays built on it: every thread of a team calls
+ *           parReduceArrays with the same rows, and after the barrier
+ *           each thread adds up the columns of its own range of the
+ *           arrays.  No thread sits idle while one thread merges.
+ *
+ *           Ranges are whole cache lines of the output (8 longs),
+ *           counted from the first line boundary in sums wherever the
+ *           allocator put it, so threads do not write to the same line,
+ *           and each range is reduced
+ *           REDUCE_CHUNK columns at a time, so the partial sums stay in
+ *           L1 while all rows are added to them.  The column loop is
+ *           simple enough for the compiler to vectorize (-O3).
+ *
+ *           The rows are 32-bit counts and the sums 64-bit, and the rows
+ *           are added to what is already in the sums, so counts flushed
+ *           out of the rows earlier (histogram_accum.h) are kept.
+ *
+ * Example:
+ *    BARRIER barrier;
+ *    barrierInit(&barrier, num_threads);
+ *    . . .
+ *    in each thread, once its row of counts is done:
+ *    parReduceArrays(&barrier, rank, num_threads, rows, num_rows, stride,
+ *                    bin_counts, bin_count);
+ *    bin_counts now holds its old counts plus all rows, in every thread
+ */
+#ifndef _PAR_REDUCE_H_
+#define _PAR_REDUCE_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+/* columns reduced at a time: 8KB of partial sums */
+#define REDUCE_CHUNK 1024
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t  ok_to_proceed;
+    int             num_threads;   /* threads that must arrive */
+    int             count;         /* threads arrived so far */
+    long            generation;    /* barriers passed so far */
+} BARRIER;
+
+
+/*---------------------------------------------------------------------
+ * Function:  barrierInit
+ * Purpose:   Set up a barrier for num_threads threads
+ */
+static inline void barrierInit(
+    BARRIER* barrier      /* out */,
+    int      num_threads  /* in  */)
+{
+    pthread_mutex_init(&barrier->mutex, NULL);
+    pthread_cond_init(&barrier->ok_to_proceed, NULL);
+    barrier->num_threads = num_threads;
+    barrier->count = 0;
+    barrier->generation = 0;
+}
+
+static inline void barrierDestroy(BARRIER* barrier)
+{
+    pthread_cond_destroy(&barrier->ok_to_proceed);
+    pthread_mutex_destroy(&barrier->mutex);
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  barrierWait
+ * Purpose:   Wait until all threads have arrived
+ * Note:      A thread waits for the generation to change rather than for
+ *            a wake up, so spurious wake ups and threads that run ahead
+ *            into the next barrier are harmless.
+ */
+static inline void barrierWait(BARRIER* barrier /* in/out */)
+{
+    long generation;
+
+    pthread_mutex_lock(&barrier->mutex);
+    generation = barrier->generation;
+    barrier->count++;
+    if (barrier->count < barrier->num_threads)
+    {
+        while (generation == barrier->generation)
+            pthread_cond_wait(&barrier->ok_to_proceed, &barrier->mutex);
+    }
+    else
+    {
+        barrier->count = 0;
+        barrier->generation++;
+        pthread_cond_broadcast(&barrier->ok_to_proceed);
+    }
+    pthread_mutex_unlock(&barrier->mutex);
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  parReduceArrays
+ * Purpose:   Add rows of ints to 64-bit sums column by column, split
+ *            over all threads
+ * In args:   barrier:      barrier for the num_threads threads
+ *            rank:         the calling thread, 0 .. num_threads-1
+ *            num_threads:  threads calling parReduceArrays
+ *            rows:         num_rows rows, row r starts at rows + r*stride
+ *            num_rows:     number of rows
+ *            stride:       ints from one row to the next
+ *            length:       columns to sum
+ * In/out:    sums:         sums[c] += sum of rows[r*stride + c] over r
+ * Note:      Waits for all threads before reading rows, and again before
+ *            returning, so sums is complete in every thread.
+ */
+static inline void parReduceArrays(
+    BARRIER*   barrier      /* in/out */,
+    long       rank         /* in     */,
+    long       num_threads  /* in     */,
+    const int* rows         /* in     */,
+    int        num_rows     /* in     */,
+    long       stride       /* in     */,
+    long*      sums         /* in/out */,
+    long       length       /* in     */)
+{
+    /* ranges in whole 64-byte lines of sums: the skew columns before
+       its first line boundary go to thread 0 */
+    long skew = (long)((64 - (uintptr_t)sums % 64) % 64 / sizeof(long));
+    long lines = (length > skew) ? (length - skew + 7) / 8 : 0;
+    long first = (rank == 0) ? 0 : skew + lines * rank / num_threads * 8;
+    long last = skew + lines * (rank + 1) / num_threads * 8;
+    long chunk, end, c;
+    int r;
+
+    if (last > length) last = length;
+
+    /* every row is complete */
+    barrierWait(barrier);
+
+    for (chunk = first; chunk < last; chunk = end)
+    {
+        long* restrict out = sums + chunk;
+        long n;
+
+        end = (chunk + REDUCE_CHUNK < last) ? chunk + REDUCE_CHUNK : last;
+        n = end - chunk;
+        for (r = 0; r < num_rows; r++)
+        {
+            const int* restrict row = rows + r * stride + chunk;
+            for (c = 0; c < n; c++)
+                out[c] += row[c];
+        }
+    }
+
+    /* every range is summed */
+    barrierWait(barrier);
+}
+
+#endif
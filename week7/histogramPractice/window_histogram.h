@@ -0,0 +1,209 @@
+/* File:     window_histogram.h
+ * COMP 137 Spring 2019
+ *
+ * Purpose:  A histogram of the last few intervals of a stream of values
+ *           ("the distribution over the last 10 seconds"), for threads
+ *           that keep recording while others read it.
+ *
+ *           The histogram is a ring of intervals + 1 sub-histograms,
+ *           one per interval.  Writers add to the sub-histogram of the
+ *           current interval with relaxed atomic adds, each into its own
+ *           stripe of rows, so they take no lock and rarely share a
+ *           cache line.  windowRotate starts
+ *           the next interval: it zeroes the slot that fell out of the
+ *           window one interval ago and then publishes the new interval
+ *           number, so rotating costs O(bins) however many values were
+ *           recorded.  A query sums the slots in the window while the
+ *           writers carry on.
+ *
+ *           The spare slot is there for writers that read the interval
+ *           number just before a rotation: their adds still land in a
+ *           slot that is not being cleared.  A value recorded across a
+ *           rotation can count in either interval, and a query made
+ *           while values are being recorded may miss the last few of
+ *           them; both are fine for live metrics.
+ *
+ *           Columns are bins shifted up by one, with column 0 for values
+ *           below min_meas and column bin_count+1 for those at or above
+ *           the last edge (and NaN).
+ *
+ * Example:
+ *    WINDOW_HISTOGRAM win;
+ *    windowInit(&win, bin_maxes, bin_count, min_meas, intervals, num_threads);
+ *    writer rank:   windowRecordBatch(&win, rank, values, count);
+ *    ticker:        every interval, windowRotate(&win);
+ *    reader:        windowQuery(&win, intervals, counts);
+ */
+#ifndef _WINDOW_HISTOGRAM_H_
+#define _WINDOW_HISTOGRAM_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include "histogram_bins.h"
+
+typedef struct {
+    BIN_MAP map;          /* the bins */
+    int     columns;      /* bin_count + 2 */
+    int     intervals;    /* intervals in the window */
+    int     slots;        /* intervals + 1 */
+    int     stripes;      /* rows per slot, one per writer */
+    long    stride;       /* longs from one row to the next */
+    long*   counts;       /* slots * stripes rows, 64-byte aligned */
+    long    epoch;        /* current interval; slot epoch % slots */
+} WINDOW_HISTOGRAM;
+
+
+/*---------------------------------------------------------------------
+ * Function:  windowInit
+ * Purpose:   Set up an empty window
+ * In args:   bin_maxes, bin_count, min_meas:  the bins, as for binMapInit
+ *            intervals:  intervals in the window
+ *            stripes:    rows per interval, normally the number of
+ *                        writers
+ * Out arg:   win, free with windowFree
+ */
+static inline void windowInit(
+    WINDOW_HISTOGRAM* win          /* out */,
+    float             bin_maxes[]  /* in  */,
+    int               bin_count    /* in  */,
+    float             min_meas     /* in  */,
+    int               intervals    /* in  */,
+    int               stripes      /* in  */)
+{
+    size_t bytes;
+
+    binMapInit(&win->map, bin_maxes, bin_count, min_meas);
+    win->columns = bin_count + 2;
+    win->intervals = intervals;
+    win->slots = intervals + 1;
+    win->stripes = stripes;
+    /* whole cache lines (8 longs) per row, so writers never share one */
+    win->stride = ((long)win->columns + 7) / 8 * 8;
+    bytes = (size_t)win->slots * stripes * win->stride * sizeof(long);
+    win->counts = aligned_alloc(64, bytes);
+    memset(win->counts, 0, bytes);
+    win->epoch = 0;
+}
+
+static inline void windowFree(WINDOW_HISTOGRAM* win)
+{
+    binMapFree(&win->map);
+    free(win->counts);
+    win->counts = NULL;
+}
+
+/* First row of the slot of interval epoch */
+static inline long* windowSlot(const WINDOW_HISTOGRAM* win, long epoch)
+{
+    return win->counts + (epoch % win->slots) * win->stripes * win->stride;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  windowRecordBatch
+ * Purpose:   Count count values in the current interval
+ * In args:   rank:    the writer, picks the stripe
+ *            values, count
+ * In/out:    win
+ * Note:      Safe to call from any number of threads, while another
+ *            rotates or queries.
+ */
+static inline void windowRecordBatch(
+    WINDOW_HISTOGRAM* win     /* in/out */,
+    long              rank    /* in     */,
+    const float*      values  /* in     */,
+    long              count   /* in     */)
+{
+    int bins[BIN_BATCH];
+    long epoch = __atomic_load_n(&win->epoch, __ATOMIC_ACQUIRE);
+    long* row = windowSlot(win, epoch) + (rank % win->stripes) * win->stride;
+    long i, j, n;
+
+    for (i = 0; i < count; i += BIN_BATCH)
+    {
+        n = (count - i < BIN_BATCH) ? count - i : BIN_BATCH;
+        binBatch(&win->map, values + i, bins, n);
+        for (j = 0; j < n; j++)
+            __atomic_fetch_add(&row[bins[j] + 1], 1, __ATOMIC_RELAXED);
+    }
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  windowRotate
+ * Purpose:   Start the next interval, dropping the oldest from the window
+ * In/out:    win
+ * Note:      Call from one thread at a time.
+ */
+static inline void windowRotate(WINDOW_HISTOGRAM* win /* in/out */)
+{
+    long next = win->epoch + 1;
+    long* slot = windowSlot(win, next);
+    long r, c;
+
+    /* interval next - slots left the window at the last rotation */
+    for (r = 0; r < win->stripes; r++)
+        for (c = 0; c < win->columns; c++)
+            __atomic_store_n(&slot[r * win->stride + c], 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&win->epoch, next, __ATOMIC_RELEASE);
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  windowQuery
+ * Purpose:   Counts of the current interval and the back-1 before it
+ * In args:   win
+ *            back:    intervals to add up, 1 .. intervals
+ * Out arg:   counts:  columns counts, see above
+ */
+static inline void windowQuery(
+    const WINDOW_HISTOGRAM* win       /* in  */,
+    int                     back      /* in  */,
+    long                    counts[]  /* out */)
+{
+    long epoch = __atomic_load_n(&win->epoch, __ATOMIC_ACQUIRE);
+    long e, r, c;
+
+    if (back > win->intervals) back = win->intervals;
+    if (back > epoch + 1) back = epoch + 1;
+    for (c = 0; c < win->columns; c++)
+        counts[c] = 0;
+    for (e = epoch - back + 1; e <= epoch; e++)
+    {
+        const long* slot = windowSlot(win, e);
+        for (r = 0; r < win->stripes; r++)
+            for (c = 0; c < win->columns; c++)
+                counts[c] += __atomic_load_n(&slot[r * win->stride + c], __ATOMIC_RELAXED);
+    }
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  windowQueryDecayed
+ * Purpose:   Counts of the whole window, each interval weighted by
+ *            2^(-age / half_life), age 0 for the current interval
+ * In args:   win, half_life (in intervals, > 0)
+ * Out arg:   weights:  columns weighted counts
+ */
+static inline void windowQueryDecayed(
+    const WINDOW_HISTOGRAM* win        /* in  */,
+    double                  half_life  /* in  */,
+    double                  weights[]  /* out */)
+{
+    long epoch = __atomic_load_n(&win->epoch, __ATOMIC_ACQUIRE);
+    long back = (win->intervals < epoch + 1) ? win->intervals : epoch + 1;
+    long age, r, c;
+
+    for (c = 0; c < win->columns; c++)
+        weights[c] = 0.0;
+    for (age = 0; age < back; age++)
+    {
+        const long* slot = windowSlot(win, epoch - age);
+        double w = exp2(-age / half_life);
+        for (r = 0; r < win->stripes; r++)
+            for (c = 0; c < win->columns; c++)
+                weights[c] += w * __atomic_load_n(&slot[r * win->stride + c], __ATOMIC_RELAXED);
+    }
+}
+
+#endif
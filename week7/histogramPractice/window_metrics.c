@@ -0,0 +1,201 @@
+/* COMP 137 Spring 2019
+ * filename: window_metrics.c
+ *
+ * Purpose:   Live metrics with a sliding-window histogram
+ *            (window_histogram.h).  Writer threads record measurements
+ *            as fast as they can, and the main thread, once per
+ *            interval, rotates the window and prints the distribution
+ *            of the last <intervals> intervals, without stopping the
+ *            writers.
+ *
+ *            The measurements are normal, with a mean that drifts up and
+ *            down over DRIFT_PERIOD intervals, so the window can be seen
+ *            following it.  The decayed mean weights each interval by
+ *            2^(-age / HALF_LIFE).
+ *
+ *            At the end the writers are stopped and the whole window is
+ *            compared with the number of values recorded: they are equal
+ *            when the run is no longer than the window.
+ *
+ * Program arguments: ./window_metrics <bin_count> <min_meas> <max_meas> <num_threads> <interval_ms> <intervals> <seconds>
+ *
+ * How to compile: gcc -O3 -march=native -o window_metrics window_metrics.c -lm -lpthread
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include "timer.h"
+#include "cbrng.h"
+#include "window_histogram.h"
+
+/* intervals for the mean to go up and down once */
+#define DRIFT_PERIOD 20
+/* half life of the decayed mean, in intervals */
+#define HALF_LIFE 2.0
+/* values a writer makes and records at a time */
+#define WRITE_BATCH 256
+
+#define DATA_SEED 0
+
+void usage(char prog_name[]);
+void* writerWork(void* args);
+float binPercentile(const long counts[], double percentile);
+
+/* shared by all threads */
+WINDOW_HISTOGRAM win;
+float* bin_maxes;
+int bin_count;
+float min_meas, max_meas;
+int num_threads;
+int done = 0;
+long* values_recorded;          /* per thread, padded to a cache line */
+
+int main(int argc, char* argv[])
+{
+    pthread_t* thread_handles;
+    struct timespec interval;
+    long* counts;
+    double* weights;
+    long t, tick, ticks, window_total, recorded = 0;
+    int interval_ms, intervals, i;
+    double seconds, t1, t2, sum, weight, rotate_time;
+
+    if (argc != 8) usage(argv[0]);
+    bin_count = strtol(argv[1], NULL, 10);
+    min_meas = strtof(argv[2], NULL);
+    max_meas = strtof(argv[3], NULL);
+    num_threads = strtol(argv[4], NULL, 10);
+    interval_ms = strtol(argv[5], NULL, 10);
+    intervals = strtol(argv[6], NULL, 10);
+    seconds = strtod(argv[7], NULL);
+    if (bin_count < 1 || num_threads < 1 || interval_ms < 1 || intervals < 1
+        || !(min_meas < max_meas)) usage(argv[0]);
+
+    bin_maxes = malloc(bin_count*sizeof(float));
+    for (i = 0; i < bin_count; i++)
+        bin_maxes[i] = min_meas + (i+1)*((max_meas - min_meas)/bin_count);
+    windowInit(&win, bin_maxes, bin_count, min_meas, intervals, num_threads);
+    counts = malloc(win.columns*sizeof(long));
+    weights = malloc(win.columns*sizeof(double));
+    values_recorded = calloc(num_threads * 8, sizeof(long));
+
+    thread_handles = malloc(num_threads*sizeof(pthread_t));
+    for (t = 0; t < num_threads; t++)
+        pthread_create(&thread_handles[t], NULL, writerWork, (void*) t);
+
+    interval.tv_sec = interval_ms / 1000;
+    interval.tv_nsec = (interval_ms % 1000) * 1000000L;
+    ticks = (long)(seconds * 1000 / interval_ms);
+    for (tick = 1; tick < ticks; tick++)
+    {
+        nanosleep(&interval, NULL);
+        GET_TIME(t1);
+        windowRotate(&win);
+        GET_TIME(t2);
+        rotate_time = t2 - t1;
+
+        windowQuery(&win, intervals, counts);
+        windowQueryDecayed(&win, HALF_LIFE, weights);
+        for (i = 1, window_total = 0; i <= bin_count; i++)
+            window_total += counts[i];
+        for (i = 1, sum = 0.0, weight = 0.0; i <= bin_count; i++)
+        {
+            float bin_min = (i == 1) ? min_meas : bin_maxes[i-2];
+            sum += weights[i] * 0.5 * (bin_min + bin_maxes[i-1]);
+            weight += weights[i];
+        }
+        printf("%6.2fs: n = %9ld  p50 = %8.3f  p99 = %8.3f  outside = %6ld  decayed mean = %8.3f  rotate = %.1f us\n",
+               tick * interval_ms / 1000.0, window_total,
+               binPercentile(counts, 50.0), binPercentile(counts, 99.0),
+               counts[0] + counts[bin_count + 1], weight > 0 ? sum / weight : 0.0,
+               rotate_time * 1e6);
+    }
+    nanosleep(&interval, NULL);
+
+    __atomic_store_n(&done, 1, __ATOMIC_RELAXED);
+    for (t = 0; t < num_threads; t++)
+        pthread_join(thread_handles[t], NULL);
+    for (t = 0; t < num_threads; t++)
+        recorded += values_recorded[8*t];
+    windowQuery(&win, intervals, counts);
+    for (i = 0, window_total = 0; i < win.columns; i++)
+        window_total += counts[i];
+    printf("recorded = %ld, in the window = %ld, windows of %d x %d ms\n",
+           recorded, window_total, intervals, interval_ms);
+
+    windowFree(&win);
+    free(counts);
+    free(weights);
+    free(values_recorded);
+    free(thread_handles);
+    free(bin_maxes);
+    return 0;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  writerWork
+ * Purpose:   Record batches of measurements until done is set
+ * In arg:    args:  the writer's rank
+ */
+void* writerWork(void* args)
+{
+    long rank = (long) args;
+    float batch[WRITE_BATCH];
+    /* each writer has its own run of indices of the random stream */
+    long next = rank << 40;
+    int i;
+
+    while (!__atomic_load_n(&done, __ATOMIC_RELAXED))
+    {
+        long epoch = __atomic_load_n(&win.epoch, __ATOMIC_RELAXED);
+        float drift = 0.25f * (max_meas - min_meas)
+                      * sinf(2.0f * (float)M_PI * epoch / DRIFT_PERIOD);
+
+        cbrngFill(DATA_SEED, CBRNG_NORMAL, min_meas, max_meas, batch, next, WRITE_BATCH);
+        for (i = 0; i < WRITE_BATCH; i++)
+            batch[i] += drift;
+        windowRecordBatch(&win, rank, batch, WRITE_BATCH);
+        next += WRITE_BATCH;
+        values_recorded[8*rank] += WRITE_BATCH;
+    }
+    return NULL;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  binPercentile
+ * Purpose:   Upper edge of the bin holding the given percentile of the
+ *            values inside the bins
+ * In args:   counts:      window counts, column i+1 for bin i
+ *            percentile:  0 .. 100
+ */
+float binPercentile(const long counts[], double percentile)
+{
+    long total = 0, seen = 0;
+    int i;
+
+    for (i = 1; i <= bin_count; i++)
+        total += counts[i];
+    for (i = 1; i <= bin_count; i++)
+    {
+        seen += counts[i];
+        if (seen > 0 && seen >= percentile / 100.0 * total) return bin_maxes[i-1];
+    }
+    return min_meas;
+}
+
+
+/*---------------------------------------------------------------------
+ * Function:  usage
+ * Purpose:   Print a message showing how to run program and quit
+ * In arg:    prog_name:  the name of the program from the command line
+ */
+void usage(char prog_name[] /* in */)
+{
+    fprintf(stderr, "usage: %s ", prog_name);
+    fprintf(stderr, "<bin_count> <min_meas> <max_meas> <num_threads> <interval_ms> <intervals> <seconds>\n");
+    exit(0);
+}  /* Usage */
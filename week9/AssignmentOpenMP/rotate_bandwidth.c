@@ -0,0 +1,230 @@
+/* rotate_bandwidth.c
+ * COMP 137 - OpenMPHW
+ *
+ * Program functionality:
+ * Rotate all vectors of a text file into an output array, choosing the
+ * kernel by working set size.  If the input plus the output fit in the
+ * last level cache, the ordinary rotateVectors kernel is used.  If not,
+ * every ordinary store to the output first reads its cache line from
+ * DRAM (read for ownership), so the streaming kernel of vector_rotate.h
+ * is used: it writes the output with non-temporal stores and prefetches
+ * the input.  Its prefetch distance is tuned at start up by timing a
+ * few candidates on slices of the input that are not in cache.  The
+ * regular kernel is timed on one more slice, and if it still wins (a
+ * machine with bandwidth to spare) the regular kernel is kept.
+ *
+ * Both kernels are then timed so the choice can be checked, and the
+ * sum of the rotated vectors is printed like parallel_vector_rotate.
+ *
+ * [replicate] repeats the vectors of the file that many times to get a
+ * working set bigger than the cache out of a small file.
+ *
+ * How to compile: gcc -O3 -march=native -fopenmp -o rotate_bandwidth rotate_bandwidth.c -lm
+ * Usage: ./rotate_bandwidth <fn> <number of threads> [repetitions] [replicate]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+#include "vector_rotate.h"
+
+/* candidate prefetch distances in bytes, 0 = no software prefetch */
+#define NUM_DISTANCES 6
+const long prefetch_candidates[NUM_DISTANCES] = { 0, 512, 1024, 2048, 4096, 8192 };
+
+/* vectors rotated per thread to time one prefetch candidate */
+#define TUNE_VECTORS (64*1024)
+
+/* global variables */
+char* input_file_name = NULL;
+int num_threads;
+int repetitions = 5;
+long replicate = 1;
+/*--------------------------------------------------------------------*/
+
+void processCommandLine(int argc, char* argv[]);
+double rotateAll(float rotation_matrix[9], const float* in, float* out, long n,
+                 int streaming, long prefetch_bytes);
+int tuneStreaming(float rotation_matrix[9], const float* in, float* out, long n, long* prefetch_bytes);
+void sumVectors(const float* v, long n, float result[3]);
+
+/*--------------------------------------------------------------------*/
+
+int main(int argc, char* argv[])
+{
+    float* input_vectors;
+    float* rotated_vectors;
+    float angles[3];
+    float rotation_matrix[9];
+    float result[3];
+    long num_vectors, file_vectors, r;
+    long llc_size, working_set, prefetch_bytes = 0;
+    double regular_time = 1e30, streaming_time = 1e30, t;
+    int streaming, rep;
+
+    /* check for command line argument */
+    processCommandLine(argc, argv);
+
+    /* read the file specified in the command line argument
+       the reader function allocates the space for the input vectors */
+    input_vectors = readInputDatafile(input_file_name, &file_vectors, angles);
+    if (input_vectors == NULL)
+    {
+        fprintf(stderr, "could not read input file %s\n", input_file_name);
+        exit(0);
+    }
+    num_vectors = file_vectors * replicate;
+    if (replicate > 1)
+    {
+        input_vectors = (float*)realloc(input_vectors, 3*num_vectors*sizeof(float));
+        for (r = 1; r < replicate; r++)
+            memcpy(&input_vectors[3*r*file_vectors], input_vectors, 3*file_vectors*sizeof(float));
+    }
+    /* 64-byte aligned, so each thread's blocks start on a cache line */
+    rotated_vectors = (float*)aligned_alloc(64, (3*num_vectors*sizeof(float) + 63) / 64 * 64);
+    if (input_vectors == NULL || rotated_vectors == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(0);
+    }
+
+    computeRotationMatrix(angles, rotation_matrix);
+
+    /* choose the kernel: input and output both pass through the cache */
+    llc_size = lastLevelCacheSize();
+    working_set = 2 * 3*num_vectors*(long)sizeof(float);
+    streaming = (llc_size > 0) ? (working_set > llc_size) : 1;
+    /* one untimed pass takes the page faults on rotated_vectors, so the
+       tuning and the timings below measure memory traffic only */
+    rotateAll(rotation_matrix, input_vectors, rotated_vectors, num_vectors, 0, 0);
+    if (streaming)
+        streaming = tuneStreaming(rotation_matrix, input_vectors, rotated_vectors, num_vectors, &prefetch_bytes);
+
+    /* time both kernels, best of repetitions */
+    for (rep = 0; rep < repetitions; rep++)
+    {
+        t = rotateAll(rotation_matrix, input_vectors, rotated_vectors, num_vectors, 0, 0);
+        if (t < regular_time) regular_time = t;
+        t = rotateAll(rotation_matrix, input_vectors, rotated_vectors, num_vectors, 1, prefetch_bytes);
+        if (t < streaming_time) streaming_time = t;
+    }
+    /* the output of the chosen kernel is the one that is summed */
+    rotateAll(rotation_matrix, input_vectors, rotated_vectors, num_vectors, streaming, prefetch_bytes);
+    sumVectors(rotated_vectors, num_vectors, result);
+
+    /* print results */
+    printf("Number of threads: %d\n", num_threads);
+    printf("vectors = %ld, working set = %.1f MB, last level cache = %.1f MB\n",
+           num_vectors, working_set / 1048576.0, llc_size / 1048576.0);
+    printf("kernel = %s", streaming ? "streaming" : "regular");
+    if (streaming) printf(", prefetch distance = %ld bytes", prefetch_bytes);
+    else if (working_set > llc_size) printf(" (streaming was slower when tuned)");
+    printf("\n");
+    printf("regular   time = %f (%.2f GB/s)\n", regular_time, working_set / regular_time * 1e-9);
+    printf("streaming time = %f (%.2f GB/s)\n", streaming_time, working_set / streaming_time * 1e-9);
+    printf("Result = [%0.2f, %0.2f, %0.2f]\n", result[0], result[1], result[2]);
+
+    /* clean up dynamic memory */
+    free(input_vectors);
+    free(rotated_vectors);
+
+    return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* rotate n vectors from in to out with the regular or the streaming
+   kernel, returns the time it took */
+double rotateAll(float rotation_matrix[9], const float* in, float* out, long n,
+                 int streaming, long prefetch_bytes)
+{
+    long num_blocks = (n + BLOCK_VECTORS - 1) / BLOCK_VECTORS;
+    double start = omp_get_wtime();
+    long b;
+
+#   pragma omp parallel num_threads(num_threads)
+{
+#   pragma omp for schedule(static)
+    for (b = 0; b < num_blocks; b++)
+    {
+        long first = b * BLOCK_VECTORS;
+        long count = n - first;
+        if (count > BLOCK_VECTORS) count = BLOCK_VECTORS;
+
+        if (streaming)
+            rotateVectorsStreaming(rotation_matrix, &in[3*first], &out[3*first], count, prefetch_bytes);
+        else
+            rotateVectors(rotation_matrix, &in[3*first], &out[3*first], count);
+    }
+    /* before the implied barrier of the parallel region */
+    if (streaming) streamFence();
+}
+
+    return omp_get_wtime() - start;
+}
+
+/* time each prefetch candidate on its own slice of the input, so every
+   candidate starts from memory rather than from what the previous one
+   left in the cache.  *prefetch_bytes gets the fastest distance.
+   Returns 1 if the streaming kernel beat the regular one. */
+int tuneStreaming(float rotation_matrix[9], const float* in, float* out, long n, long* prefetch_bytes)
+{
+    long slice = (long)num_threads * TUNE_VECTORS;
+    double best_time = 1e30, regular_time, t;
+    int c;
+
+    /* too small to give meaningful timings: use a middle value */
+    *prefetch_bytes = 2048;
+    if (n < (NUM_DISTANCES + 1) * slice) return 1;
+
+    for (c = 0; c < NUM_DISTANCES; c++)
+    {
+        t = rotateAll(rotation_matrix, &in[3*c*slice], &out[3*c*slice], slice, 1, prefetch_candidates[c]);
+        if (t < best_time)
+        {
+            best_time = t;
+            *prefetch_bytes = prefetch_candidates[c];
+        }
+    }
+    regular_time = rotateAll(rotation_matrix, &in[3*c*slice], &out[3*c*slice], slice, 0, 0);
+    return best_time < regular_time;
+}
+
+/* sum of n vectors */
+void sumVectors(const float* v, long n, float result[3])
+{
+    float sx = 0.0f, sy = 0.0f, sz = 0.0f;
+    long i;
+
+#   pragma omp parallel for simd num_threads(num_threads) reduction(+: sx, sy, sz)
+    for (i = 0; i < n; i++)
+    {
+        sx += v[3*i];
+        sy += v[3*i + 1];
+        sz += v[3*i + 2];
+    }
+    result[0] = sx;
+    result[1] = sy;
+    result[2] = sz;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* print command line usage message and abort program. */
+void usage(char* prog_name) {
+	fprintf(stderr, "usage: %s <fn> <number of threads> [repetitions] [replicate]\n", prog_name);
+	fprintf(stderr, "   <fn> is name of the file containing the vectors\n");
+	fprintf(stderr, "   [replicate] repeats the vectors of the file to grow the working set\n");
+	exit(0);
+}
+
+/* interpret command lines and store in shared variables */
+void processCommandLine(int argc, char* argv[]) {
+	if (argc < 3 || argc > 5) usage(argv[0]);
+	input_file_name = argv[1];
+	num_threads = atoi(argv[2]);
+	if (argc >= 4) repetitions = atoi(argv[3]);
+	if (argc == 5) replicate = atol(argv[4]);
+	if (num_threads < 1 || repetitions < 1 || replicate < 1) usage(argv[0]);
+}
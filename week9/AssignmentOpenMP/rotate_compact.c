@@ -0,0 +1,404 @@
+/* rotate_compact.c
+ * COMP 137 - OpenMPHW
+ *
+ * Program functionality:
+ * Read 3D rotations and 3D vectors from a text file, store the vectors
+ * in a 16-bit format, rotate and sum them, and store the rotated vectors
+ * in the same format.  Each format is compared with plain floats for
+ * speed and for error.
+ *
+ * Formats (2 bytes per component instead of 4):
+ *   fp16   IEEE half precision (11 significant bits).  The largest
+ *          finite value is 65504; components beyond it, before or after
+ *          rotation, become +-inf.  They are counted in the "saturated"
+ *          column and the errors of that format are not valid
+ *   bf16   bfloat16, the top half of a float (8 significant bits)
+ *   int16  integers with one float scale per block of BLOCK_VECTORS
+ *
+ * The kernel works one block at a time: the block is decoded into a
+ * small float buffer that stays in L1, rotated and summed in float,
+ * and encoded again, so memory only sees the 16-bit data.  The decode
+ * and encode loops are SIMD (F16C instructions for fp16 when the
+ * compiler targets them).
+ *
+ * The formats only pay off when the vectors do not fit in cache, so
+ * that the time goes to memory traffic.  For inputs that fit (input1.txt
+ * among them) the decode and encode are extra work and all three
+ * formats are slower than plain floats.
+ *
+ * How to compile: gcc -O3 -march=native -fopenmp -o rotate_compact rotate_compact.c -lm
+ * Usage: ./rotate_compact <fn> <number of threads> [repetitions]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <omp.h>
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+#include "vector_rotate.h"
+
+#define FMT_FP16  0
+#define FMT_BF16  1
+#define FMT_INT16 2
+#define NUM_FORMATS 3
+
+const char* format_names[NUM_FORMATS] = { "fp16", "bf16", "int16" };
+
+/* n vectors as 3n 16-bit components */
+typedef struct {
+    int       format;
+    long      n;
+    uint16_t* data;
+    float*    scales;   /* int16 only: one scale per block */
+} COMPACT_VECTORS;
+
+/* global variables */
+char* input_file_name = NULL;
+long num_vectors = 0;
+float* original_vectors = NULL;
+float* rotated_vectors = NULL;
+int num_threads;
+int repetitions = 10;
+/*--------------------------------------------------------------------*/
+
+void processCommandLine(int argc, char* argv[]);
+void allocCompact(COMPACT_VECTORS* cv, int format, long n);
+void freeCompact(COMPACT_VECTORS* cv);
+void encodeVectors(const float* vects, long n, COMPACT_VECTORS* cv);
+void decodeVectors(const COMPACT_VECTORS* cv, float* vects);
+void rotateFloat(float rotation_matrix[9], const float* in, float* out, long n, double result[3]);
+void rotateCompact(float rotation_matrix[9], const COMPACT_VECTORS* in, COMPACT_VECTORS* out, double result[3]);
+
+/*--------------------------------------------------------------------*/
+
+int main(int argc, char* argv[])
+{
+    float rotation_matrix[9];
+    float angles[3];
+    double result[3], compact_result[3];
+    double start, float_time, compact_time, bytes;
+    float* decoded;
+    COMPACT_VECTORS in, out;
+    int f, r;
+    long i, saturated;
+
+    /* check for command line argument */
+    processCommandLine(argc, argv);
+
+    /* read the file specified in the command line argument
+       the reader function allocates the space for the input vectors */
+    original_vectors = readInputDatafile(input_file_name, &num_vectors, angles);
+    if (original_vectors == NULL)
+    {
+        fprintf(stderr, "could not read input file %s\n", input_file_name);
+        exit(0);
+    }
+    rotated_vectors = (float*)malloc(3*num_vectors*sizeof(float));
+    decoded = (float*)malloc(3*num_vectors*sizeof(float));
+    computeRotationMatrix(angles, rotation_matrix);
+
+    /* plain float reference */
+    rotateFloat(rotation_matrix, original_vectors, rotated_vectors, num_vectors, result);
+    start = omp_get_wtime();
+    for (r = 0; r < repetitions; r++)
+        rotateFloat(rotation_matrix, original_vectors, rotated_vectors, num_vectors, result);
+    float_time = (omp_get_wtime() - start) / repetitions;
+    bytes = 2.0 * 3 * num_vectors * sizeof(float);
+
+    printf("Number of threads: %d\n", num_threads);
+    printf("%-6s %12s %9s %8s %14s %14s %10s\n", "format", "time", "GB/s", "speedup", "max abs error", "Result error", "saturated");
+    printf("%-6s %12f %9.2f %8.2f %14s %14s %10s\n", "fp32", float_time, bytes / float_time * 1e-9, 1.0, "-", "-", "-");
+
+    for (f = 0; f < NUM_FORMATS; f++)
+    {
+        float max_err = 0.0f;
+        double result_err = 0.0;
+
+        allocCompact(&in, f, num_vectors);
+        allocCompact(&out, f, num_vectors);
+        encodeVectors(original_vectors, num_vectors, &in);
+
+        rotateCompact(rotation_matrix, &in, &out, compact_result);
+        start = omp_get_wtime();
+        for (r = 0; r < repetitions; r++)
+            rotateCompact(rotation_matrix, &in, &out, compact_result);
+        compact_time = (omp_get_wtime() - start) / repetitions;
+        bytes = 2.0 * 3 * num_vectors * sizeof(uint16_t);
+
+        /* components the format could not hold, in the input and the output */
+        decodeVectors(&in, decoded);
+        for (i = 0, saturated = 0; i < 3*num_vectors; i++)
+            saturated += isinf(decoded[i]) && !isinf(original_vectors[i]);
+        decodeVectors(&out, decoded);
+        for (i = 0; i < 3*num_vectors; i++)
+        {
+            saturated += isinf(decoded[i]) && !isinf(rotated_vectors[i]);
+            max_err = fmaxf(max_err, fabsf(decoded[i] - rotated_vectors[i]));
+        }
+        for (i = 0; i < 3; i++)
+        {
+            /* not fmax, which would hide a NaN */
+            double e = fabs(compact_result[i] - result[i]);
+            if (!(e <= result_err)) result_err = e;
+        }
+
+        printf("%-6s %12f %9.2f %8.2f %14e %14e %10ld\n", format_names[f], compact_time,
+               bytes / compact_time * 1e-9, float_time / compact_time, max_err, result_err, saturated);
+        fflush(stdout);
+        if (saturated > 0)
+            fprintf(stderr, "%s: %ld components out of range became inf, its results are not valid\n",
+                    format_names[f], saturated);
+
+        freeCompact(&in);
+        freeCompact(&out);
+    }
+    printf("Result = [%0.2f, %0.2f, %0.2f]\n", result[0], result[1], result[2]);
+
+    /* clean up dynamic memory */
+    free(original_vectors);
+    free(rotated_vectors);
+    free(decoded);
+
+    return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+void allocCompact(COMPACT_VECTORS* cv, int format, long n)
+{
+    long num_blocks = (n + BLOCK_VECTORS - 1) / BLOCK_VECTORS;
+    cv->format = format;
+    cv->n = n;
+    cv->data = (uint16_t*)malloc(3*(n > 0 ? n : 1)*sizeof(uint16_t));
+    cv->scales = (format == FMT_INT16) ? (float*)malloc((num_blocks > 0 ? num_blocks : 1)*sizeof(float)) : NULL;
+}
+
+void freeCompact(COMPACT_VECTORS* cv)
+{
+    free(cv->data);
+    free(cv->scales);
+}
+
+/* convert count 16-bit values to floats */
+static inline void decodeValues(int format, const uint16_t* restrict in, float scale,
+                                float* restrict out, long count)
+{
+    long i = 0;
+
+    if (format == FMT_FP16)
+    {
+#ifdef __F16C__
+        for (; i + 8 <= count; i += 8)
+            _mm256_storeu_ps(&out[i], _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)&in[i])));
+#endif
+        for (; i < count; i++)
+        {
+            _Float16 h;
+            memcpy(&h, &in[i], sizeof(h));
+            out[i] = (float)h;
+        }
+    }
+    else if (format == FMT_BF16)
+    {
+#       pragma omp simd
+        for (i = 0; i < count; i++)
+        {
+            uint32_t bits = (uint32_t)in[i] << 16;
+            float x;
+            memcpy(&x, &bits, sizeof(x));
+            out[i] = x;
+        }
+    }
+    else
+    {
+#       pragma omp simd
+        for (i = 0; i < count; i++)
+            out[i] = (int16_t)in[i] * scale;
+    }
+}
+
+/* convert count floats to 16-bit values; returns the block scale for int16 */
+static inline float encodeValues(int format, const float* restrict in,
+                                 uint16_t* restrict out, long count)
+{
+    long i = 0;
+    float max_abs = 0.0f, scale = 0.0f, inv_scale;
+
+    if (format == FMT_FP16)
+    {
+#ifdef __F16C__
+        for (; i + 8 <= count; i += 8)
+            _mm_storeu_si128((__m128i*)&out[i],
+                             _mm256_cvtps_ph(_mm256_loadu_ps(&in[i]), _MM_FROUND_TO_NEAREST_INT));
+#endif
+        for (; i < count; i++)
+        {
+            _Float16 h = (_Float16)in[i];
+            memcpy(&out[i], &h, sizeof(h));
+        }
+    }
+    else if (format == FMT_BF16)
+    {
+        /* round to nearest even on the dropped 16 bits */
+#       pragma omp simd
+        for (i = 0; i < count; i++)
+        {
+            uint32_t bits;
+            memcpy(&bits, &in[i], sizeof(bits));
+            out[i] = (uint16_t)((bits + 0x7fffu + ((bits >> 16) & 1u)) >> 16);
+        }
+    }
+    else
+    {
+#       pragma omp simd reduction(max: max_abs)
+        for (i = 0; i < count; i++)
+            max_abs = maxf(max_abs, fabsf(in[i]));
+        scale = max_abs / 32767.0f;
+        inv_scale = (scale > 0.0f) ? 1.0f / scale : 0.0f;
+        /* round half away from zero; lrintf would not vectorize */
+#       pragma omp simd
+        for (i = 0; i < count; i++)
+        {
+            float q = in[i] * inv_scale;
+            out[i] = (uint16_t)(int16_t)(int)(q + copysignf(0.5f, q));
+        }
+    }
+    return scale;
+}
+
+/* store n float vectors in the format of cv */
+void encodeVectors(const float* vects, long n, COMPACT_VECTORS* cv)
+{
+    long num_blocks = (n + BLOCK_VECTORS - 1) / BLOCK_VECTORS;
+    long b;
+
+#   pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (b = 0; b < num_blocks; b++)
+    {
+        long first = b * BLOCK_VECTORS;
+        long count = n - first;
+        float scale;
+        if (count > BLOCK_VECTORS) count = BLOCK_VECTORS;
+        scale = encodeValues(cv->format, &vects[3*first], &cv->data[3*first], 3*count);
+        if (cv->format == FMT_INT16) cv->scales[b] = scale;
+    }
+}
+
+/* turn the vectors in cv back into floats */
+void decodeVectors(const COMPACT_VECTORS* cv, float* vects)
+{
+    long num_blocks = (cv->n + BLOCK_VECTORS - 1) / BLOCK_VECTORS;
+    long b;
+
+#   pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (b = 0; b < num_blocks; b++)
+    {
+        long first = b * BLOCK_VECTORS;
+        long count = cv->n - first;
+        if (count > BLOCK_VECTORS) count = BLOCK_VECTORS;
+        decodeValues(cv->format, &cv->data[3*first],
+                     (cv->format == FMT_INT16) ? cv->scales[b] : 0.0f, &vects[3*first], 3*count);
+    }
+}
+
+/* rotate n float vectors and sum them, the reference for the formats */
+void rotateFloat(float rotation_matrix[9], const float* in, float* out, long n, double result[3])
+{
+    long num_blocks = (n + BLOCK_VECTORS - 1) / BLOCK_VECTORS;
+    double sx = 0.0, sy = 0.0, sz = 0.0;
+    long b, v;
+
+#   pragma omp parallel for num_threads(num_threads) schedule(static) reduction(+: sx, sy, sz)
+    for (b = 0; b < num_blocks; b++)
+    {
+        long first = b * BLOCK_VECTORS;
+        long count = n - first;
+        float bx = 0.0f, by = 0.0f, bz = 0.0f;
+        float* block;
+        if (count > BLOCK_VECTORS) count = BLOCK_VECTORS;
+        block = &out[3*first];
+        rotateVectors(rotation_matrix, &in[3*first], block, count);
+#       pragma omp simd reduction(+: bx, by, bz)
+        for (v = 0; v < count; v++)
+        {
+            bx += block[3*v];
+            by += block[3*v + 1];
+            bz += block[3*v + 2];
+        }
+        sx += bx;
+        sy += by;
+        sz += bz;
+    }
+    result[0] = sx;
+    result[1] = sy;
+    result[2] = sz;
+}
+
+/* rotate compact vectors into compact vectors and sum them in float */
+void rotateCompact(float rotation_matrix[9], const COMPACT_VECTORS* in, COMPACT_VECTORS* out, double result[3])
+{
+    long n = in->n;
+    long num_blocks = (n + BLOCK_VECTORS - 1) / BLOCK_VECTORS;
+    double sx = 0.0, sy = 0.0, sz = 0.0;
+    long b;
+
+#   pragma omp parallel num_threads(num_threads) reduction(+: sx, sy, sz)
+{
+    float in_block[3*BLOCK_VECTORS] __attribute__((aligned(64)));
+    float out_block[3*BLOCK_VECTORS] __attribute__((aligned(64)));
+    long v;
+
+#   pragma omp for schedule(static)
+    for (b = 0; b < num_blocks; b++)
+    {
+        long first = b * BLOCK_VECTORS;
+        long count = n - first;
+        float bx = 0.0f, by = 0.0f, bz = 0.0f;
+        float scale;
+        if (count > BLOCK_VECTORS) count = BLOCK_VECTORS;
+
+        decodeValues(in->format, &in->data[3*first],
+                     (in->format == FMT_INT16) ? in->scales[b] : 0.0f, in_block, 3*count);
+        rotateVectors(rotation_matrix, in_block, out_block, count);
+#       pragma omp simd reduction(+: bx, by, bz)
+        for (v = 0; v < count; v++)
+        {
+            bx += out_block[3*v];
+            by += out_block[3*v + 1];
+            bz += out_block[3*v + 2];
+        }
+        sx += bx;
+        sy += by;
+        sz += bz;
+        scale = encodeValues(out->format, out_block, &out->data[3*first], 3*count);
+        if (out->format == FMT_INT16) out->scales[b] = scale;
+    }
+}
+    result[0] = sx;
+    result[1] = sy;
+    result[2] = sz;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* print command line usage message and abort program. */
+void usage(char* prog_name) {
+	fprintf(stderr, "usage: %s <fn> <number of threads> [repetitions]\n", prog_name);
+	fprintf(stderr, "   <fn> is name of the file containing the data to be processed\n");
+	fprintf(stderr, "   fp16 holds magnitudes up to 65504; larger components become inf\n");
+	fprintf(stderr, "   and are reported in the saturated column\n");
+	fprintf(stderr, "   the 16-bit formats are only faster for data larger than the cache\n");
+	exit(0);
+}
+
+/* interpret command lines and store in shared variables */
+void processCommandLine(int argc, char* argv[]) {
+	if (argc != 3 && argc != 4) usage(argv[0]);
+	input_file_name = argv[1];
+	num_threads = atoi(argv[2]);
+	if (argc == 4) repetitions = atoi(argv[3]);
+	if (num_threads < 1 || repetitions < 1) usage(argv[0]);
+}
@@ -0,0 +1,350 @@
+/* rotate_filter.c
+ * COMP 137 - OpenMPHW
+ *
+ * Program functionality:
+ * Read 3D rotations and 3D vectors from a text file, rotate the vectors
+ * that satisfy a predicate and sum them.  The selected rotated vectors
+ * are written contiguously to filtered_vectors, together with the
+ * original index of each.
+ *
+ * The predicate is tested either on the original vectors (before the
+ * rotation) or on the rotated ones (after).  Everything happens in one
+ * pass over the input, one block of BLOCK_VECTORS at a time:
+ *   1. the predicate is evaluated for the whole block with SIMD
+ *   2. the block is rotated and the selected vectors summed (masked)
+ *   3. the indices of the selected vectors are compacted (AVX-512
+ *      compress stores when available, branch-free stores otherwise)
+ *   4. the block gets its output offset from a running total that the
+ *      blocks add their counts to in an ordered region, so in block
+ *      order whatever order the runtime hands them out in
+ *   5. the selected vectors are copied to their final place
+ *
+ * Predicates:
+ *   norm<R       |v| < R
+ *   norm>R       |v| > R
+ *   half:A,B,C,D A*x + B*y + C*z >= D
+ *   index:FILE   index listed in FILE (whitespace separated)
+ *
+ * How to compile: gcc -O3 -march=native -fopenmp -o rotate_filter rotate_filter.c -lm
+ * Usage: ./rotate_filter <fn> <number of threads> <before|after> <predicate>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <omp.h>
+#if defined(__AVX512BW__) && defined(__AVX512VL__)
+#include <immintrin.h>
+#endif
+#include "vector_rotate.h"
+
+#define PRED_NORM_LT 0
+#define PRED_NORM_GT 1
+#define PRED_HALF    2
+#define PRED_INDEX   3
+
+typedef struct {
+    int    kind;
+    int    after;       /* 1: test the rotated vector */
+    float  param[4];    /* R*R for norms, A, B, C, D for half-spaces */
+    unsigned char* index_set;   /* PRED_INDEX: index_set[i] != 0 if selected */
+} PREDICATE;
+
+/* global variables */
+char* input_file_name = NULL;
+long num_vectors = 0;
+float* original_vectors = NULL;
+float* filtered_vectors = NULL; /* selected rotated vectors, in input order */
+long* filtered_index = NULL;    /* original index of each selected vector */
+int num_threads;
+char* predicate_text = NULL;
+PREDICATE predicate;
+/*--------------------------------------------------------------------*/
+
+void processCommandLine(int argc, char* argv[]);
+int parsePredicate(char* text, PREDICATE* pred);
+long rotateFiltered(float rotation_matrix[9], const PREDICATE* pred, float result[3]);
+int checkFiltered(float rotation_matrix[9], const PREDICATE* pred, long count, float result[3]);
+
+/*--------------------------------------------------------------------*/
+
+int main(int argc, char* argv[])
+{
+    float rotation_matrix[9];
+    float angles[3];
+    float result[3];
+    double start, elapsed;
+    long count;
+
+    /* check for command line argument */
+    processCommandLine(argc, argv);
+
+    /* read the file specified in the command line argument
+       the reader function allocates the space for the input vectors */
+    original_vectors = readInputDatafile(input_file_name, &num_vectors, angles);
+    if (original_vectors == NULL)
+    {
+        fprintf(stderr, "could not read input file %s\n", input_file_name);
+        exit(0);
+    }
+
+    /* an index set is sized by the number of vectors, so the predicate
+       is parsed after the vectors are read */
+    if (!parsePredicate(predicate_text, &predicate))
+    {
+        fprintf(stderr, "could not use predicate %s\n", predicate_text);
+        exit(0);
+    }
+
+    /* worst case every vector is selected */
+    filtered_vectors = (float*)malloc(3*num_vectors*sizeof(float));
+    filtered_index = (long*)malloc(num_vectors*sizeof(long));
+    computeRotationMatrix(angles, rotation_matrix);
+
+    start = omp_get_wtime();
+    count = rotateFiltered(rotation_matrix, &predicate, result);
+    elapsed = omp_get_wtime() - start;
+
+    /* print results */
+    printf("Number of threads: %d\n", num_threads);
+    printf("Elapsed time = %f\n", elapsed);
+    printf("Selected %ld of %ld vectors\n", count, num_vectors);
+    printf("Result = [%0.2f, %0.2f, %0.2f]\n", result[0], result[1], result[2]);
+    printf("Serial check: %s\n", checkFiltered(rotation_matrix, &predicate, count, result) ? "passed" : "FAILED");
+
+    /* clean up dynamic memory */
+    free(original_vectors);
+    free(filtered_vectors);
+    free(filtered_index);
+    free(predicate.index_set);
+
+    return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* flags[v] = 1 if vector v of the block satisfies pred.
+   first is the index of the block's first vector in the whole input. */
+static inline void evaluatePredicate(const PREDICATE* pred, const float* restrict block,
+                                     long first, long count, unsigned char* restrict flags)
+{
+    const float a = pred->param[0], b = pred->param[1];
+    const float c = pred->param[2], d = pred->param[3];
+    long v;
+
+    switch (pred->kind)
+    {
+    case PRED_NORM_LT:
+#       pragma omp simd
+        for (v = 0; v < count; v++)
+        {
+            float x = block[3*v], y = block[3*v + 1], z = block[3*v + 2];
+            flags[v] = (x * x + y * y + z * z) < a;
+        }
+        break;
+    case PRED_NORM_GT:
+#       pragma omp simd
+        for (v = 0; v < count; v++)
+        {
+            float x = block[3*v], y = block[3*v + 1], z = block[3*v + 2];
+            flags[v] = (x * x + y * y + z * z) > a;
+        }
+        break;
+    case PRED_HALF:
+#       pragma omp simd
+        for (v = 0; v < count; v++)
+            flags[v] = (a * block[3*v] + b * block[3*v + 1] + c * block[3*v + 2]) >= d;
+        break;
+    default:
+#       pragma omp simd
+        for (v = 0; v < count; v++)
+            flags[v] = pred->index_set[first + v] != 0;
+        break;
+    }
+}
+
+/* idx = positions v with flags[v] set, returns how many */
+static inline int compactIndices(const unsigned char* flags, int count, int* restrict idx)
+{
+    int v = 0, k = 0;
+
+#if defined(__AVX512BW__) && defined(__AVX512VL__)
+    const __m512i lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    for (; v + 16 <= count; v += 16)
+    {
+        __m128i f = _mm_loadu_si128((const __m128i*)&flags[v]);
+        __mmask16 m = _mm_cmpneq_epi8_mask(f, _mm_setzero_si128());
+        _mm512_mask_compressstoreu_epi32(&idx[k], m, _mm512_add_epi32(lane, _mm512_set1_epi32(v)));
+        k += __builtin_popcount(m);
+    }
+#endif
+    /* branch-free: always store, only advance when selected */
+    for (; v < count; v++)
+    {
+        idx[k] = v;
+        k += flags[v];
+    }
+    return k;
+}
+
+/* rotate the vectors selected by pred, sum them and store them
+   contiguously in filtered_vectors.  Returns the number selected. */
+long rotateFiltered(float rotation_matrix[9], const PREDICATE* pred, float result[3])
+{
+    long num_blocks = (num_vectors + BLOCK_VECTORS - 1) / BLOCK_VECTORS;
+    float sx = 0.0f, sy = 0.0f, sz = 0.0f;
+    long b, total = 0;
+
+#   pragma omp parallel num_threads(num_threads) reduction(+: sx, sy, sz)
+{
+    float rotated[3*BLOCK_VECTORS] __attribute__((aligned(64)));
+    unsigned char flags[BLOCK_VECTORS] __attribute__((aligned(64)));
+    int idx[BLOCK_VECTORS + 16];
+    long v;
+
+    /* only the offset is taken in order; the rest of each block runs
+       in parallel */
+#   pragma omp for schedule(dynamic, 1) ordered
+    for (b = 0; b < num_blocks; b++)
+    {
+        long first = b * BLOCK_VECTORS;
+        long count = num_vectors - first;
+        const float* in = &original_vectors[3*first];
+        float bx = 0.0f, by = 0.0f, bz = 0.0f;
+        long offset;
+        int k, selected;
+
+        if (count > BLOCK_VECTORS) count = BLOCK_VECTORS;
+
+        if (!pred->after) evaluatePredicate(pred, in, first, count, flags);
+        rotateVectors(rotation_matrix, in, rotated, count);
+        if (pred->after) evaluatePredicate(pred, rotated, first, count, flags);
+
+        /* masked sum: a select, as 0 * inf would add NaN for an
+           unselected vector */
+#       pragma omp simd reduction(+: bx, by, bz)
+        for (v = 0; v < count; v++)
+        {
+            bx += flags[v] ? rotated[3*v] : 0.0f;
+            by += flags[v] ? rotated[3*v + 1] : 0.0f;
+            bz += flags[v] ? rotated[3*v + 2] : 0.0f;
+        }
+        sx += bx;
+        sy += by;
+        sz += bz;
+
+        selected = compactIndices(flags, (int)count, idx);
+
+        /* blocks take their offsets in order */
+#       pragma omp ordered
+        {
+            offset = total;
+            total += selected;
+        }
+
+        for (k = 0; k < selected; k++)
+        {
+            long dst = offset + k;
+            filtered_vectors[3*dst] = rotated[3*idx[k]];
+            filtered_vectors[3*dst + 1] = rotated[3*idx[k] + 1];
+            filtered_vectors[3*dst + 2] = rotated[3*idx[k] + 2];
+            filtered_index[dst] = first + idx[k];
+        }
+    }
+}
+
+    result[0] = sx;
+    result[1] = sy;
+    result[2] = sz;
+    return total;
+}
+
+/* filter, rotate and sum the obvious way and compare */
+int checkFiltered(float rotation_matrix[9], const PREDICATE* pred, long count, float result[3])
+{
+    double sum[3] = { 0.0, 0.0, 0.0 };
+    long v, k = 0;
+    int ok = 1, i;
+
+    for (v = 0; v < num_vectors && ok; v++)
+    {
+        float r[3];
+        unsigned char flag;
+        multMatrixVector(rotation_matrix, &original_vectors[3*v], r);
+        evaluatePredicate(pred, pred->after ? r : &original_vectors[3*v], v, 1, &flag);
+        if (!flag) continue;
+        if (k >= count || filtered_index[k] != v) ok = 0;
+        else
+            for (i = 0; i < 3; i++)
+            {
+                if (fabsf(filtered_vectors[3*k + i] - r[i]) > 1e-5f) ok = 0;
+                sum[i] += r[i];
+            }
+        k++;
+    }
+    if (k != count) ok = 0;
+    for (i = 0; i < 3; i++)
+        if (fabs(sum[i] - result[i]) > 1e-2 * (1.0 + fabs(sum[i]))) ok = 0;
+    return ok;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* print command line usage message and abort program. */
+void usage(char* prog_name) {
+	fprintf(stderr, "usage: %s <fn> <number of threads> <before|after> <predicate>\n", prog_name);
+	fprintf(stderr, "   <fn> is name of the file containing the data to be processed\n");
+	fprintf(stderr, "   <predicate> is norm<R, norm>R, half:A,B,C,D or index:FILE\n");
+	exit(0);
+}
+
+/* fill pred from text, returns 0 if it cannot be parsed */
+int parsePredicate(char* text, PREDICATE* pred)
+{
+    float r;
+    long i;
+    FILE* fp;
+
+    pred->index_set = NULL;
+    if (sscanf(text, "norm<%f", &r) == 1)
+    {
+        pred->kind = PRED_NORM_LT;
+        pred->param[0] = r * r;
+    }
+    else if (sscanf(text, "norm>%f", &r) == 1)
+    {
+        pred->kind = PRED_NORM_GT;
+        pred->param[0] = r * r;
+    }
+    else if (sscanf(text, "half:%f,%f,%f,%f", &pred->param[0], &pred->param[1],
+                    &pred->param[2], &pred->param[3]) == 4)
+        pred->kind = PRED_HALF;
+    else if (strncmp(text, "index:", 6) == 0)
+        pred->kind = PRED_INDEX;
+    else
+        return 0;
+
+    if (pred->kind == PRED_INDEX)
+    {
+        fp = fopen(text + 6, "r");
+        if (fp == NULL) return 0;
+        pred->index_set = (unsigned char*)calloc(num_vectors > 0 ? num_vectors : 1, 1);
+        while (fscanf(fp, "%ld", &i) == 1)
+            if (i >= 0 && i < num_vectors) pred->index_set[i] = 1;
+        fclose(fp);
+    }
+    return 1;
+}
+
+/* interpret command lines and store in shared variables */
+void processCommandLine(int argc, char* argv[]) {
+	if (argc != 5) usage(argv[0]);
+	input_file_name = argv[1];
+	num_threads = atoi(argv[2]);
+	if (num_threads < 1) usage(argv[0]);
+	if (strcmp(argv[3], "before") == 0) predicate.after = 0;
+	else if (strcmp(argv[3], "after") == 0) predicate.after = 1;
+	else usage(argv[0]);
+	predicate_text = argv[4];
+}
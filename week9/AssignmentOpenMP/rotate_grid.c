@@ -0,0 +1,462 @@
+/* rotate_grid.c
+ * COMP 137 - OpenMPHW
+ *
+ * Program functionality:
+ * Read 3D rotations and 3D vectors from a text file, rotate all vectors
+ * and build a uniform grid over the rotated vectors so nearest-neighbor
+ * and box queries do not have to scan every vector.
+ *
+ * The grid is built with a parallel counting sort: every thread counts
+ * the vectors of its slice per cell, the counts are turned into
+ * per-thread offsets, and every thread scatters its slice.  The vectors
+ * of a cell end up contiguous, next to the original index of each.
+ *
+ * Queries are answered in batches (one query per loop iteration, spread
+ * over the threads).  The same batches are answered by brute force so
+ * the build time and query throughput can be compared and the answers
+ * checked.
+ *
+ * How to compile: gcc -O3 -march=native -fopenmp -o rotate_grid rotate_grid.c -lm
+ * Usage: ./rotate_grid <fn> <number of threads> [number of queries]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <omp.h>
+#include "vector_rotate.h"
+
+/* average number of vectors per grid cell */
+#define POINTS_PER_CELL 2
+
+typedef struct {
+    float lo[3];        /* corner of the bounding box */
+    float cell_w[3];    /* cell width along each axis */
+    float inv_w[3];     /* 1/cell_w */
+    int   dims[3];      /* cells along each axis */
+    long  num_cells;
+    long  n;            /* number of vectors */
+    long* cell_start;   /* vectors of cell c are [cell_start[c], cell_start[c+1]) */
+    float* points;      /* vectors sorted by cell */
+    long* index;        /* original index of each sorted vector */
+} GRID;
+
+/* global variables */
+char* input_file_name = NULL;
+long num_vectors = 0;
+float* original_vectors = NULL;
+float* rotated_vectors = NULL;
+int num_threads;
+long num_queries = 1000;
+/*--------------------------------------------------------------------*/
+
+void processCommandLine(int argc, char* argv[]);
+void buildGrid(const float* vects, long n, GRID* grid);
+void freeGrid(GRID* grid);
+void gridNearestBatch(const GRID* grid, const float* queries, long nq, long* nearest);
+void gridBoxCountBatch(const GRID* grid, const float* boxes, long nq, long* counts);
+void bruteNearestBatch(const float* vects, long n, const float* queries, long nq, long* nearest);
+void bruteBoxCountBatch(const float* vects, long n, const float* boxes, long nq, long* counts);
+
+/*--------------------------------------------------------------------*/
+
+int main(int argc, char* argv[])
+{
+    float rotation_matrix[9];
+    float angles[3];
+    float* queries;
+    float* boxes;
+    long *grid_nearest, *brute_nearest, *grid_counts, *brute_counts;
+    long q, mismatches = 0;
+    double t0, build_time, grid_nn_time, grid_box_time, brute_nn_time, brute_box_time;
+    unsigned int seed = 1;
+    GRID grid;
+    int i;
+
+    /* check for command line argument */
+    processCommandLine(argc, argv);
+
+    /* read the file specified in the command line argument
+       the reader function allocates the space for the input vectors */
+    original_vectors = readInputDatafile(input_file_name, &num_vectors, angles);
+    if (original_vectors == NULL || num_vectors == 0)
+    {
+        fprintf(stderr, "could not read input file %s\n", input_file_name);
+        exit(0);
+    }
+
+    rotated_vectors = (float*)malloc(3*num_vectors*sizeof(float));
+    computeRotationMatrix(angles, rotation_matrix);
+    rotateVectors(rotation_matrix, original_vectors, rotated_vectors, num_vectors);
+
+    t0 = omp_get_wtime();
+    buildGrid(rotated_vectors, num_vectors, &grid);
+    build_time = omp_get_wtime() - t0;
+
+    /* random query points and boxes (center +- 5% of the extent) */
+    queries = (float*)malloc(3*num_queries*sizeof(float));
+    boxes = (float*)malloc(6*num_queries*sizeof(float));
+    for (q = 0; q < num_queries; q++)
+        for (i = 0; i < 3; i++)
+        {
+            float extent = grid.cell_w[i] * grid.dims[i];
+            float c = grid.lo[i] + extent * rand_r(&seed) / (float)RAND_MAX;
+            queries[3*q + i] = c;
+            boxes[6*q + i] = c - 0.05f * extent;
+            boxes[6*q + 3 + i] = c + 0.05f * extent;
+        }
+    grid_nearest = (long*)malloc(num_queries*sizeof(long));
+    brute_nearest = (long*)malloc(num_queries*sizeof(long));
+    grid_counts = (long*)malloc(num_queries*sizeof(long));
+    brute_counts = (long*)malloc(num_queries*sizeof(long));
+
+    t0 = omp_get_wtime();
+    gridNearestBatch(&grid, queries, num_queries, grid_nearest);
+    grid_nn_time = omp_get_wtime() - t0;
+    t0 = omp_get_wtime();
+    gridBoxCountBatch(&grid, boxes, num_queries, grid_counts);
+    grid_box_time = omp_get_wtime() - t0;
+    t0 = omp_get_wtime();
+    bruteNearestBatch(rotated_vectors, num_vectors, queries, num_queries, brute_nearest);
+    brute_nn_time = omp_get_wtime() - t0;
+    t0 = omp_get_wtime();
+    bruteBoxCountBatch(rotated_vectors, num_vectors, boxes, num_queries, brute_counts);
+    brute_box_time = omp_get_wtime() - t0;
+
+    /* nearest may differ only on exact ties, so compare distances */
+    for (q = 0; q < num_queries; q++)
+    {
+        float dg = 0.0f, db = 0.0f;
+        for (i = 0; i < 3; i++)
+        {
+            float a = rotated_vectors[3*grid_nearest[q] + i] - queries[3*q + i];
+            float b = rotated_vectors[3*brute_nearest[q] + i] - queries[3*q + i];
+            dg += a * a;
+            db += b * b;
+        }
+        if (dg != db || grid_counts[q] != brute_counts[q]) mismatches++;
+    }
+
+    /* print results */
+    printf("Number of threads: %d\n", num_threads);
+    printf("grid %d x %d x %d, build time = %f\n", grid.dims[0], grid.dims[1], grid.dims[2], build_time);
+    printf("nearest neighbor: grid %f (%.0f queries/s), brute force %f (%.0f queries/s)\n",
+           grid_nn_time, num_queries / grid_nn_time, brute_nn_time, num_queries / brute_nn_time);
+    printf("box count:        grid %f (%.0f queries/s), brute force %f (%.0f queries/s)\n",
+           grid_box_time, num_queries / grid_box_time, brute_box_time, num_queries / brute_box_time);
+    printf("mismatched answers = %ld\n", mismatches);
+
+    /* clean up dynamic memory */
+    freeGrid(&grid);
+    free(queries);
+    free(boxes);
+    free(grid_nearest);
+    free(brute_nearest);
+    free(grid_counts);
+    free(brute_counts);
+    free(original_vectors);
+    free(rotated_vectors);
+
+    return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* cell coordinate of x along axis a, clamped into the grid */
+static inline int cellCoord(const GRID* grid, float x, int a)
+{
+    int c = (int)floorf((x - grid->lo[a]) * grid->inv_w[a]);
+    if (c < 0) c = 0;
+    if (c >= grid->dims[a]) c = grid->dims[a] - 1;
+    return c;
+}
+
+static inline long cellId(const GRID* grid, int cx, int cy, int cz)
+{
+    return ((long)cz * grid->dims[1] + cy) * grid->dims[0] + cx;
+}
+
+/* build a uniform grid over n vectors with a parallel counting sort */
+void buildGrid(const float* vects, long n, GRID* grid)
+{
+    float lx = INFINITY, ly = INFINITY, lz = INFINITY;
+    float hx = -INFINITY, hy = -INFINITY, hz = -INFINITY;
+    float ext[3], side;
+    long* cell_of = (long*)malloc(n*sizeof(long));
+    long* thread_counts;
+    long v, num_cells;
+    int a;
+
+#   pragma omp parallel for simd num_threads(num_threads) \
+        reduction(min: lx, ly, lz) reduction(max: hx, hy, hz)
+    for (v = 0; v < n; v++)
+    {
+        lx = minf(lx, vects[3*v]);
+        ly = minf(ly, vects[3*v + 1]);
+        lz = minf(lz, vects[3*v + 2]);
+        hx = maxf(hx, vects[3*v]);
+        hy = maxf(hy, vects[3*v + 1]);
+        hz = maxf(hz, vects[3*v + 2]);
+    }
+
+    /* cubic cells sized for about POINTS_PER_CELL vectors each */
+    grid->lo[0] = lx; grid->lo[1] = ly; grid->lo[2] = lz;
+    ext[0] = fmaxf(hx - lx, 1e-6f);
+    ext[1] = fmaxf(hy - ly, 1e-6f);
+    ext[2] = fmaxf(hz - lz, 1e-6f);
+    side = cbrtf(ext[0] * ext[1] * ext[2] * POINTS_PER_CELL / (float)n);
+    for (a = 0; a < 3; a++)
+    {
+        grid->dims[a] = (int)(ext[a] / side);
+        if (grid->dims[a] < 1) grid->dims[a] = 1;
+        if (grid->dims[a] > 1024) grid->dims[a] = 1024;
+        grid->cell_w[a] = ext[a] / grid->dims[a];
+        grid->inv_w[a] = 1.0f / grid->cell_w[a];
+    }
+    num_cells = (long)grid->dims[0] * grid->dims[1] * grid->dims[2];
+    grid->num_cells = num_cells;
+    grid->n = n;
+    grid->cell_start = (long*)malloc((num_cells + 1)*sizeof(long));
+    grid->points = (float*)malloc(3*n*sizeof(float));
+    grid->index = (long*)malloc(n*sizeof(long));
+    thread_counts = (long*)malloc((long)num_threads*num_cells*sizeof(long));
+
+#   pragma omp parallel num_threads(num_threads)
+{
+    int my_rank = omp_get_thread_num();
+    int thread_count = omp_get_num_threads();
+    long first = n * my_rank / thread_count;
+    long last = n * (my_rank + 1) / thread_count;
+    long* my_counts = &thread_counts[my_rank*num_cells];
+    long i, c, offset;
+    int t;
+
+    /* count the vectors of this thread's slice in each cell */
+    for (c = 0; c < num_cells; c++)
+        my_counts[c] = 0;
+    for (i = first; i < last; i++)
+    {
+        c = cellId(grid, cellCoord(grid, vects[3*i], 0),
+                         cellCoord(grid, vects[3*i + 1], 1),
+                         cellCoord(grid, vects[3*i + 2], 2));
+        cell_of[i] = c;
+        my_counts[c]++;
+    }
+
+#   pragma omp barrier
+    /* counts -> starting offsets, cell-major and thread-minor; every
+       thread handles a range of cells, then the range totals are
+       shifted by the totals of the ranges before them */
+#   pragma omp for schedule(static)
+    for (c = 0; c < num_cells; c++)
+    {
+        long total = 0;
+        for (t = 0; t < thread_count; t++)
+            total += thread_counts[t*num_cells + c];
+        grid->cell_start[c + 1] = total;
+    }
+#   pragma omp single
+    {
+        grid->cell_start[0] = 0;
+        for (c = 0; c < num_cells; c++)
+            grid->cell_start[c + 1] += grid->cell_start[c];
+    }
+#   pragma omp for schedule(static)
+    for (c = 0; c < num_cells; c++)
+    {
+        offset = grid->cell_start[c];
+        for (t = 0; t < thread_count; t++)
+        {
+            long count = thread_counts[t*num_cells + c];
+            thread_counts[t*num_cells + c] = offset;
+            offset += count;
+        }
+    }
+
+    /* scatter this thread's slice */
+    for (i = first; i < last; i++)
+    {
+        long dst = my_counts[cell_of[i]]++;
+        grid->points[3*dst] = vects[3*i];
+        grid->points[3*dst + 1] = vects[3*i + 1];
+        grid->points[3*dst + 2] = vects[3*i + 2];
+        grid->index[dst] = i;
+    }
+}
+
+    free(thread_counts);
+    free(cell_of);
+}
+
+void freeGrid(GRID* grid)
+{
+    free(grid->cell_start);
+    free(grid->points);
+    free(grid->index);
+}
+
+/* nearest[q] = original index of the vector closest to query q.
+   Cells are searched in shells of growing Chebyshev radius r around
+   the query's cell.  Every vector in shell r or beyond is at least
+   (r - 1) * (smallest cell width) away, which ends the search. */
+void gridNearestBatch(const GRID* grid, const float* queries, long nq, long* nearest)
+{
+    float min_w = fminf(grid->cell_w[0], fminf(grid->cell_w[1], grid->cell_w[2]));
+    int max_r = grid->dims[0];
+    long q;
+
+    if (grid->dims[1] > max_r) max_r = grid->dims[1];
+    if (grid->dims[2] > max_r) max_r = grid->dims[2];
+
+#   pragma omp parallel for num_threads(num_threads) schedule(dynamic, 16)
+    for (q = 0; q < nq; q++)
+    {
+        const float* p = &queries[3*q];
+        int c[3], r, x, y, z;
+        float best_d2 = INFINITY;
+        long best = -1;
+
+        c[0] = cellCoord(grid, p[0], 0);
+        c[1] = cellCoord(grid, p[1], 1);
+        c[2] = cellCoord(grid, p[2], 2);
+
+        for (r = 0; r < max_r; r++)
+        {
+            float bound = (r - 1) * min_w;
+            if (r > 0 && best >= 0 && best_d2 <= bound * bound) break;
+            for (z = c[2] - r; z <= c[2] + r; z++)
+            {
+                if (z < 0 || z >= grid->dims[2]) continue;
+                for (y = c[1] - r; y <= c[1] + r; y++)
+                {
+                    if (y < 0 || y >= grid->dims[1]) continue;
+                    for (x = c[0] - r; x <= c[0] + r; x++)
+                    {
+                        long cell, i;
+                        if (x < 0 || x >= grid->dims[0]) continue;
+                        /* only the surface of the cube is new */
+                        if (abs(x - c[0]) != r && abs(y - c[1]) != r && abs(z - c[2]) != r) continue;
+                        cell = cellId(grid, x, y, z);
+                        for (i = grid->cell_start[cell]; i < grid->cell_start[cell + 1]; i++)
+                        {
+                            float dx = grid->points[3*i] - p[0];
+                            float dy = grid->points[3*i + 1] - p[1];
+                            float dz = grid->points[3*i + 2] - p[2];
+                            float d2 = dx * dx + dy * dy + dz * dz;
+                            if (d2 < best_d2 || (d2 == best_d2 && grid->index[i] < best))
+                            {
+                                best_d2 = d2;
+                                best = grid->index[i];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        nearest[q] = best;
+    }
+}
+
+/* counts[q] = number of vectors inside box q, given as
+   boxes[6q..6q+2] = low corner, boxes[6q+3..6q+5] = high corner */
+void gridBoxCountBatch(const GRID* grid, const float* boxes, long nq, long* counts)
+{
+    long q;
+
+#   pragma omp parallel for num_threads(num_threads) schedule(dynamic, 16)
+    for (q = 0; q < nq; q++)
+    {
+        const float* lo = &boxes[6*q];
+        const float* hi = &boxes[6*q + 3];
+        int y, z;
+        long count = 0;
+        int x0 = cellCoord(grid, lo[0], 0), x1 = cellCoord(grid, hi[0], 0);
+        int y0 = cellCoord(grid, lo[1], 1), y1 = cellCoord(grid, hi[1], 1);
+        int z0 = cellCoord(grid, lo[2], 2), z1 = cellCoord(grid, hi[2], 2);
+
+        for (z = z0; z <= z1; z++)
+            for (y = y0; y <= y1; y++)
+            {
+                /* cells x0..x1 of a row are contiguous */
+                long i;
+                long row_first = grid->cell_start[cellId(grid, x0, y, z)];
+                long row_last = grid->cell_start[cellId(grid, x1, y, z) + 1];
+#               pragma omp simd reduction(+: count)
+                for (i = row_first; i < row_last; i++)
+                {
+                    const float* v = &grid->points[3*i];
+                    count += (v[0] >= lo[0]) & (v[0] <= hi[0]) &
+                             (v[1] >= lo[1]) & (v[1] <= hi[1]) &
+                             (v[2] >= lo[2]) & (v[2] <= hi[2]);
+                }
+            }
+        counts[q] = count;
+    }
+}
+
+/* nearest neighbor by scanning all vectors */
+void bruteNearestBatch(const float* vects, long n, const float* queries, long nq, long* nearest)
+{
+    long q;
+
+#   pragma omp parallel for num_threads(num_threads) schedule(dynamic, 16)
+    for (q = 0; q < nq; q++)
+    {
+        const float* p = &queries[3*q];
+        float best_d2 = INFINITY;
+        long i, best = -1;
+        for (i = 0; i < n; i++)
+        {
+            float dx = vects[3*i] - p[0];
+            float dy = vects[3*i + 1] - p[1];
+            float dz = vects[3*i + 2] - p[2];
+            float d2 = dx * dx + dy * dy + dz * dz;
+            if (d2 < best_d2)
+            {
+                best_d2 = d2;
+                best = i;
+            }
+        }
+        nearest[q] = best;
+    }
+}
+
+/* box count by scanning all vectors */
+void bruteBoxCountBatch(const float* vects, long n, const float* boxes, long nq, long* counts)
+{
+    long q;
+
+#   pragma omp parallel for num_threads(num_threads) schedule(dynamic, 16)
+    for (q = 0; q < nq; q++)
+    {
+        const float* lo = &boxes[6*q];
+        const float* hi = &boxes[6*q + 3];
+        long i, count = 0;
+#       pragma omp simd reduction(+: count)
+        for (i = 0; i < n; i++)
+        {
+            const float* v = &vects[3*i];
+            count += (v[0] >= lo[0]) & (v[0] <= hi[0]) &
+                     (v[1] >= lo[1]) & (v[1] <= hi[1]) &
+                     (v[2] >= lo[2]) & (v[2] <= hi[2]);
+        }
+        counts[q] = count;
+    }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* print command line usage message and abort program. */
+void usage(char* prog_name) {
+	fprintf(stderr, "usage: %s <fn> <number of threads> [number of queries]\n", prog_name);
+	fprintf(stderr, "   <fn> is name of the file containing the data to be processed\n");
+	exit(0);
+}
+
+/* interpret command lines and store in shared variables */
+void processCommandLine(int argc, char* argv[]) {
+	if (argc != 3 && argc != 4) usage(argv[0]);
+	input_file_name = argv[1];
+	num_threads = atoi(argv[2]);
+	if (argc == 4) num_queries = atol(argv[3]);
+	if (num_threads < 1 || num_queries < 1) usage(argv[0]);
+}
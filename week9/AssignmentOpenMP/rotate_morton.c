@@ -0,0 +1,307 @@
+/* rotate_morton.c
+ * COMP 137 - OpenMPHW
+ *
+ * Program functionality:
+ * Read 3D rotations and 3D vectors from a text file, rotate all vectors,
+ * then reorder the rotated vectors along a Morton (Z-order) curve so that
+ * points close in space are close in memory.
+ *
+ * Each rotated vector is quantized to 21 bits per axis inside the
+ * bounding box and the bits are interleaved into a 63-bit Morton code.
+ * The (code, index) pairs are sorted with a parallel LSD radix sort
+ * (8-bit digits, per-thread histograms, prefix sum, per-thread scatter)
+ * and the vectors are gathered in sorted order.
+ *
+ * The reordered vectors come with a permutation array:
+ *   morton_vectors[i] == rotated_vectors[permutation[i]]
+ * so permutation[i] is the original position of the i-th sorted vector.
+ *
+ * How to compile: gcc -O3 -march=native -fopenmp -o rotate_morton rotate_morton.c -lm
+ * Usage: ./rotate_morton <fn> <number of threads>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <omp.h>
+#include "vector_rotate.h"
+
+#define RADIX_BITS   8
+#define RADIX_SIZE   (1 << RADIX_BITS)
+#define MORTON_BITS  63     /* 21 bits per axis */
+
+/* global variables */
+char* input_file_name = NULL;
+long num_vectors = 0;
+float* original_vectors = NULL;
+float* rotated_vectors = NULL;
+float* morton_vectors = NULL;   /* rotated vectors in Morton order */
+uint64_t* morton_codes = NULL;  /* sorted codes */
+uint32_t* permutation = NULL;   /* original index of each sorted vector */
+int num_threads;
+/*--------------------------------------------------------------------*/
+
+void processCommandLine(int argc, char* argv[]);
+void computeMortonCodes(const float* vects, long n, uint64_t* codes, uint32_t* index);
+void radixSortPairs(uint64_t* keys, uint32_t* vals, long n, int key_bits);
+void gatherVectors(const float* in, const uint32_t* perm, long n, float* out);
+int checkMortonOrder(void);
+
+/*--------------------------------------------------------------------*/
+
+int main(int argc, char* argv[])
+{
+    float rotation_matrix[9];
+    float angles[3];
+    double t0, t1, t2, t3, t4;
+
+    /* check for command line argument */
+    processCommandLine(argc, argv);
+
+    /* read the file specified in the command line argument
+       the reader function allocates the space for the input vectors */
+    original_vectors = readInputDatafile(input_file_name, &num_vectors, angles);
+    if (original_vectors == NULL)
+    {
+        fprintf(stderr, "could not read input file %s\n", input_file_name);
+        exit(0);
+    }
+    if (num_vectors > UINT32_MAX)
+    {
+        fprintf(stderr, "too many vectors for a 32-bit permutation\n");
+        exit(0);
+    }
+
+    rotated_vectors = (float*)malloc(3*num_vectors*sizeof(float));
+    morton_vectors = (float*)malloc(3*num_vectors*sizeof(float));
+    morton_codes = (uint64_t*)malloc(num_vectors*sizeof(uint64_t));
+    permutation = (uint32_t*)malloc(num_vectors*sizeof(uint32_t));
+    computeRotationMatrix(angles, rotation_matrix);
+
+    t0 = omp_get_wtime();
+#   pragma omp parallel num_threads(num_threads)
+{
+    long b, first, count;
+    long num_blocks = (num_vectors + BLOCK_VECTORS - 1) / BLOCK_VECTORS;
+#   pragma omp for schedule(static)
+    for (b = 0; b < num_blocks; b++)
+    {
+        first = b * BLOCK_VECTORS;
+        count = num_vectors - first;
+        if (count > BLOCK_VECTORS) count = BLOCK_VECTORS;
+        rotateVectors(rotation_matrix, &(original_vectors[first*3]),
+                      &(rotated_vectors[first*3]), count);
+    }
+}
+    t1 = omp_get_wtime();
+    computeMortonCodes(rotated_vectors, num_vectors, morton_codes, permutation);
+    t2 = omp_get_wtime();
+    radixSortPairs(morton_codes, permutation, num_vectors, MORTON_BITS);
+    t3 = omp_get_wtime();
+    gatherVectors(rotated_vectors, permutation, num_vectors, morton_vectors);
+    t4 = omp_get_wtime();
+
+    /* print results */
+    printf("Number of threads: %d\n", num_threads);
+    printf("rotate time = %f\n", t1 - t0);
+    printf("morton code time = %f\n", t2 - t1);
+    printf("radix sort time = %f\n", t3 - t2);
+    printf("gather time = %f\n", t4 - t3);
+    printf("Morton order check: %s\n", checkMortonOrder() ? "passed" : "FAILED");
+
+    /* clean up dynamic memory */
+    free(original_vectors);
+    free(rotated_vectors);
+    free(morton_vectors);
+    free(morton_codes);
+    free(permutation);
+
+    return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* spread the low 21 bits of x so there are two zero bits between each */
+static inline uint64_t splitBy3(uint32_t x)
+{
+    uint64_t v = x & 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffULL;
+    v = (v | v << 16) & 0x1f0000ff0000ffULL;
+    v = (v | v << 8)  & 0x100f00f00f00f00fULL;
+    v = (v | v << 4)  & 0x10c30c30c30c30c3ULL;
+    v = (v | v << 2)  & 0x1249249249249249ULL;
+    return v;
+}
+
+/* compute the 63-bit Morton code of every vector relative to the
+   bounding box of the set, and set index[i] = i */
+void computeMortonCodes(const float* vects, long n, uint64_t* codes, uint32_t* index)
+{
+    float lx = INFINITY, ly = INFINITY, lz = INFINITY;
+    float hx = -INFINITY, hy = -INFINITY, hz = -INFINITY;
+    float scale[3];
+    const float max_q = (float)((1 << 21) - 1);
+    long v;
+
+    /* bounding box */
+#   pragma omp parallel for simd num_threads(num_threads) \
+        reduction(min: lx, ly, lz) reduction(max: hx, hy, hz)
+    for (v = 0; v < n; v++)
+    {
+        lx = minf(lx, vects[3*v]);
+        ly = minf(ly, vects[3*v + 1]);
+        lz = minf(lz, vects[3*v + 2]);
+        hx = maxf(hx, vects[3*v]);
+        hy = maxf(hy, vects[3*v + 1]);
+        hz = maxf(hz, vects[3*v + 2]);
+    }
+    scale[0] = (hx > lx) ? max_q / (hx - lx) : 0.0f;
+    scale[1] = (hy > ly) ? max_q / (hy - ly) : 0.0f;
+    scale[2] = (hz > lz) ? max_q / (hz - lz) : 0.0f;
+
+#   pragma omp parallel for simd num_threads(num_threads)
+    for (v = 0; v < n; v++)
+    {
+        /* minf keeps rounding at the top edge inside 21 bits */
+        uint32_t qx = (uint32_t)minf((vects[3*v] - lx) * scale[0], max_q);
+        uint32_t qy = (uint32_t)minf((vects[3*v + 1] - ly) * scale[1], max_q);
+        uint32_t qz = (uint32_t)minf((vects[3*v + 2] - lz) * scale[2], max_q);
+        codes[v] = splitBy3(qx) << 2 | splitBy3(qy) << 1 | splitBy3(qz);
+        index[v] = (uint32_t)v;
+    }
+}
+
+/* stable LSD radix sort of keys, carrying vals along.
+   Each pass: every thread counts the digits of its own slice, the
+   counts are turned into per-thread starting offsets (digit-major,
+   thread-minor, so the sort stays stable), then every thread scatters
+   its slice.  A pass where every key has the same digit is skipped. */
+void radixSortPairs(uint64_t* keys, uint32_t* vals, long n, int key_bits)
+{
+    uint64_t* tmp_keys = (uint64_t*)malloc(n*sizeof(uint64_t));
+    uint32_t* tmp_vals = (uint32_t*)malloc(n*sizeof(uint32_t));
+    uint64_t* src_keys = keys;
+    uint32_t* src_vals = vals;
+    long* thread_counts = (long*)malloc((long)num_threads*RADIX_SIZE*sizeof(long));
+    int shift;
+
+    for (shift = 0; shift < key_bits; shift += RADIX_BITS)
+    {
+        int skip_pass = 0;
+
+#       pragma omp parallel num_threads(num_threads)
+    {
+        int my_rank = omp_get_thread_num();
+        int thread_count = omp_get_num_threads();
+        long first = n * my_rank / thread_count;
+        long last = n * (my_rank + 1) / thread_count;
+        long* my_counts = &thread_counts[(long)my_rank*RADIX_SIZE];
+        long i, offset;
+        int d, t;
+
+        for (d = 0; d < RADIX_SIZE; d++)
+            my_counts[d] = 0;
+        for (i = first; i < last; i++)
+            my_counts[(src_keys[i] >> shift) & (RADIX_SIZE - 1)]++;
+
+#       pragma omp barrier
+#       pragma omp single
+        {
+            /* exclusive prefix sum over (digit, thread) */
+            offset = 0;
+            for (d = 0; d < RADIX_SIZE; d++)
+            {
+                long digit_total = 0;
+                for (t = 0; t < thread_count; t++)
+                {
+                    long c = thread_counts[(long)t*RADIX_SIZE + d];
+                    thread_counts[(long)t*RADIX_SIZE + d] = offset;
+                    offset += c;
+                    digit_total += c;
+                }
+                if (digit_total == n) skip_pass = 1;
+            }
+        }
+        /* implied barrier at the end of single */
+
+        if (!skip_pass)
+        {
+            uint64_t* dst_keys = (src_keys == keys) ? tmp_keys : keys;
+            uint32_t* dst_vals = (src_vals == vals) ? tmp_vals : vals;
+            for (i = first; i < last; i++)
+            {
+                long dst = my_counts[(src_keys[i] >> shift) & (RADIX_SIZE - 1)]++;
+                dst_keys[dst] = src_keys[i];
+                dst_vals[dst] = src_vals[i];
+            }
+        }
+    }
+        if (!skip_pass)
+        {
+            src_keys = (src_keys == keys) ? tmp_keys : keys;
+            src_vals = (src_vals == vals) ? tmp_vals : vals;
+        }
+    }
+
+    /* an odd number of passes leaves the result in the temporaries */
+    if (src_keys != keys)
+    {
+        memcpy(keys, src_keys, n*sizeof(uint64_t));
+        memcpy(vals, src_vals, n*sizeof(uint32_t));
+    }
+
+    free(tmp_keys);
+    free(tmp_vals);
+    free(thread_counts);
+}
+
+/* out[i] = in[perm[i]] */
+void gatherVectors(const float* in, const uint32_t* perm, long n, float* out)
+{
+    long i;
+#   pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (i = 0; i < n; i++)
+    {
+        out[3*i] = in[3*(long)perm[i]];
+        out[3*i + 1] = in[3*(long)perm[i] + 1];
+        out[3*i + 2] = in[3*(long)perm[i] + 2];
+    }
+}
+
+/* codes ascending, permutation is a permutation of 0..n-1 and maps
+   morton_vectors back onto rotated_vectors */
+int checkMortonOrder(void)
+{
+    char* seen = (char*)calloc(num_vectors > 0 ? num_vectors : 1, 1);
+    long i;
+    int ok = 1;
+
+    for (i = 0; i < num_vectors && ok; i++)
+    {
+        if (i > 0 && morton_codes[i-1] > morton_codes[i]) ok = 0;
+        if (permutation[i] >= num_vectors || seen[permutation[i]]) ok = 0;
+        else seen[permutation[i]] = 1;
+        if (ok && memcmp(&morton_vectors[3*i], &rotated_vectors[3*(long)permutation[i]], 3*sizeof(float)) != 0)
+            ok = 0;
+    }
+    free(seen);
+    return ok;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* print command line usage message and abort program. */
+void usage(char* prog_name) {
+	fprintf(stderr, "usage: %s <fn> <number of threads> \n", prog_name);
+	fprintf(stderr, "   <fn> is name of the file containing the data to be processed\n");
+	exit(0);
+}
+
+/* interpret command lines and store in shared variables */
+void processCommandLine(int argc, char* argv[]) {
+	if (argc != 3) usage(argv[0]);
+	input_file_name = argv[1];
+	num_threads = atoi(argv[2]);
+	if (num_threads < 1) usage(argv[0]);
+}
@@ -0,0 +1,238 @@
+/* rotate_per_vector.c
+ * COMP 137 - OpenMPHW
+ *
+ * Program functionality:
+ * Read 3D vectors that each carry their own rotation (pitch, yaw, roll)
+ * from a text file, rotate every vector by its own angles and sum the
+ * rotated vectors.
+ *
+ * Calling computeRotationMatrix for every vector spends most of the time
+ * in cosf/sinf.  Here the sines and cosines of a whole batch of angles
+ * are computed with a polynomial sincos that the compiler vectorizes,
+ * and the rotation matrix R = Ry*Rx*Rz is expanded in closed form in
+ * registers; it is never stored.  The scalar libm version is also run
+ * so the time and the largest difference can be compared.
+ *
+ * Input file format:
+ *   <number of vectors>
+ *   x, y, z, pitch, yaw, roll      (one line per vector, radians)
+ *
+ * How to compile: gcc -O3 -march=native -fopenmp -o rotate_per_vector rotate_per_vector.c -lm
+ * Usage: ./rotate_per_vector <fn> <number of threads>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <omp.h>
+#include "vector_rotate.h"
+
+/* global variables */
+char* input_file_name = NULL;
+long num_vectors = 0;
+float* original_vectors = NULL;
+float* vector_angles = NULL;    /* pitch, yaw, roll of each vector */
+float* rotated_vectors = NULL;
+float* reference_vectors = NULL;
+int num_threads;
+/*--------------------------------------------------------------------*/
+
+void processCommandLine(int argc, char* argv[]);
+int readPerVectorDatafile(char* filename, long* num_vects, float** vects, float** angles);
+void rotatePerVectorScalar(long n, float result[3]);
+void rotatePerVectorBatched(long n, float result[3]);
+
+/*--------------------------------------------------------------------*/
+
+int main(int argc, char* argv[])
+{
+    float result[3] = { 0.0f, 0.0f, 0.0f };
+    float reference[3] = { 0.0f, 0.0f, 0.0f };
+    double start, scalar_time, batched_time;
+    float diff, max_diff = 0.0f;
+    long i;
+
+    /* check for command line argument */
+    processCommandLine(argc, argv);
+
+    /* the reader allocates the vectors and their angles */
+    if (!readPerVectorDatafile(input_file_name, &num_vectors, &original_vectors, &vector_angles))
+    {
+        fprintf(stderr, "could not read input file %s\n", input_file_name);
+        exit(0);
+    }
+    rotated_vectors = (float*)malloc(3*num_vectors*sizeof(float));
+    reference_vectors = (float*)malloc(3*num_vectors*sizeof(float));
+
+    start = omp_get_wtime();
+    rotatePerVectorScalar(num_vectors, reference);
+    scalar_time = omp_get_wtime() - start;
+
+    start = omp_get_wtime();
+    rotatePerVectorBatched(num_vectors, result);
+    batched_time = omp_get_wtime() - start;
+
+    for (i = 0; i < 3*num_vectors; i++)
+    {
+        diff = fabsf(rotated_vectors[i] - reference_vectors[i]);
+        if (diff > max_diff) max_diff = diff;
+    }
+
+    /* print results */
+    printf("Number of threads: %d\n", num_threads);
+    printf("libm per-vector time = %f\n", scalar_time);
+    printf("batched sincos time = %f\n", batched_time);
+    printf("max |difference| = %e\n", max_diff);
+    printf("libm Result = [%0.2f, %0.2f, %0.2f]\n", reference[0], reference[1], reference[2]);
+    printf("Result = [%0.2f, %0.2f, %0.2f]\n", result[0], result[1], result[2]);
+
+    /* clean up dynamic memory */
+    free(original_vectors);
+    free(vector_angles);
+    free(rotated_vectors);
+    free(reference_vectors);
+
+    return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* rotate vector v by its own angles with computeRotationMatrix */
+void rotatePerVectorScalar(long n, float result[3])
+{
+    long v;
+    float sx = 0.0f, sy = 0.0f, sz = 0.0f;
+
+#   pragma omp parallel for num_threads(num_threads) reduction(+: sx, sy, sz)
+    for (v = 0; v < n; v++)
+    {
+        float rotation_matrix[9];
+        computeRotationMatrix(&(vector_angles[v*3]), rotation_matrix);
+        multMatrixVector(rotation_matrix, &(original_vectors[v*3]), &(reference_vectors[v*3]));
+        sx += reference_vectors[v*3];
+        sy += reference_vectors[v*3 + 1];
+        sz += reference_vectors[v*3 + 2];
+    }
+    result[0] = sx;
+    result[1] = sy;
+    result[2] = sz;
+}
+
+/* sine and cosine of x (Cephes single precision polynomials).
+   x is reduced to [-pi/4, pi/4] by multiples of pi/4 in three parts so
+   the reduction stays exact for |x| up to a few thousand radians.
+   There are no branches, so a loop calling it vectorizes. */
+static inline void sinCosf(float x, float* s, float* c)
+{
+    const float four_over_pi = 1.27323954473516f;
+    float ax = fabsf(x);
+    int j = (int)(ax * four_over_pi);
+    float y, z, zz, sin_poly, cos_poly, sin_val, cos_val;
+    int swap, sin_negative, cos_negative;
+
+    /* round to an even multiple of pi/4 */
+    j = (j + 1) & ~1;
+    y = (float)j;
+    z = ((ax - y * 0.78515625f) - y * 2.4187564849853515625e-4f) - y * 3.77489497744594108e-8f;
+    zz = z * z;
+
+    sin_poly = ((-1.9515295891e-4f * zz + 8.3321608736e-3f) * zz - 1.6666654611e-1f) * zz * z + z;
+    cos_poly = ((2.443315711809948e-5f * zz - 1.388731625493765e-3f) * zz + 4.166664568298827e-2f) * zz * zz
+               - 0.5f * zz + 1.0f;
+
+    /* octant decides which polynomial is which and the signs */
+    swap = j & 2;
+    sin_negative = ((j & 4) != 0) ^ (x < 0.0f);
+    cos_negative = ((j + 2) & 4) != 0;
+    sin_val = swap ? cos_poly : sin_poly;
+    cos_val = swap ? sin_poly : cos_poly;
+    *s = sin_negative ? -sin_val : sin_val;
+    *c = cos_negative ? -cos_val : cos_val;
+}
+
+/* rotate vector v by its own angles, computing sines/cosines for a
+   SIMD batch at a time and R = Ry*Rx*Rz in closed form */
+void rotatePerVectorBatched(long n, float result[3])
+{
+    const float* restrict in = original_vectors;
+    const float* restrict ang = vector_angles;
+    float* restrict out = rotated_vectors;
+    float sx = 0.0f, sy = 0.0f, sz = 0.0f;
+    long v;
+
+#   pragma omp parallel for simd num_threads(num_threads) schedule(static) reduction(+: sx, sy, sz)
+    for (v = 0; v < n; v++)
+    {
+        float sp, cp, syw, cyw, sr, cr;
+        float x = in[3*v], y = in[3*v + 1], z = in[3*v + 2];
+        float rx, ry, rz;
+
+        sinCosf(ang[3*v], &sp, &cp);        /* pitch */
+        sinCosf(ang[3*v + 1], &syw, &cyw);  /* yaw */
+        sinCosf(ang[3*v + 2], &sr, &cr);    /* roll */
+
+        rx = (cyw * cr + syw * sp * sr) * x + (syw * sp * cr - cyw * sr) * y + (syw * cp) * z;
+        ry = (cp * sr) * x + (cp * cr) * y - sp * z;
+        rz = (cyw * sp * sr - syw * cr) * x + (syw * sr + cyw * sp * cr) * y + (cyw * cp) * z;
+
+        out[3*v] = rx;
+        out[3*v + 1] = ry;
+        out[3*v + 2] = rz;
+        sx += rx;
+        sy += ry;
+        sz += rz;
+    }
+    result[0] = sx;
+    result[1] = sy;
+    result[2] = sz;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* print command line usage message and abort program. */
+void usage(char* prog_name) {
+	fprintf(stderr, "usage: %s <fn> <number of threads> \n", prog_name);
+	fprintf(stderr, "   <fn> is name of the file containing the vectors and their angles\n");
+	exit(0);
+}
+
+/* interpret command lines and store in shared variables */
+void processCommandLine(int argc, char* argv[]) {
+	if (argc != 3) usage(argv[0]);
+	input_file_name = argv[1];
+	num_threads = atoi(argv[2]);
+	if (num_threads < 1) usage(argv[0]);
+}
+
+/* read a file of vectors with per-vector angles, returns 0 on failure */
+int readPerVectorDatafile(char* filename, long* num_vects, float** vects, float** angles)
+{
+	long i = 0, n = 0;
+	float* v;
+	float* a;
+
+	FILE* fp = fopen(filename, "r");
+	if (fp == NULL) return 0;
+	if (fscanf(fp, "%ld\n", &n) != 1 || n < 0)
+	{
+		fclose(fp);
+		return 0;
+	}
+	v = (float*)malloc(3 * (n > 0 ? n : 1) * sizeof(float));
+	a = (float*)malloc(3 * (n > 0 ? n : 1) * sizeof(float));
+	for (i = 0; i<n; i++)
+	{
+		if (fscanf(fp, "%f, %f, %f, %f, %f, %f\n", &(v[3*i]), &(v[3*i + 1]), &(v[3*i + 2]),
+		           &(a[3*i]), &(a[3*i + 1]), &(a[3*i + 2])) != 6)
+		{
+			free(v);
+			free(a);
+			fclose(fp);
+			return 0;
+		}
+	}
+	fclose(fp);
+	*num_vects = n;
+	*vects = v;
+	*angles = a;
+	return 1;
+}
@@ -0,0 +1,186 @@
+/* rotate_shm.c
+ * COMP 137 - OpenMPHW
+ *
+ * Program functionality:
+ * Rotate and sum batches of 3D vectors that a producer hands over in a
+ * POSIX shared memory segment (see shm_channel.h), instead of reading
+ * them from a text file.  The vectors are read straight from the
+ * producer's memory, so nothing is parsed or copied in; the input is
+ * left unchanged and the rotated vectors go to the output segment, or
+ * only to a small per-thread block buffer while they are summed.
+ *
+ * If an output segment is given, the rotated vectors and the sum are
+ * written into it (its writer side is this program), otherwise only
+ * the sum is computed and stored in the input segment's result field.
+ *
+ * The program keeps serving batches until the producer closes the
+ * input channel.  shm_producer.c is an example producer.
+ *
+ * How to compile: gcc -O3 -march=native -fopenmp -o rotate_shm rotate_shm.c -lm -lrt
+ * Usage: ./rotate_shm <input segment> <number of threads> [output segment]
+ * Example: ./shm_producer /rot_in /rot_out input1.txt 10 &
+ *          ./rotate_shm /rot_in 4 /rot_out
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <omp.h>
+#include "vector_rotate.h"
+#include "shm_channel.h"
+
+/* how long to wait for the producer to create the segments */
+#define ATTACH_TRIES 500
+#define ATTACH_SLEEP_US 10000
+
+/* global variables */
+char* input_name = NULL;
+char* output_name = NULL;
+int num_threads;
+/*--------------------------------------------------------------------*/
+
+void processCommandLine(int argc, char* argv[]);
+SHM_CHANNEL* attachWhenReady(const char* name);
+void rotateBatch(float rotation_matrix[9], const float* in, float* out, long n, float result[3]);
+
+/*--------------------------------------------------------------------*/
+
+int main(int argc, char* argv[])
+{
+    SHM_CHANNEL* in_ch;
+    SHM_CHANNEL* out_ch = NULL;
+    float rotation_matrix[9];
+    double start, busy_time = 0.0;
+    long batches = 0, vectors = 0;
+
+    /* check for command line argument */
+    processCommandLine(argc, argv);
+
+    in_ch = attachWhenReady(input_name);
+    if (in_ch == NULL)
+    {
+        fprintf(stderr, "could not attach to shared memory %s\n", input_name);
+        exit(0);
+    }
+    if (output_name != NULL)
+    {
+        out_ch = attachWhenReady(output_name);
+        if (out_ch == NULL || out_ch->capacity < in_ch->capacity)
+        {
+            fprintf(stderr, "could not attach to shared memory %s\n", output_name);
+            exit(0);
+        }
+    }
+
+    while (shmChannelWaitReadable(in_ch))
+    {
+        long n = (long)in_ch->num_vectors;
+        if (n > (long)in_ch->capacity) n = (long)in_ch->capacity;
+
+        if (out_ch != NULL) shmChannelWaitWritable(out_ch);
+
+        start = omp_get_wtime();
+        computeRotationMatrix(in_ch->angles, rotation_matrix);
+        rotateBatch(rotation_matrix, shmChannelVectors(in_ch),
+                    (out_ch != NULL) ? shmChannelVectors(out_ch) : NULL, n, in_ch->result);
+        busy_time += omp_get_wtime() - start;
+
+        if (out_ch != NULL)
+        {
+            out_ch->num_vectors = n;
+            memcpy(out_ch->angles, in_ch->angles, sizeof(in_ch->angles));
+            memcpy(out_ch->result, in_ch->result, sizeof(in_ch->result));
+            shmChannelPublish(out_ch);
+        }
+        /* the producer may now overwrite the input */
+        shmChannelRelease(in_ch);
+
+        batches++;
+        vectors += n;
+    }
+    if (out_ch != NULL) shmChannelClose(out_ch);
+
+    /* print results */
+    printf("Number of threads: %d\n", num_threads);
+    printf("batches = %ld, vectors = %ld\n", batches, vectors);
+    printf("rotate time = %f (%.1f M vectors/s)\n", busy_time,
+           (busy_time > 0.0) ? vectors / busy_time * 1e-6 : 0.0);
+
+    shmChannelDetach(in_ch);
+    if (out_ch != NULL) shmChannelDetach(out_ch);
+
+    return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* the producer may start after us, so retry for a while */
+SHM_CHANNEL* attachWhenReady(const char* name)
+{
+    SHM_CHANNEL* ch = NULL;
+    int tries;
+
+    for (tries = 0; tries < ATTACH_TRIES && ch == NULL; tries++)
+    {
+        ch = shmChannelAttach(name);
+        if (ch == NULL) usleep(ATTACH_SLEEP_US);
+    }
+    return ch;
+}
+
+/* rotate n vectors from in and sum them; the rotated vectors are
+   stored in out, or only kept in an L1 block buffer if out is NULL */
+void rotateBatch(float rotation_matrix[9], const float* in, float* out, long n, float result[3])
+{
+    long num_blocks = (n + BLOCK_VECTORS - 1) / BLOCK_VECTORS;
+    float sx = 0.0f, sy = 0.0f, sz = 0.0f;
+    long b;
+
+#   pragma omp parallel num_threads(num_threads) reduction(+: sx, sy, sz)
+{
+    float scratch[3*BLOCK_VECTORS] __attribute__((aligned(64)));
+    long v;
+
+#   pragma omp for schedule(static)
+    for (b = 0; b < num_blocks; b++)
+    {
+        long first = b * BLOCK_VECTORS;
+        long count = n - first;
+        float* block = (out != NULL) ? &out[3*first] : scratch;
+        float bx = 0.0f, by = 0.0f, bz = 0.0f;
+        if (count > BLOCK_VECTORS) count = BLOCK_VECTORS;
+
+        rotateVectors(rotation_matrix, &in[3*first], block, count);
+#       pragma omp simd reduction(+: bx, by, bz)
+        for (v = 0; v < count; v++)
+        {
+            bx += block[3*v];
+            by += block[3*v + 1];
+            bz += block[3*v + 2];
+        }
+        sx += bx;
+        sy += by;
+        sz += bz;
+    }
+}
+    result[0] = sx;
+    result[1] = sy;
+    result[2] = sz;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* print command line usage message and abort program. */
+void usage(char* prog_name) {
+	fprintf(stderr, "usage: %s <input segment> <number of threads> [output segment]\n", prog_name);
+	fprintf(stderr, "   segments are POSIX shared memory names such as /rot_in\n");
+	exit(0);
+}
+
+/* interpret command lines and store in shared variables */
+void processCommandLine(int argc, char* argv[]) {
+	if (argc != 3 && argc != 4) usage(argv[0]);
+	input_name = argv[1];
+	num_threads = atoi(argv[2]);
+	if (argc == 4) output_name = argv[3];
+	if (num_threads < 1) usage(argv[0]);
+}
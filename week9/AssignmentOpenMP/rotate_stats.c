@@ -0,0 +1,346 @@
+/* rotate_stats.c
+ * COMP 137 - OpenMPHW
+ *
+ * Program functionality:
+ * Read 3D rotations and 3D vectors from a text file, rotate all vectors
+ * and compute a configurable set of statistics of the rotated set
+ * (sum/centroid, bounding box, sums of squares, cross products and the
+ * 3x3 covariance) in the same pass as the rotation.
+ *
+ * The vectors are rotated one block of BLOCK_VECTORS at a time.  Each
+ * requested statistic is accumulated from the block while it is still
+ * in L1, so rotated_vectors is streamed from memory only once no matter
+ * how many statistics are asked for.  Every thread keeps its own
+ * accumulators; they are combined with a tree-structured merge.
+ *
+ * How to compile: gcc -O3 -march=native -fopenmp -o rotate_stats rotate_stats.c -lm
+ * Usage: ./rotate_stats <fn> <number of threads> [stats]
+ *   [stats] comma separated list of sum, minmax, sumsq, cross, cov, all
+ *           (default all).  cov is shorthand for sum,sumsq,cross.
+ * result for input1.txt:
+ * Result = [-613.67, 28.55, 9.76]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+#include "vector_rotate.h"
+
+/* statistics that can be requested */
+#define STAT_SUM    1   /* sum and centroid */
+#define STAT_MINMAX 2   /* bounding box */
+#define STAT_SUMSQ  4   /* x*x, y*y, z*z */
+#define STAT_CROSS  8   /* x*y, x*z, y*z */
+#define STAT_ALL    (STAT_SUM | STAT_MINMAX | STAT_SUMSQ | STAT_CROSS)
+
+/* timed runs of each pass; the best is printed */
+#define TIMING_RUNS 5
+
+/* per-thread accumulators, aligned so threads never share a cache line */
+typedef struct {
+    double sum[3];
+    double sumsq[3];
+    double cross[3];    /* xy, xz, yz */
+    float  min[3];
+    float  max[3];
+} __attribute__((aligned(64))) ROT_STATS;
+
+/* global variables */
+char* input_file_name = NULL;
+long num_vectors = 0;
+float* original_vectors = NULL;
+float* rotated_vectors = NULL;
+int num_threads;
+int stat_mask = STAT_ALL;
+/*--------------------------------------------------------------------*/
+
+void processCommandLine(int argc, char* argv[]);
+int parseStatList(char* list);
+void initStats(ROT_STATS* s);
+void accumulateBlock(const float* block, long count, int mask, ROT_STATS* s);
+void mergeStats(ROT_STATS* a, const ROT_STATS* b);
+double rotateWithStats(float rotation_matrix[9], int mask, ROT_STATS* thread_stats);
+void printStats(const ROT_STATS* s, int mask, long n);
+
+/*--------------------------------------------------------------------*/
+
+int main(int argc, char* argv[])
+{
+    float rotation_matrix[9];
+    float angles[3];
+    double rotate_time = 1e30, fused_time = 1e30, t;
+    ROT_STATS* thread_stats;
+    int run;
+
+    /* check for command line argument */
+    processCommandLine(argc, argv);
+
+    /* read the file specified in the command line argument
+       the reader function allocates the space for the input vectors */
+    original_vectors = readInputDatafile(input_file_name, &num_vectors, angles);
+    if (original_vectors == NULL)
+    {
+        fprintf(stderr, "could not read input file %s\n", input_file_name);
+        exit(0);
+    }
+
+    /* allocated space for rotated vectors, per-thread accumulators
+       and compute the rotation transformation matrix */
+    rotated_vectors = (float*)malloc(3*num_vectors*sizeof(float));
+    thread_stats = (ROT_STATS*)aligned_alloc(64, num_threads*sizeof(ROT_STATS));
+    computeRotationMatrix(angles, rotation_matrix);
+
+    /* an untimed pass takes the page faults on rotated_vectors, then the
+       rotation alone and with the statistics take turns, best of
+       TIMING_RUNS, so the cost of the statistics can be compared.  The
+       fused pass runs last and leaves its statistics in thread_stats */
+    rotateWithStats(rotation_matrix, 0, thread_stats);
+    for (run = 0; run < TIMING_RUNS; run++)
+    {
+        t = rotateWithStats(rotation_matrix, 0, thread_stats);
+        if (t < rotate_time) rotate_time = t;
+        t = rotateWithStats(rotation_matrix, stat_mask, thread_stats);
+        if (t < fused_time) fused_time = t;
+    }
+
+    /* print results */
+    printf("Number of threads: %d\n", num_threads);
+    printf("Rotate only time = %f\n", rotate_time);
+    printf("Rotate + stats time = %f\n", fused_time);
+    printStats(&thread_stats[0], stat_mask, num_vectors);
+
+    /* clean up dynamic memory */
+    free(original_vectors);
+    free(rotated_vectors);
+    free(thread_stats);
+
+    return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* rotate all vectors and accumulate the statistics in mask.
+   The merged statistics end up in thread_stats[0].
+   Returns the elapsed time. */
+double rotateWithStats(float rotation_matrix[9], int mask, ROT_STATS* thread_stats)
+{
+    long num_blocks = (num_vectors + BLOCK_VECTORS - 1) / BLOCK_VECTORS;
+    double start, end;
+
+    start = omp_get_wtime();
+#   pragma omp parallel num_threads(num_threads)
+{
+    int my_rank = omp_get_thread_num();
+    int thread_count = omp_get_num_threads();
+    ROT_STATS* my_stats = &thread_stats[my_rank];
+    long b, first, count;
+    int stride;
+
+    initStats(my_stats);
+
+#   pragma omp for schedule(static)
+    for (b = 0; b < num_blocks; b++)
+    {
+        first = b * BLOCK_VECTORS;
+        count = num_vectors - first;
+        if (count > BLOCK_VECTORS) count = BLOCK_VECTORS;
+        rotateVectors(rotation_matrix, &(original_vectors[first*3]),
+                      &(rotated_vectors[first*3]), count);
+        accumulateBlock(&(rotated_vectors[first*3]), count, mask, my_stats);
+    }
+
+    /* tree-structured merge: at each level, thread r adds in the
+       partial result of thread r + stride */
+    for (stride = 1; stride < thread_count; stride *= 2)
+    {
+#       pragma omp barrier
+        if (my_rank % (2*stride) == 0 && my_rank + stride < thread_count)
+            mergeStats(my_stats, &thread_stats[my_rank + stride]);
+    }
+}
+    end = omp_get_wtime();
+
+    return end - start;
+}
+
+/* set accumulators to the identity of each statistic */
+void initStats(ROT_STATS* s)
+{
+    int i;
+    for (i = 0; i < 3; i++)
+    {
+        s->sum[i] = 0.0;
+        s->sumsq[i] = 0.0;
+        s->cross[i] = 0.0;
+        s->min[i] = INFINITY;
+        s->max[i] = -INFINITY;
+    }
+}
+
+/* accumulate the requested statistics of one block of rotated vectors.
+   Each statistic is one SIMD loop with float lanes over the block (which
+   is still in L1); the block partials are then added in double. */
+void accumulateBlock(const float* block, long count, int mask, ROT_STATS* s)
+{
+    long v;
+
+    if (mask & STAT_SUM)
+    {
+        float sx = 0.0f, sy = 0.0f, sz = 0.0f;
+#       pragma omp simd reduction(+: sx, sy, sz)
+        for (v = 0; v < count; v++)
+        {
+            sx += block[3*v];
+            sy += block[3*v + 1];
+            sz += block[3*v + 2];
+        }
+        s->sum[0] += sx;
+        s->sum[1] += sy;
+        s->sum[2] += sz;
+    }
+
+    if (mask & STAT_MINMAX)
+    {
+        float lx = s->min[0], ly = s->min[1], lz = s->min[2];
+        float hx = s->max[0], hy = s->max[1], hz = s->max[2];
+#       pragma omp simd reduction(min: lx, ly, lz) reduction(max: hx, hy, hz)
+        for (v = 0; v < count; v++)
+        {
+            lx = minf(lx, block[3*v]);
+            ly = minf(ly, block[3*v + 1]);
+            lz = minf(lz, block[3*v + 2]);
+            hx = maxf(hx, block[3*v]);
+            hy = maxf(hy, block[3*v + 1]);
+            hz = maxf(hz, block[3*v + 2]);
+        }
+        s->min[0] = lx; s->min[1] = ly; s->min[2] = lz;
+        s->max[0] = hx; s->max[1] = hy; s->max[2] = hz;
+    }
+
+    if (mask & STAT_SUMSQ)
+    {
+        float qx = 0.0f, qy = 0.0f, qz = 0.0f;
+#       pragma omp simd reduction(+: qx, qy, qz)
+        for (v = 0; v < count; v++)
+        {
+            qx += block[3*v] * block[3*v];
+            qy += block[3*v + 1] * block[3*v + 1];
+            qz += block[3*v + 2] * block[3*v + 2];
+        }
+        s->sumsq[0] += qx;
+        s->sumsq[1] += qy;
+        s->sumsq[2] += qz;
+    }
+
+    if (mask & STAT_CROSS)
+    {
+        float cxy = 0.0f, cxz = 0.0f, cyz = 0.0f;
+#       pragma omp simd reduction(+: cxy, cxz, cyz)
+        for (v = 0; v < count; v++)
+        {
+            cxy += block[3*v] * block[3*v + 1];
+            cxz += block[3*v] * block[3*v + 2];
+            cyz += block[3*v + 1] * block[3*v + 2];
+        }
+        s->cross[0] += cxy;
+        s->cross[1] += cxz;
+        s->cross[2] += cyz;
+    }
+}
+
+/* a = a + b for every statistic */
+void mergeStats(ROT_STATS* a, const ROT_STATS* b)
+{
+    int i;
+    for (i = 0; i < 3; i++)
+    {
+        a->sum[i] += b->sum[i];
+        a->sumsq[i] += b->sumsq[i];
+        a->cross[i] += b->cross[i];
+        a->min[i] = fminf(a->min[i], b->min[i]);
+        a->max[i] = fmaxf(a->max[i], b->max[i]);
+    }
+}
+
+/* print the statistics in mask; centroid and covariance are derived
+   from the sums when all the sums they need were accumulated */
+void printStats(const ROT_STATS* s, int mask, long n)
+{
+    double mean[3], cov[9];
+    int i;
+
+    if (mask & STAT_SUM)
+    {
+        printf("Result = [%0.2f, %0.2f, %0.2f]\n", s->sum[0], s->sum[1], s->sum[2]);
+        for (i = 0; i < 3; i++)
+            mean[i] = (n > 0) ? s->sum[i] / n : 0.0;
+        printf("Centroid = [%0.4f, %0.4f, %0.4f]\n", mean[0], mean[1], mean[2]);
+    }
+    if (mask & STAT_MINMAX)
+    {
+        printf("Bounding box min = [%0.4f, %0.4f, %0.4f]\n", s->min[0], s->min[1], s->min[2]);
+        printf("Bounding box max = [%0.4f, %0.4f, %0.4f]\n", s->max[0], s->max[1], s->max[2]);
+    }
+    if (mask & STAT_SUMSQ)
+        printf("Sum of squares = [%0.2f, %0.2f, %0.2f]\n", s->sumsq[0], s->sumsq[1], s->sumsq[2]);
+    if (mask & STAT_CROSS)
+        printf("Cross products [xy, xz, yz] = [%0.2f, %0.2f, %0.2f]\n", s->cross[0], s->cross[1], s->cross[2]);
+
+    if ((mask & (STAT_SUM | STAT_SUMSQ | STAT_CROSS)) == (STAT_SUM | STAT_SUMSQ | STAT_CROSS) && n > 0)
+    {
+        /* population covariance: E[ab] - E[a]E[b] */
+        cov[0] = s->sumsq[0] / n - mean[0] * mean[0];
+        cov[4] = s->sumsq[1] / n - mean[1] * mean[1];
+        cov[8] = s->sumsq[2] / n - mean[2] * mean[2];
+        cov[1] = cov[3] = s->cross[0] / n - mean[0] * mean[1];
+        cov[2] = cov[6] = s->cross[1] / n - mean[0] * mean[2];
+        cov[5] = cov[7] = s->cross[2] / n - mean[1] * mean[2];
+        printf("Covariance =\n");
+        for (i = 0; i < 3; i++)
+            printf("  [%0.4f, %0.4f, %0.4f]\n", cov[3*i], cov[3*i + 1], cov[3*i + 2]);
+    }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* print command line usage message and abort program. */
+void usage(char* prog_name) {
+	fprintf(stderr, "usage: %s <fn> <number of threads> [stats]\n", prog_name);
+	fprintf(stderr, "   <fn> is name of the file containing the data to be processed\n");
+	fprintf(stderr, "   [stats] comma separated list of sum, minmax, sumsq, cross, cov, all\n");
+	exit(0);
+}
+
+/* turn a list like "sum,minmax" into a STAT_ mask, 0 on a bad name */
+int parseStatList(char* list)
+{
+    int mask = 0;
+    char* name = strtok(list, ",");
+
+    while (name != NULL)
+    {
+        if (strcmp(name, "sum") == 0) mask |= STAT_SUM;
+        else if (strcmp(name, "minmax") == 0) mask |= STAT_MINMAX;
+        else if (strcmp(name, "sumsq") == 0) mask |= STAT_SUMSQ;
+        else if (strcmp(name, "cross") == 0) mask |= STAT_CROSS;
+        else if (strcmp(name, "cov") == 0) mask |= STAT_SUM | STAT_SUMSQ | STAT_CROSS;
+        else if (strcmp(name, "all") == 0) mask |= STAT_ALL;
+        else return 0;
+        name = strtok(NULL, ",");
+    }
+    return mask;
+}
+
+/* interpret command lines and store in shared variables */
+void processCommandLine(int argc, char* argv[]) {
+	if (argc != 3 && argc != 4) usage(argv[0]);
+	input_file_name = argv[1];
+	num_threads = atoi(argv[2]);
+	if (num_threads < 1) usage(argv[0]);
+	if (argc == 4)
+	{
+		stat_mask = parseStatList(argv[3]);
+		if (stat_mask == 0) usage(argv[0]);
+	}
+}
@@ -0,0 +1,258 @@
+/* rotate_stream.c
+ * COMP 137 - OpenMPHW
+ *
+ * Program functionality:
+ * Read 3D vectors from a text file once, then keep re-rotating them as
+ * new orientations arrive.  Every line "pitch, yaw, roll" read from
+ * stdin (or from a named pipe given on the command line) produces one
+ * frame: all vectors rotated by the new angles, and their sum.
+ *
+ * The threads are created once and live in a single parallel region.
+ * Between frames they wait at the barrier of the single that reads the
+ * next angles; run with OMP_WAIT_POLICY=active to keep them spinning
+ * (lowest latency) or passive to let them sleep.
+ *
+ * Frames are double buffered.  Each frame is written into the buffer
+ * that is not being shown, then published by switching front_buffer.
+ * Each buffer has a sequence number that is odd while it is being
+ * written, so a reader that sees the same even number before and after
+ * using a frame knows it was not half written (see readFrame).
+ *
+ * When the input ends, the latency of the frames (angles read to frame
+ * published) is reported as percentiles.
+ *
+ * How to compile: gcc -O3 -march=native -fopenmp -o rotate_stream rotate_stream.c -lm
+ * Usage: ./rotate_stream <fn> <number of threads> [angle pipe]
+ * Example: printf "0.1, 0.2, 0.3\n0.2, 0.2, 0.3\n" | ./rotate_stream input1.txt 4
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <omp.h>
+#include "vector_rotate.h"
+
+/* PRINT_FRAMES = 1 -> print the sum of every frame
+ * PRINT_FRAMES != 1 -> only print the latency summary
+ */
+#define PRINT_FRAMES 0
+
+/* global variables */
+char* input_file_name = NULL;
+char* angle_file_name = NULL;
+long num_vectors = 0;
+float* original_vectors = NULL;
+float* frame_vectors[2] = { NULL, NULL };   /* double buffer */
+float frame_result[2][3];
+atomic_long frame_seq[2];       /* odd while the buffer is being written */
+atomic_int front_buffer;        /* buffer holding the latest frame */
+int num_threads;
+/*--------------------------------------------------------------------*/
+
+void processCommandLine(int argc, char* argv[]);
+long runStream(FILE* angle_fp, double** latencies_p);
+long readFrame(float* copy, float result[3]);
+int compareDoubles(const void* a, const void* b);
+void printLatencies(double* latencies, long frames);
+
+/*--------------------------------------------------------------------*/
+
+int main(int argc, char* argv[])
+{
+    float angles[3];
+    double* latencies = NULL;
+    FILE* angle_fp = stdin;
+    long frames;
+
+    /* check for command line argument */
+    processCommandLine(argc, argv);
+
+    /* read the file specified in the command line argument
+       the reader function allocates the space for the input vectors */
+    original_vectors = readInputDatafile(input_file_name, &num_vectors, angles);
+    if (original_vectors == NULL)
+    {
+        fprintf(stderr, "could not read input file %s\n", input_file_name);
+        exit(0);
+    }
+    if (angle_file_name != NULL && (angle_fp = fopen(angle_file_name, "r")) == NULL)
+    {
+        fprintf(stderr, "could not open angle input %s\n", angle_file_name);
+        exit(0);
+    }
+
+    frame_vectors[0] = (float*)malloc(3*num_vectors*sizeof(float));
+    frame_vectors[1] = (float*)malloc(3*num_vectors*sizeof(float));
+    atomic_init(&frame_seq[0], 0);
+    atomic_init(&frame_seq[1], 0);
+    atomic_init(&front_buffer, 0);
+
+    frames = runStream(angle_fp, &latencies);
+    printLatencies(latencies, frames);
+
+    /* clean up dynamic memory */
+    if (angle_fp != stdin) fclose(angle_fp);
+    free(latencies);
+    free(original_vectors);
+    free(frame_vectors[0]);
+    free(frame_vectors[1]);
+
+    return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* produce one frame per line of angles until the input ends.
+   Returns the number of frames; *latencies_p gets the latency of each. */
+long runStream(FILE* angle_fp, double** latencies_p)
+{
+    float rotation_matrix[9];
+    float angles[3];
+    float sx, sy, sz;
+    double frame_start;
+    double* latencies = NULL;
+    long frames = 0, capacity = 0;
+    int running = 1, back = 1;
+
+#   pragma omp parallel num_threads(num_threads)
+{
+    long num_blocks = (num_vectors + BLOCK_VECTORS - 1) / BLOCK_VECTORS;
+    long b, v;
+
+    while (1)
+    {
+#       pragma omp single
+        {
+            running = (fscanf(angle_fp, " %f , %f , %f", &angles[0], &angles[1], &angles[2]) == 3);
+            if (running)
+            {
+                frame_start = omp_get_wtime();
+                computeRotationMatrix(angles, rotation_matrix);
+                back = 1 - atomic_load(&front_buffer);
+                /* odd: buffer is being written */
+                atomic_fetch_add_explicit(&frame_seq[back], 1, memory_order_acq_rel);
+                sx = sy = sz = 0.0f;
+            }
+        }
+        /* implied barrier: every thread sees the same running */
+        if (!running) break;
+
+#       pragma omp for schedule(static) reduction(+: sx, sy, sz)
+        for (b = 0; b < num_blocks; b++)
+        {
+            long first = b * BLOCK_VECTORS;
+            long count = num_vectors - first;
+            float* out = &frame_vectors[back][3*first];
+            float bx = 0.0f, by = 0.0f, bz = 0.0f;
+            if (count > BLOCK_VECTORS) count = BLOCK_VECTORS;
+            rotateVectors(rotation_matrix, &original_vectors[3*first], out, count);
+#           pragma omp simd reduction(+: bx, by, bz)
+            for (v = 0; v < count; v++)
+            {
+                bx += out[3*v];
+                by += out[3*v + 1];
+                bz += out[3*v + 2];
+            }
+            sx += bx;
+            sy += by;
+            sz += bz;
+        }
+
+#       pragma omp single
+        {
+            frame_result[back][0] = sx;
+            frame_result[back][1] = sy;
+            frame_result[back][2] = sz;
+            /* even again, then publish */
+            atomic_fetch_add_explicit(&frame_seq[back], 1, memory_order_release);
+            atomic_store_explicit(&front_buffer, back, memory_order_release);
+
+            if (frames == capacity)
+            {
+                capacity = (capacity > 0) ? 2*capacity : 1024;
+                latencies = (double*)realloc(latencies, capacity*sizeof(double));
+            }
+            latencies[frames++] = omp_get_wtime() - frame_start;
+#if PRINT_FRAMES == 1
+            {
+                float result[3];
+                readFrame(NULL, result);
+                printf("frame %ld Result = [%0.2f, %0.2f, %0.2f]\n", frames, result[0], result[1], result[2]);
+                fflush(stdout);
+            }
+#endif
+        }
+    }
+}
+
+    *latencies_p = latencies;
+    return frames;
+}
+
+/* copy the latest complete frame (if copy != NULL) and its sum.
+   Safe to call from any thread while frames are being produced: the
+   copy is retried if the buffer was rewritten while it was read.
+   Returns the sequence number of the frame that was read. */
+long readFrame(float* copy, float result[3])
+{
+    long before, after;
+    int buf;
+
+    while (1)
+    {
+        buf = atomic_load_explicit(&front_buffer, memory_order_acquire);
+        before = atomic_load_explicit(&frame_seq[buf], memory_order_acquire);
+        if (before & 1) continue;   /* being written, look again */
+        if (copy != NULL)
+            memcpy(copy, frame_vectors[buf], 3*num_vectors*sizeof(float));
+        memcpy(result, frame_result[buf], 3*sizeof(float));
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&frame_seq[buf], memory_order_relaxed);
+        if (before == after) return before;
+    }
+}
+
+int compareDoubles(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/* print frame latency percentiles in microseconds */
+void printLatencies(double* latencies, long frames)
+{
+    const double percents[] = { 50.0, 90.0, 99.0, 99.9 };
+    int i;
+
+    printf("Number of threads: %d\n", num_threads);
+    printf("frames = %ld\n", frames);
+    if (frames == 0) return;
+    qsort(latencies, frames, sizeof(double), compareDoubles);
+    for (i = 0; i < 4; i++)
+    {
+        long k = (long)ceil(percents[i] / 100.0 * frames) - 1;
+        if (k < 0) k = 0;
+        printf("p%-5g latency = %10.1f us\n", percents[i], latencies[k] * 1e6);
+    }
+    printf("max    latency = %10.1f us\n", latencies[frames-1] * 1e6);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* print command line usage message and abort program. */
+void usage(char* prog_name) {
+	fprintf(stderr, "usage: %s <fn> <number of threads> [angle pipe]\n", prog_name);
+	fprintf(stderr, "   <fn> is name of the file containing the vectors\n");
+	fprintf(stderr, "   [angle pipe] lines of pitch, yaw, roll (default stdin)\n");
+	exit(0);
+}
+
+/* interpret command lines and store in shared variables */
+void processCommandLine(int argc, char* argv[]) {
+	if (argc != 3 && argc != 4) usage(argv[0]);
+	input_file_name = argv[1];
+	num_threads = atoi(argv[2]);
+	if (argc == 4) angle_file_name = argv[3];
+	if (num_threads < 1) usage(argv[0]);
+}
@@ -0,0 +1,167 @@
+/* File:     shm_channel.h
+ * COMP 137 - OpenMPHW
+ *
+ * Purpose:  A one-writer, one-reader channel for batches of 3D vectors
+ *           in a POSIX shared memory segment, so a producer can hand
+ *           vectors to the rotate tools without going through a file.
+ *
+ * Layout:   a SHM_CHANNEL header followed by capacity vectors
+ *           (x0, y0, z0, x1, ...) starting at header_size bytes.
+ *
+ * Protocol: ready and consumed count batches.  The writer waits until
+ *           consumed == ready (the reader is done with the last batch),
+ *           fills in the vectors and num_vectors, and increments ready.
+ *           The reader waits until ready > consumed, uses the batch in
+ *           place, and increments consumed.  Neither side ever locks;
+ *           each counter has a single writer and lives on its own cache
+ *           line.  closed tells the reader no more batches will come.
+ *
+ * Compile:  add -lrt on systems where shm_open is not in libc.
+ */
+#ifndef _SHM_CHANNEL_H_
+#define _SHM_CHANNEL_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdatomic.h>
+
+#define SHM_CHANNEL_MAGIC 0x524f5431u   /* "ROT1" */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t header_size;       /* offset of the first vector */
+    uint64_t capacity;          /* vectors the segment can hold */
+    uint64_t num_vectors;       /* vectors in the current batch */
+    float    angles[3];         /* rotation of the current batch */
+    float    result[3];         /* sum, filled in by the rotate tool */
+    _Alignas(64) atomic_uint_fast64_t ready;      /* written by the writer only */
+    _Alignas(64) atomic_uint_fast64_t consumed;   /* written by the reader only */
+    _Alignas(64) atomic_int closed;
+} SHM_CHANNEL;
+
+#define SHM_CHANNEL_HEADER_SIZE \
+    ((sizeof(SHM_CHANNEL) + 63) / 64 * 64)
+
+/* the vectors that follow the header */
+static inline float* shmChannelVectors(SHM_CHANNEL* ch)
+{
+    return (float*)((char*)ch + ch->header_size);
+}
+
+/* create (or replace) a segment holding up to capacity vectors */
+static inline SHM_CHANNEL* shmChannelCreate(const char* name, uint64_t capacity)
+{
+    size_t size = SHM_CHANNEL_HEADER_SIZE + 3*capacity*sizeof(float);
+    SHM_CHANNEL* ch;
+    int fd;
+
+    fd = shm_open(name, O_CREAT | O_RDWR, 0600);
+    if (fd < 0) return NULL;
+    if (ftruncate(fd, size) != 0)
+    {
+        close(fd);
+        return NULL;
+    }
+    ch = (SHM_CHANNEL*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ch == MAP_FAILED) return NULL;
+
+    ch->magic = 0;
+    ch->header_size = SHM_CHANNEL_HEADER_SIZE;
+    ch->capacity = capacity;
+    ch->num_vectors = 0;
+    atomic_init(&ch->ready, 0);
+    atomic_init(&ch->consumed, 0);
+    atomic_init(&ch->closed, 0);
+    /* magic last, so an attaching reader never sees half a header */
+    atomic_thread_fence(memory_order_release);
+    ch->magic = SHM_CHANNEL_MAGIC;
+    return ch;
+}
+
+/* map an existing segment, NULL if it does not exist (yet) */
+static inline SHM_CHANNEL* shmChannelAttach(const char* name)
+{
+    struct stat st;
+    SHM_CHANNEL* ch;
+    int fd;
+
+    fd = shm_open(name, O_RDWR, 0600);
+    if (fd < 0) return NULL;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < SHM_CHANNEL_HEADER_SIZE)
+    {
+        close(fd);
+        return NULL;
+    }
+    ch = (SHM_CHANNEL*)mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ch == MAP_FAILED) return NULL;
+    atomic_thread_fence(memory_order_acquire);
+    if (ch->magic != SHM_CHANNEL_MAGIC
+        || (size_t)st.st_size < ch->header_size + 3*ch->capacity*sizeof(float))
+    {
+        munmap(ch, st.st_size);
+        return NULL;
+    }
+    return ch;
+}
+
+static inline void shmChannelDetach(SHM_CHANNEL* ch)
+{
+    munmap(ch, ch->header_size + 3*ch->capacity*sizeof(float));
+}
+
+/* spin for a while, then give the processor away */
+static inline void shmChannelPause(long* spins)
+{
+    if (++(*spins) > 1000) sched_yield();
+}
+
+/* writer: wait until the reader has released the last batch */
+static inline void shmChannelWaitWritable(SHM_CHANNEL* ch)
+{
+    long spins = 0;
+    uint64_t ready = atomic_load_explicit(&ch->ready, memory_order_relaxed);
+    while (atomic_load_explicit(&ch->consumed, memory_order_acquire) != ready)
+        shmChannelPause(&spins);
+}
+
+/* writer: the batch in the segment is complete */
+static inline void shmChannelPublish(SHM_CHANNEL* ch)
+{
+    atomic_fetch_add_explicit(&ch->ready, 1, memory_order_release);
+}
+
+/* writer: no more batches */
+static inline void shmChannelClose(SHM_CHANNEL* ch)
+{
+    atomic_store_explicit(&ch->closed, 1, memory_order_release);
+}
+
+/* reader: wait for a batch, returns 0 if the writer closed instead */
+static inline int shmChannelWaitReadable(SHM_CHANNEL* ch)
+{
+    long spins = 0;
+    uint64_t consumed = atomic_load_explicit(&ch->consumed, memory_order_relaxed);
+    while (atomic_load_explicit(&ch->ready, memory_order_acquire) == consumed)
+    {
+        if (atomic_load_explicit(&ch->closed, memory_order_acquire)
+            && atomic_load_explicit(&ch->ready, memory_order_acquire) == consumed)
+            return 0;
+        shmChannelPause(&spins);
+    }
+    return 1;
+}
+
+/* reader: done with the batch, the writer may reuse the segment */
+static inline void shmChannelRelease(SHM_CHANNEL* ch)
+{
+    atomic_fetch_add_explicit(&ch->consumed, 1, memory_order_release);
+}
+
+#endif
@@ -0,0 +1,90 @@
+/* shm_producer.c
+ * COMP 137 - OpenMPHW
+ *
+ * Program functionality:
+ * Example producer for rotate_shm.  Creates the input (and optionally
+ * the output) shared memory segments, then publishes a number of
+ * batches.  Each batch holds the vectors of a text file with the yaw
+ * advanced a little per batch; when an output segment is used, the sum
+ * computed by rotate_shm is read back and printed.
+ *
+ * A real producer would generate its vectors straight into
+ * shmChannelVectors(); here they are copied from the file once per batch.
+ *
+ * How to compile: gcc -O3 -fopenmp -o shm_producer shm_producer.c -lm -lrt
+ * Usage: ./shm_producer <input segment> <output segment|-> <fn> <batches>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "vector_rotate.h"
+#include "shm_channel.h"
+
+/*--------------------------------------------------------------------*/
+
+/* print command line usage message and abort program. */
+void usage(char* prog_name) {
+	fprintf(stderr, "usage: %s <input segment> <output segment|-> <fn> <batches>\n", prog_name);
+	fprintf(stderr, "   <fn> is name of the file containing the vectors to publish\n");
+	exit(0);
+}
+
+int main(int argc, char* argv[])
+{
+    SHM_CHANNEL* in_ch;
+    SHM_CHANNEL* out_ch = NULL;
+    float angles[3];
+    float* vectors;
+    long num_vectors, batch, num_batches;
+
+    if (argc != 5) usage(argv[0]);
+    num_batches = atol(argv[4]);
+
+    vectors = readInputDatafile(argv[3], &num_vectors, angles);
+    if (vectors == NULL)
+    {
+        fprintf(stderr, "could not read input file %s\n", argv[3]);
+        exit(0);
+    }
+
+    in_ch = shmChannelCreate(argv[1], num_vectors);
+    if (strcmp(argv[2], "-") != 0) out_ch = shmChannelCreate(argv[2], num_vectors);
+    if (in_ch == NULL || (strcmp(argv[2], "-") != 0 && out_ch == NULL))
+    {
+        fprintf(stderr, "could not create shared memory\n");
+        exit(0);
+    }
+
+    for (batch = 0; batch < num_batches; batch++)
+    {
+        shmChannelWaitWritable(in_ch);
+        memcpy(shmChannelVectors(in_ch), vectors, 3*num_vectors*sizeof(float));
+        in_ch->num_vectors = num_vectors;
+        in_ch->angles[0] = angles[0];
+        in_ch->angles[1] = angles[1] + 0.01f * batch;
+        in_ch->angles[2] = angles[2];
+        shmChannelPublish(in_ch);
+
+        if (out_ch != NULL)
+        {
+            if (!shmChannelWaitReadable(out_ch)) break;
+            printf("batch %ld Result = [%0.2f, %0.2f, %0.2f]\n", batch,
+                   out_ch->result[0], out_ch->result[1], out_ch->result[2]);
+            shmChannelRelease(out_ch);
+        }
+    }
+    /* let the last batch be consumed before closing */
+    shmChannelWaitWritable(in_ch);
+    shmChannelClose(in_ch);
+
+    shmChannelDetach(in_ch);
+    shm_unlink(argv[1]);
+    if (out_ch != NULL)
+    {
+        shmChannelDetach(out_ch);
+        shm_unlink(argv[2]);
+    }
+    free(vectors);
+    return 0;
+}
@@ -0,0 +1,266 @@
+/* File:     vector_rotate.h
+ * COMP 137 - OpenMPHW
+ *
+ * Purpose:  Pieces shared by the OpenMP vector rotate tools: the input
+ *           file reader, the rotation matrix and the 3x3 math, plus a
+ *           SIMD rotate kernel that works on a block of vectors.
+ *
+ * Note:     Vectors are stored the same way readInputDatafile returns
+ *           them: x0, y0, z0, x1, y1, z1, ...
+ *
+ *           Everything here is static, so a tool only has to include
+ *           this file and compile as usual:
+ *           gcc -O3 -march=native -fopenmp -o tool tool.c -lm
+ *
+ *           multMatrixMatrix uses a[8] for the last column of the third
+ *           row; the copy in parallel_vector_rotate.c uses a[7] there, so
+ *           the tools report a different (correct) Result for input1.txt.
+ */
+#ifndef _VECTOR_ROTATE_H_
+#define _VECTOR_ROTATE_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#if defined(__AVX__) || defined(__SSE__)
+#include <immintrin.h>
+#endif
+
+/* number of vectors rotated at a time by the blocked kernels;
+   1024 vectors in + out is 24KB, which stays in L1 */
+#define BLOCK_VECTORS 1024
+
+/* vectors per step of the streaming kernel; 1024 vectors is 12KB */
+#define STREAM_VECTORS 1024
+
+/* vectors rotated per input prefetch of the streaming kernel: 16
+   vectors are 192 bytes, three cache lines */
+#define PREFETCH_STEP_VECTORS 16
+
+/* read the input data file */
+static inline float* readInputDatafile(char* filename, long* num_vects, float angles[3])
+{
+	long i = 0, j = 0, n = 0;
+	float* input_vectors;
+
+	FILE* fp = fopen(filename, "r");
+	if (fp == NULL) return NULL;
+	if (fscanf(fp, "%f, %f, %f\n", &(angles[0]), &(angles[1]), &(angles[2])) != 3
+	    || fscanf(fp, "%ld\n", &n) != 1 || n < 0)
+	{
+		fclose(fp);
+		return NULL;
+	}
+	*num_vects = n;
+	input_vectors = (float*)malloc(3 * (n > 0 ? n : 1) * sizeof(float));
+	for (i = 0; i<n; i++)
+	{
+		if (fscanf(fp, "%f, %f, %f\n", &(input_vectors[j]), &(input_vectors[j + 1]), &(input_vectors[j + 2])) != 3)
+		{
+			free(input_vectors);
+			fclose(fp);
+			return NULL;
+		}
+		j += 3;
+	}
+	fclose(fp);
+	return input_vectors;
+}
+
+/*--------------------------------------------------------------------*/
+/*
+ * Matrix and vector mathematics
+ * These functions are thread safe.
+*/
+
+static inline void multMatrixMatrix(const float a[9], const float b[9], float c[9])
+{
+	/* c = a*b */
+	c[0] = a[0] * b[0] + a[1] * b[3] + a[2] * b[6];
+	c[1] = a[0] * b[1] + a[1] * b[4] + a[2] * b[7];
+	c[2] = a[0] * b[2] + a[1] * b[5] + a[2] * b[8];
+	c[3] = a[3] * b[0] + a[4] * b[3] + a[5] * b[6];
+	c[4] = a[3] * b[1] + a[4] * b[4] + a[5] * b[7];
+	c[5] = a[3] * b[2] + a[4] * b[5] + a[5] * b[8];
+	c[6] = a[6] * b[0] + a[7] * b[3] + a[8] * b[6];
+	c[7] = a[6] * b[1] + a[7] * b[4] + a[8] * b[7];
+	c[8] = a[6] * b[2] + a[7] * b[5] + a[8] * b[8];
+}
+
+static inline void multMatrixVector(const float a[9], const float b[3], float c[3])
+{
+	/* c = a*b */
+	c[0] = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	c[1] = a[3] * b[0] + a[4] * b[1] + a[5] * b[2];
+	c[2] = a[6] * b[0] + a[7] * b[1] + a[8] * b[2];
+}
+
+static inline void addVectorVector(const float a[3], const float b[3], float c[3])
+{
+	/* c = a + b */
+	c[0] = a[0] + b[0];
+	c[1] = a[1] + b[1];
+	c[2] = a[2] + b[2];
+}
+
+static inline void computeRotationMatrix(const float angles[3], float rotation_matrix[9])
+{
+	float r = angles[2]; /* roll (radians) */
+	float p = angles[0]; /* pitch (radians) */
+	float y = angles[1]; /* yaw (radians) */
+	float rx[9] =
+	{ 1.0f,       0.0f,       0.0f,
+		0.0f,       cosf(p),     -sinf(p),
+		0.0f,       sinf(p),     cosf(p)
+	};
+	float ry[9] =
+	{ cosf(y),    0.0f,       sinf(y),
+		0.0f,       1.0f,       0.0f,
+		-sinf(y),   0.0f,       cosf(y)
+	};
+	float rz[9] =
+	{ cosf(r),    -sinf(r),   0.0f,
+		sinf(r),    cosf(r),    0.0f,
+		0.0f,       0.0f,       1.0f
+	};
+	float ry_rx[9];
+	multMatrixMatrix(ry, rx, ry_rx);
+	multMatrixMatrix(ry_rx, rz, rotation_matrix);
+}
+
+/* min and max as a compare and select.  fminf/fmaxf also have to
+   handle NaN, which makes them library calls that keep the reduction
+   loops from vectorizing. */
+static inline float minf(float a, float b) { return (b < a) ? b : a; }
+static inline float maxf(float a, float b) { return (b > a) ? b : a; }
+
+/*--------------------------------------------------------------------*/
+
+/* rotate n vectors from in to out with the same matrix.
+   The matrix entries are copied to locals so the compiler keeps them
+   in registers and vectorizes across vectors. */
+static inline void rotateVectors(const float m[9], const float* restrict in,
+                                 float* restrict out, long n)
+{
+	const float m0 = m[0], m1 = m[1], m2 = m[2];
+	const float m3 = m[3], m4 = m[4], m5 = m[5];
+	const float m6 = m[6], m7 = m[7], m8 = m[8];
+	long v;
+
+#	pragma omp simd
+	for (v = 0; v < n; v++)
+	{
+		float x = in[3*v], y = in[3*v + 1], z = in[3*v + 2];
+		out[3*v]     = m0 * x + m1 * y + m2 * z;
+		out[3*v + 1] = m3 * x + m4 * y + m5 * z;
+		out[3*v + 2] = m6 * x + m7 * y + m8 * z;
+	}
+}
+
+/*--------------------------------------------------------------------*/
+/*
+ * Bandwidth-bound output
+ * When in + out is bigger than the last level cache, every ordinary
+ * store first reads its line from DRAM (read for ownership).  The
+ * streaming kernel rotates into an L1 buffer and writes it out with
+ * non-temporal stores, which skip that read, and prefetches the input
+ * prefetch_bytes ahead.
+*/
+
+/* copy count floats from L1 to dst with non-temporal stores */
+static inline void streamStoreFloats(float* restrict dst, const float* restrict src, long count)
+{
+	long i = 0;
+
+#if defined(__AVX__)
+	/* ordinary stores up to the first 32-byte boundary */
+	while (i < count && ((size_t)&dst[i] & 31) != 0)
+	{
+		dst[i] = src[i];
+		i++;
+	}
+	for (; i + 8 <= count; i += 8)
+		_mm256_stream_ps(&dst[i], _mm256_loadu_ps(&src[i]));
+#elif defined(__SSE__)
+	while (i < count && ((size_t)&dst[i] & 15) != 0)
+	{
+		dst[i] = src[i];
+		i++;
+	}
+	for (; i + 4 <= count; i += 4)
+		_mm_stream_ps(&dst[i], _mm_loadu_ps(&src[i]));
+#endif
+	for (; i < count; i++)
+		dst[i] = src[i];
+}
+
+/* rotateVectors with non-temporal output and input prefetch.
+   The input is prefetched as it is read: before each step of
+   PREFETCH_STEP_VECTORS vectors (three cache lines) the three lines
+   prefetch_bytes ahead of it are requested, so the distance is kept
+   all the way through.  Call _mm_sfence (streamFence) before other
+   threads read out. */
+static inline void rotateVectorsStreaming(const float m[9], const float* restrict in,
+                                          float* restrict out, long n, long prefetch_bytes)
+{
+	float block[3*STREAM_VECTORS] __attribute__((aligned(64)));
+	long first, count, v, step;
+
+	for (first = 0; first < n; first += STREAM_VECTORS)
+	{
+		count = n - first;
+		if (count > STREAM_VECTORS) count = STREAM_VECTORS;
+		if (prefetch_bytes > 0)
+			for (v = 0; v < count; v += PREFETCH_STEP_VECTORS)
+			{
+				/* prefetch never faults, so running past the end is harmless */
+				const char* p = (const char*)&in[3*(first + v)] + prefetch_bytes;
+				step = (count - v < PREFETCH_STEP_VECTORS) ? count - v : PREFETCH_STEP_VECTORS;
+				__builtin_prefetch(p, 0, 0);
+				__builtin_prefetch(p + 64, 0, 0);
+				__builtin_prefetch(p + 128, 0, 0);
+				rotateVectors(m, &in[3*(first + v)], &block[3*v], step);
+			}
+		else
+			rotateVectors(m, &in[3*first], block, count);
+		streamStoreFloats(&out[3*first], block, 3*count);
+	}
+}
+
+/* make this thread's non-temporal stores visible to the others */
+static inline void streamFence(void)
+{
+#if defined(__SSE__)
+	_mm_sfence();
+#endif
+}
+
+/* size in bytes of the last level data cache, 0 if unknown */
+static inline long lastLevelCacheSize(void)
+{
+	long size = 0;
+	int index;
+	char path[128];
+	FILE* fp;
+
+#ifdef _SC_LEVEL3_CACHE_SIZE
+	size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+	if (size <= 0) size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+	if (size > 0) return size;
+
+	/* the highest cache index listed in sysfs is the last level */
+	for (index = 0; index < 8; index++)
+	{
+		long kb;
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/size", index);
+		fp = fopen(path, "r");
+		if (fp == NULL) break;
+		if (fscanf(fp, "%ldK", &kb) == 1) size = kb * 1024;
+		fclose(fp);
+	}
+	return size > 0 ? size : 0;
+}
+
+#endif